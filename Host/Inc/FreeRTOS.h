@@ -0,0 +1,77 @@
+/**
+ ******************************************************************************
+ * @file    FreeRTOS.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+/* Host stand-in for the subset of the FreeRTOS kernel API used by the pipeline.
+ * Tasks map to pthreads and semaphores to mutex/condvar pairs. Priorities are
+ * recorded but not enforced by the host scheduler.
+ */
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+#define pdFALSE ((BaseType_t) 0)
+#define pdTRUE ((BaseType_t) 1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t) 1)
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+#define configTICK_RATE_HZ ((TickType_t) 1000)
+#define configMAX_PRIORITIES (56)
+#define configMINIMAL_STACK_SIZE ((uint16_t) 1024)
+#define configRUN_TIME_COUNTER_TYPE size_t
+#define configSTACK_DEPTH_TYPE uint16_t
+#define tskIDLE_PRIORITY ((UBaseType_t) 0)
+
+#define portYIELD_FROM_ISR(x) ((void) (x))
+#define portGET_RUN_TIME_COUNTER_VALUE() sim_rtos_run_time_counter()
+
+typedef struct sim_rtos_sem {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  UBaseType_t count;
+  UBaseType_t max;
+} StaticSemaphore_t;
+
+typedef struct sim_rtos_task {
+  pthread_t thread;
+  TaskFunction_t fct;
+  void *arg;
+  const char *name;
+  UBaseType_t priority;
+  uint32_t stack_depth;
+  /* cpu time charged with sim_cpu_busy_us() */
+  uint64_t busy_us;
+  StaticSemaphore_t notify;
+} StaticTask_t;
+
+BaseType_t xPortIsInsideInterrupt(void);
+configRUN_TIME_COUNTER_TYPE sim_rtos_run_time_counter(void);
+
+#endif /* INC_FREERTOS_H */
@@ -0,0 +1,32 @@
+/**
+ ******************************************************************************
+ * @file    arm_math.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+/* Host stand-in for the CMSIS-DSP types referenced by the postprocess headers */
+#ifndef ARM_MATH_H
+#define ARM_MATH_H
+
+#include <math.h>
+#include <stdint.h>
+
+typedef float float32_t;
+typedef double float64_t;
+typedef int8_t q7_t;
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+#endif /* ARM_MATH_H */
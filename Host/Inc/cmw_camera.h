@@ -0,0 +1,33 @@
+/**
+ ******************************************************************************
+ * @file    cmw_camera.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+/* Host stand-in for the camera middleware definitions used by the pipeline */
+#ifndef CMW_CAMERA_H
+#define CMW_CAMERA_H
+
+#include <stdint.h>
+
+#include "stm32n6xx_hal.h"
+
+#define CMW_MODE_CONTINUOUS 0U
+#define CMW_MODE_SNAPSHOT 1U
+
+int CMW_CAMERA_PIPE_FrameEventCallback(uint32_t pipe);
+int CMW_CAMERA_PIPE_VsyncEventCallback(uint32_t pipe);
+
+#endif /* CMW_CAMERA_H */
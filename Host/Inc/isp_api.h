@@ -0,0 +1,23 @@
+/**
+ ******************************************************************************
+ * @file    isp_api.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+/* Host stand-in: the ISP library is driven through CAM_IspUpdate() only */
+#ifndef ISP_API_H
+#define ISP_API_H
+
+#endif /* ISP_API_H */
@@ -0,0 +1,61 @@
+/**
+ ******************************************************************************
+ * @file    ll_aton_reloc_network.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+/* Host stand-in for the relocatable model support. The binary is never read, sim_aton.c installs a
+ * network with the default model geometry at the cost given by the simulator config.
+ */
+#ifndef __LL_ATON_RELOC_NETWORK_H
+#define __LL_ATON_RELOC_NETWORK_H
+
+#include <stdint.h>
+
+#include "ll_aton_rt_user_api.h"
+
+#define AI_RELOC_RT_LOAD_MODE_XIP   (1 << 0)
+#define AI_RELOC_RT_LOAD_MODE_COPY  (1 << 1)
+#define AI_RELOC_RT_LOAD_MODE_CLEAR (1 << 2)
+
+#define AI_RELOC_RT_ERR_NONE        (0)
+#define AI_RELOC_RT_ERR_INVALID_BIN (-1)
+#define AI_RELOC_RT_ERR_MEMORY      (-2)
+#define AI_RELOC_RT_ERR_ARG         (-4)
+
+typedef struct _ll_aton_reloc_info {
+  const char *c_name;
+  uint32_t code_sz;
+  uint32_t params_sz;
+  uint32_t acts_sz;
+  uint32_t ext_ram_sz;
+  uint32_t rt_ram_xip;
+  uint32_t rt_ram_copy;
+} ll_aton_reloc_info;
+
+typedef struct _ll_aton_reloc_config {
+  uintptr_t exec_ram_addr;
+  uint32_t exec_ram_size;
+  uintptr_t ext_ram_addr;
+  size_t ext_ram_size;
+  uintptr_t ext_param_addr;
+  uint32_t mode;
+} ll_aton_reloc_config;
+
+int ll_aton_reloc_get_info(const uintptr_t file_ptr, ll_aton_reloc_info *rt);
+int ll_aton_reloc_install(const uintptr_t file_ptr, const ll_aton_reloc_config *config,
+                          NN_Instance_TypeDef *nn_instance);
+
+#endif /* __LL_ATON_RELOC_NETWORK_H */
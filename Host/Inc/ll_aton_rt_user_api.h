@@ -0,0 +1,105 @@
+/**
+ ******************************************************************************
+ * @file    ll_aton_rt_user_api.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+/* Host stand-in for the LL_ATON runtime user API. A network is modeled as a
+ * sequence of epoch blocks whose durations come from the simulator config.
+ */
+#ifndef __LL_ATON_RT_USER_API
+#define __LL_ATON_RT_USER_API
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stm32n6xx_hal.h"
+
+typedef enum LL_ATON_RT_RetValues {
+  LL_ATON_RT_NO_WFE = 0,
+  LL_ATON_RT_WFE,
+  LL_ATON_RT_DONE,
+} LL_ATON_RT_RetValues_t;
+
+typedef enum {
+  LL_ATON_User_IO_NOERROR = 0,
+  LL_ATON_User_IO_WRONG_ALIGNMENT,
+  LL_ATON_User_IO_WRONG_LENGTH,
+  LL_ATON_User_IO_WRONG_INDEX,
+} LL_ATON_User_IO_Result_t;
+
+typedef struct {
+  const char *name;
+  uint32_t offset_start;
+  uint32_t offset_end;
+  uint8_t is_user_allocated;
+} LL_Buffer_InfoTypeDef;
+
+typedef const LL_Buffer_InfoTypeDef *(*NN_Buffers_Info_TypeDef)(void);
+
+typedef struct {
+  const char *network_name;
+  NN_Buffers_Info_TypeDef input_buffers_info;
+  NN_Buffers_Info_TypeDef output_buffers_info;
+} NN_Interface_TypeDef;
+
+typedef struct {
+  int epoch_block_idx;
+  int is_block_started;
+  uint64_t block_end_us;
+  void *user_input;
+  void *user_output;
+} NN_Execution_State_TypeDef;
+
+typedef struct __nn_instance_struct {
+  const NN_Interface_TypeDef *network;
+  NN_Execution_State_TypeDef exec_state;
+} NN_Instance_TypeDef;
+
+/* sim_aton.c provides the buffer info of each network name the application declares */
+#define LL_ATON_DECLARE_NAMED_NN_INTERFACE(nn_if_name)                                                                 \
+  const LL_Buffer_InfoTypeDef *sim_aton_##nn_if_name##_input_buffers_info(void);                                       \
+  const LL_Buffer_InfoTypeDef *sim_aton_##nn_if_name##_output_buffers_info(void);                                      \
+  static const NN_Interface_TypeDef NN_Interface_##nn_if_name = {                                                      \
+      .network_name = #nn_if_name,                                                                                     \
+      .input_buffers_info = &sim_aton_##nn_if_name##_input_buffers_info,                                               \
+      .output_buffers_info = &sim_aton_##nn_if_name##_output_buffers_info}
+
+#define LL_ATON_DECLARE_NAMED_NN_INSTANCE(nn_exec_name, nn_if_ptr)                                                     \
+  static NN_Instance_TypeDef NN_Instance_##nn_exec_name = {.network = nn_if_ptr, .exec_state = {0}}
+
+#define LL_ATON_DECLARE_NAMED_NN_INSTANCE_AND_INTERFACE(nn_name)                                                       \
+  LL_ATON_DECLARE_NAMED_NN_INTERFACE(nn_name);                                                                         \
+  LL_ATON_DECLARE_NAMED_NN_INSTANCE(nn_name, &NN_Interface_##nn_name);
+
+static inline uint32_t LL_Buffer_len(const LL_Buffer_InfoTypeDef *buf)
+{
+  return buf->offset_end - buf->offset_start;
+}
+
+void LL_ATON_RT_RuntimeInit(void);
+void LL_ATON_RT_Init_Network(NN_Instance_TypeDef *nn_instance);
+LL_ATON_RT_RetValues_t LL_ATON_RT_RunEpochBlock(NN_Instance_TypeDef *nn_instance);
+void LL_ATON_RT_Reset_Network(NN_Instance_TypeDef *nn_instance);
+LL_ATON_User_IO_Result_t LL_ATON_Set_User_Input_Buffer(NN_Instance_TypeDef *nn_instance, uint32_t num, void *buffer,
+                                                       uint32_t size);
+LL_ATON_User_IO_Result_t LL_ATON_Set_User_Output_Buffer(NN_Instance_TypeDef *nn_instance, uint32_t num, void *buffer,
+                                                        uint32_t size);
+void sim_aton_wfe(void);
+
+#define LL_ATON_OSAL_WFE() sim_aton_wfe()
+
+#endif /* __LL_ATON_RT_USER_API */
@@ -0,0 +1,134 @@
+/**
+ ******************************************************************************
+ * @file    sim.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+#include "svc/app_stats.h"
+
+#define SIM_LATENCY_SAMPLES_MAX 4096
+
+typedef struct {
+  /* frame event timeline */
+  int fps;
+  int frames;
+  uint32_t jitter_us;
+  const char *timeline;
+  /* capture geometry */
+  int width;
+  int height;
+  /* per-stage latencies */
+  uint32_t isp_us;
+  uint32_t nn_us;
+  int nn_epoch_blocks;
+  /* LL_ATON_RT_Init_Network() cpu time */
+  uint32_t nn_init_us;
+  /* Alt detector */
+  uint32_t alt_nn_us;
+  /* ll_aton_reloc_install() cpu time, the partition can also hold no valid binary */
+  uint32_t reloc_install_us;
+  int reloc_is_invalid;
+  uint32_t model_switch_ms;
+  uint32_t pp_us;
+  int detections;
+  /* cascade second stage, per ROI */
+  uint32_t roi_us;
+  uint32_t enc_us;
+  uint32_t enc_p_bytes;
+  uint32_t enc_i_bytes;
+  int enc_slice_rows;
+  /* every Nth sliced frame fails after its first slice, 0 never */
+  uint32_t enc_fail_period;
+  uint32_t dma2d_setup_us;
+  uint32_t dma2d_mpix_s;
+  uint32_t usb_kbps;
+  uint32_t usb_start_ms;
+  int usb_stream;
+  int usb_switch_stream;
+  uint32_t usb_switch_ms;
+  int debug_overlay;
+  /* PSRAM bandwidth model */
+  uint32_t psram_mbps;
+  int ipplug_split;
+  int ipplug_wlru[2];
+  int ipplug_sweep;
+  const char *trace;
+  const char *cpu_stats;
+} sim_conf_t;
+
+typedef struct {
+  uint32_t pipe_frames[3];
+  uint32_t nn_drops;
+  uint32_t enc_frames;
+  uint32_t enc_intra;
+  uint32_t enc_errors;
+  uint32_t enc_rc_changes;
+  uint32_t cam_resizes;
+  uint32_t uvc_switches;
+  uint32_t uvc_rejects;
+  uint32_t uvc_aborts;
+  uint32_t uvc_frames;
+  uint64_t uvc_bytes;
+  uint32_t dma2d_ops;
+  uint64_t dma2d_busy_us;
+  uint64_t dma2d_bytes;
+  uint64_t capture_bytes;
+  uint64_t enc_in_bytes;
+  uint32_t latency_nb;
+  uint32_t latency_us[SIM_LATENCY_SAMPLES_MAX];
+} sim_report_t;
+
+/* PSRAM traffic of one frame period, pipe1 then pipe2 writes go through the IPPlug */
+typedef struct {
+  double pipe_bytes[2];
+  double enc_bytes;
+  uint32_t enc_us;
+  double nn_bytes;
+  uint32_t nn_us;
+  double overlay_bytes;
+  uint32_t overlay_us;
+} sim_ipplug_load_t;
+
+extern sim_conf_t sim_conf;
+extern sim_report_t sim_report;
+
+/* time base and execution context */
+uint64_t sim_now_us(void);
+void sim_sleep_us(uint64_t us);
+void sim_sleep_until_us(uint64_t deadline_us);
+void sim_cpu_busy_us(uint32_t us);
+uint64_t sim_cpu_busy_total_us(void);
+void sim_rtos_task_busy_us(uint32_t us);
+/* Outermost handler is timed like the target IRQ handlers do */
+void sim_isr_enter(isr_src_t src);
+void sim_isr_exit(void);
+int sim_is_isr(void);
+void sim_report_lock(void);
+void sim_report_unlock(void);
+
+/* simulated peripherals */
+int sim_camera_run(void);
+uint64_t sim_camera_buffer_ts(const uint8_t *buffer);
+uint64_t sim_encoder_capture_ts(const void *p_out);
+
+/* bandwidth models */
+void sim_ipplug_report(const sim_ipplug_load_t *load);
+
+#endif /* SIM_H */
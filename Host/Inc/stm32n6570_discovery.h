@@ -0,0 +1,49 @@
+/**
+ ******************************************************************************
+ * @file    stm32n6570_discovery.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+/* Host stand-in for the board BSP: LEDs are no-ops, USER1 reflects the simulator configuration */
+#ifndef STM32N6570_DISCOVERY_H
+#define STM32N6570_DISCOVERY_H
+
+#include <stdint.h>
+
+#include "stm32n6xx_hal.h"
+
+#define BSP_ERROR_NONE 0
+
+typedef enum {
+  LED_GREEN = 0,
+  LED_RED = 1,
+} Led_TypeDef;
+
+typedef enum {
+  BUTTON_USER1 = 0,
+  BUTTON_USER2 = 1,
+} Button_TypeDef;
+
+typedef enum {
+  BUTTON_MODE_GPIO = 0,
+  BUTTON_MODE_EXTI = 1,
+} ButtonMode_TypeDef;
+
+int32_t BSP_LED_On(Led_TypeDef led);
+int32_t BSP_LED_Off(Led_TypeDef led);
+int32_t BSP_PB_Init(Button_TypeDef button, ButtonMode_TypeDef mode);
+int32_t BSP_PB_GetState(Button_TypeDef button);
+
+#endif /* STM32N6570_DISCOVERY_H */
@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ * @file    stm32n6xx_hal.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+/* Host stand-in for the HAL definitions referenced by the pipeline sources */
+#ifndef STM32N6xx_HAL_H
+#define STM32N6xx_HAL_H
+
+#include <assert.h>
+#include <stdint.h>
+
+#define __weak __attribute__((weak))
+#define assert_param(expr) assert(expr)
+
+typedef enum {
+  HAL_OK = 0x00,
+  HAL_ERROR = 0x01,
+  HAL_BUSY = 0x02,
+  HAL_TIMEOUT = 0x03,
+} HAL_StatusTypeDef;
+
+#define DCMIPP_PIPE0 0U
+#define DCMIPP_PIPE1 1U
+#define DCMIPP_PIPE2 2U
+
+#define GPIO_PIN_RESET 0
+#define GPIO_PIN_SET 1
+
+typedef struct {
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define CoreDebug (&sim_core_debug)
+extern CoreDebug_Type sim_core_debug;
+
+typedef struct {
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+
+/* CYCCNT is refreshed from the host clock on each access */
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define DWT (sim_dwt())
+DWT_Type *sim_dwt(void);
+
+extern uint32_t SystemCoreClock;
+
+#define __DMB() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+typedef struct {
+  uint32_t id;
+} PCD_TypeDef;
+
+typedef struct {
+  PCD_TypeDef *Instance;
+} PCD_HandleTypeDef;
+
+#define USB1_OTG_HS (&sim_usb1_otg_hs)
+extern PCD_TypeDef sim_usb1_otg_hs;
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t delay);
+
+#endif /* STM32N6xx_HAL_H */
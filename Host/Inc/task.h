@@ -0,0 +1,47 @@
+/**
+ ******************************************************************************
+ * @file    task.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef StaticTask_t *TaskHandle_t;
+
+/* Subset of the kernel TaskStatus_t fields */
+typedef struct {
+  TaskHandle_t xHandle;
+  const char *pcTaskName;
+  UBaseType_t uxCurrentPriority;
+  configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;
+  configSTACK_DEPTH_TYPE usStackHighWaterMark;
+} TaskStatus_t;
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fct, const char *name, uint32_t stack_depth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+configRUN_TIME_COUNTER_TYPE ulTaskGetIdleRunTimeCounter(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken);
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks);
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t status_nb,
+                                 configRUN_TIME_COUNTER_TYPE *total_run_time);
+
+#endif /* INC_TASK_H */
@@ -0,0 +1,216 @@
+/**
+ ******************************************************************************
+ * @file    sim_aton.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "ll_aton_rt_user_api.h"
+#include "ll_aton_reloc_network.h"
+#include "app/app_config.h"
+#include "network.h"
+#include "sim.h"
+
+/* Relocatable detector code and data, installed in COPY mode */
+#define SIM_ATON_RELOC_RAM_COPY (192 * 1024)
+
+/* Cascade second stage stand-in, a classifier with one quantized score per class */
+#define SIM_ATON_ROI_CLASS_NB 16
+
+static const LL_Buffer_InfoTypeDef sim_aton_inputs[] = {
+  {.name = "Input_0_out_0", .offset_start = 0, .offset_end = LL_ATON_DEFAULT_IN_1_SIZE_BYTES, .is_user_allocated = 1},
+  {.name = NULL},
+};
+
+static const LL_Buffer_InfoTypeDef sim_aton_outputs[] = {
+  {.name = "Output_0_out_0", .offset_start = 0, .offset_end = LL_ATON_DEFAULT_OUT_1_SIZE_BYTES, .is_user_allocated = 1},
+  {.name = NULL},
+};
+
+static const LL_Buffer_InfoTypeDef sim_aton_roi_inputs[] = {
+  {.name = "Input_0_out_0", .offset_start = 0, .offset_end = NN_ROI_WIDTH * NN_ROI_HEIGHT * 3, .is_user_allocated = 1},
+  {.name = NULL},
+};
+
+static const LL_Buffer_InfoTypeDef sim_aton_roi_outputs[] = {
+  {.name = "Output_0_out_0", .offset_start = 0, .offset_end = SIM_ATON_ROI_CLASS_NB, .is_user_allocated = 1},
+  {.name = NULL},
+};
+
+/* End of the epoch block currently running on the (single) NPU */
+static _Atomic uint64_t sim_aton_block_end_us;
+/* Same name as in ll_aton_runtime.c, every simulated block is a pure hardware one */
+NN_Instance_TypeDef *volatile __ll_current_aton_ip_owner;
+
+const LL_Buffer_InfoTypeDef *sim_aton_Default_input_buffers_info(void)
+{
+  return sim_aton_inputs;
+}
+
+const LL_Buffer_InfoTypeDef *sim_aton_Default_output_buffers_info(void)
+{
+  return sim_aton_outputs;
+}
+
+/* Alt detector shares the default model geometry */
+const LL_Buffer_InfoTypeDef *sim_aton_Alt_input_buffers_info(void)
+{
+  return sim_aton_inputs;
+}
+
+const LL_Buffer_InfoTypeDef *sim_aton_Alt_output_buffers_info(void)
+{
+  return sim_aton_outputs;
+}
+
+const LL_Buffer_InfoTypeDef *sim_aton_Roi_input_buffers_info(void)
+{
+  return sim_aton_roi_inputs;
+}
+
+const LL_Buffer_InfoTypeDef *sim_aton_Roi_output_buffers_info(void)
+{
+  return sim_aton_roi_outputs;
+}
+
+/* Relocatable detector shares the default model geometry and inference time */
+static const NN_Interface_TypeDef sim_aton_reloc_interface = {
+  .network_name = "Reloc",
+  .input_buffers_info = &sim_aton_Default_input_buffers_info,
+  .output_buffers_info = &sim_aton_Default_output_buffers_info,
+};
+
+int ll_aton_reloc_get_info(const uintptr_t file_ptr, ll_aton_reloc_info *rt)
+{
+  if (!file_ptr || sim_conf.reloc_is_invalid)
+    return AI_RELOC_RT_ERR_INVALID_BIN;
+
+  memset(rt, 0, sizeof(*rt));
+  rt->c_name = "network";
+  rt->code_sz = SIM_ATON_RELOC_RAM_COPY;
+  rt->rt_ram_copy = SIM_ATON_RELOC_RAM_COPY;
+
+  return AI_RELOC_RT_ERR_NONE;
+}
+
+int ll_aton_reloc_install(const uintptr_t file_ptr, const ll_aton_reloc_config *config,
+                          NN_Instance_TypeDef *nn_instance)
+{
+  if (!file_ptr || sim_conf.reloc_is_invalid)
+    return AI_RELOC_RT_ERR_INVALID_BIN;
+  if (!config || !nn_instance || !(config->mode & AI_RELOC_RT_LOAD_MODE_COPY))
+    return AI_RELOC_RT_ERR_ARG;
+  if (!config->exec_ram_addr || (config->exec_ram_addr & 7) || config->exec_ram_size < SIM_ATON_RELOC_RAM_COPY)
+    return AI_RELOC_RT_ERR_MEMORY;
+
+  /* copy and relocation of code and data, weights stay in flash */
+  sim_cpu_busy_us(sim_conf.reloc_install_us);
+  nn_instance->network = &sim_aton_reloc_interface;
+  memset(&nn_instance->exec_state, 0, sizeof(nn_instance->exec_state));
+
+  return AI_RELOC_RT_ERR_NONE;
+}
+
+static uint32_t sim_aton_network_us(const NN_Instance_TypeDef *nn_instance)
+{
+  if (strcmp(nn_instance->network->network_name, "Roi") == 0)
+    return sim_conf.roi_us;
+  if (strcmp(nn_instance->network->network_name, "Alt") == 0)
+    return sim_conf.alt_nn_us;
+
+  return sim_conf.nn_us;
+}
+
+void LL_ATON_RT_RuntimeInit(void)
+{
+  atomic_store(&sim_aton_block_end_us, 0);
+  __ll_current_aton_ip_owner = NULL;
+}
+
+void LL_ATON_RT_Init_Network(NN_Instance_TypeDef *nn_instance)
+{
+  sim_cpu_busy_us(sim_conf.nn_init_us);
+  LL_ATON_RT_Reset_Network(nn_instance);
+}
+
+LL_ATON_RT_RetValues_t LL_ATON_RT_RunEpochBlock(NN_Instance_TypeDef *nn_instance)
+{
+  NN_Execution_State_TypeDef *state = &nn_instance->exec_state;
+  const int blocks = sim_conf.nn_epoch_blocks > 0 ? sim_conf.nn_epoch_blocks : 1;
+  uint64_t now = sim_now_us();
+
+  /* like the target runtime, the call ending a block returns at its boundary */
+  if (state->is_block_started) {
+    if (now < state->block_end_us)
+      return LL_ATON_RT_WFE;
+    state->is_block_started = 0;
+    state->epoch_block_idx++;
+    __ll_current_aton_ip_owner = NULL;
+    return LL_ATON_RT_NO_WFE;
+  }
+
+  if (state->epoch_block_idx == blocks)
+    return LL_ATON_RT_DONE;
+
+  /* callers must serialize blocks, the target would block on the ATON lock */
+  assert(__ll_current_aton_ip_owner == NULL);
+  __ll_current_aton_ip_owner = nn_instance;
+  state->is_block_started = 1;
+  state->block_end_us = now + sim_aton_network_us(nn_instance) / blocks;
+  atomic_store(&sim_aton_block_end_us, state->block_end_us);
+
+  return LL_ATON_RT_WFE;
+}
+
+void LL_ATON_RT_Reset_Network(NN_Instance_TypeDef *nn_instance)
+{
+  nn_instance->exec_state.epoch_block_idx = 0;
+  nn_instance->exec_state.is_block_started = 0;
+  nn_instance->exec_state.block_end_us = 0;
+}
+
+LL_ATON_User_IO_Result_t LL_ATON_Set_User_Input_Buffer(NN_Instance_TypeDef *nn_instance, uint32_t num, void *buffer,
+                                                       uint32_t size)
+{
+  if (num != 0)
+    return LL_ATON_User_IO_WRONG_INDEX;
+  if (size < LL_Buffer_len(&nn_instance->network->input_buffers_info()[0]))
+    return LL_ATON_User_IO_WRONG_LENGTH;
+
+  nn_instance->exec_state.user_input = buffer;
+
+  return LL_ATON_User_IO_NOERROR;
+}
+
+LL_ATON_User_IO_Result_t LL_ATON_Set_User_Output_Buffer(NN_Instance_TypeDef *nn_instance, uint32_t num, void *buffer,
+                                                        uint32_t size)
+{
+  if (num != 0)
+    return LL_ATON_User_IO_WRONG_INDEX;
+  if (size < LL_Buffer_len(&nn_instance->network->output_buffers_info()[0]))
+    return LL_ATON_User_IO_WRONG_LENGTH;
+
+  nn_instance->exec_state.user_output = buffer;
+
+  return LL_ATON_User_IO_NOERROR;
+}
+
+void sim_aton_wfe(void)
+{
+  sim_sleep_until_us(atomic_load(&sim_aton_block_end_us));
+}
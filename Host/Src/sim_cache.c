@@ -0,0 +1,43 @@
+/**
+ ******************************************************************************
+ * @file    sim_cache.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include "fal/fal_cache.h"
+
+/* Host memory is coherent between the CPU and the simulated masters */
+int FAL_CacheIsEnabled(void)
+{
+  return 0;
+}
+
+void FAL_CacheInvalidate(void *addr, size_t len)
+{
+  (void) addr;
+  (void) len;
+}
+
+void FAL_CacheClean(void *addr, size_t len)
+{
+  (void) addr;
+  (void) len;
+}
+
+void FAL_CacheCleanInvalidate(void *addr, size_t len)
+{
+  (void) addr;
+  (void) len;
+}
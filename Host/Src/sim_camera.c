@@ -0,0 +1,303 @@
+/**
+ ******************************************************************************
+ * @file    sim_camera.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app/app_config.h"
+#include "fal/fal_camera.h"
+#include "sim.h"
+
+#define SIM_CAMERA_PIPE_NB 3
+#define SIM_CAMERA_TRACKED_BUFFERS 16
+
+/* DCMIPP model: a new address is latched at the next frame start, a frame end
+ * event reports the buffer that has just been written.
+ */
+typedef struct {
+  int is_started;
+  uint32_t frame_id;
+  uint8_t *dst;
+  uint8_t *pending;
+  int is_updated;
+} sim_pipe_t;
+
+typedef struct {
+  const uint8_t *buffer;
+  uint64_t ts;
+} sim_capture_t;
+
+static pthread_mutex_t sim_camera_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_pipe_t sim_pipes[SIM_CAMERA_PIPE_NB];
+static sim_capture_t sim_captures[SIM_CAMERA_TRACKED_BUFFERS];
+static int venc_width;
+static int venc_height;
+
+static void sim_camera_track(const uint8_t *buffer, uint64_t ts)
+{
+  int free_slot = -1;
+  int i;
+
+  for (i = 0; i < SIM_CAMERA_TRACKED_BUFFERS; i++) {
+    if (sim_captures[i].buffer == buffer) {
+      sim_captures[i].ts = ts;
+      return;
+    }
+    if (!sim_captures[i].buffer && free_slot < 0)
+      free_slot = i;
+  }
+  assert(free_slot >= 0);
+  sim_captures[free_slot].buffer = buffer;
+  sim_captures[free_slot].ts = ts;
+}
+
+uint64_t sim_camera_buffer_ts(const uint8_t *buffer)
+{
+  uint64_t ts = 0;
+  int i;
+
+  pthread_mutex_lock(&sim_camera_lock);
+  for (i = 0; i < SIM_CAMERA_TRACKED_BUFFERS; i++) {
+    if (sim_captures[i].buffer == buffer) {
+      ts = sim_captures[i].ts;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&sim_camera_lock);
+
+  return ts;
+}
+
+static void sim_camera_frame_start(uint32_t pipe)
+{
+  sim_pipe_t *p = &sim_pipes[pipe];
+
+  pthread_mutex_lock(&sim_camera_lock);
+  if (p->pending) {
+    p->dst = p->pending;
+    p->pending = NULL;
+  }
+  p->is_updated = 0;
+  /* ISP bumps its frame ids on vsync */
+  if (p->is_started)
+    p->frame_id++;
+  pthread_mutex_unlock(&sim_camera_lock);
+}
+
+static void sim_camera_frame_end(uint32_t pipe, uint64_t ts)
+{
+  sim_pipe_t *p = &sim_pipes[pipe];
+  int is_updated;
+
+  pthread_mutex_lock(&sim_camera_lock);
+  if (!p->is_started) {
+    pthread_mutex_unlock(&sim_camera_lock);
+    return;
+  }
+  sim_camera_track(p->dst, ts);
+  pthread_mutex_unlock(&sim_camera_lock);
+
+  sim_isr_enter(ISR_CAMERA);
+  CMW_CAMERA_PIPE_FrameEventCallback(pipe);
+  sim_isr_exit();
+
+  pthread_mutex_lock(&sim_camera_lock);
+  is_updated = p->is_updated;
+  pthread_mutex_unlock(&sim_camera_lock);
+
+  sim_report_lock();
+  sim_report.pipe_frames[pipe]++;
+  if (pipe == DCMIPP_PIPE1)
+    sim_report.capture_bytes += CAPTURE_FRAME_SIZE(venc_width, venc_height);
+  /* NN pipe keeps writing the same buffer when the app had none to give */
+  if (pipe == DCMIPP_PIPE2 && !is_updated)
+    sim_report.nn_drops++;
+  sim_report_unlock();
+}
+
+static void sim_camera_event(uint64_t ts)
+{
+  sim_camera_frame_end(DCMIPP_PIPE1, ts);
+  sim_camera_frame_end(DCMIPP_PIPE2, ts);
+
+  sim_isr_enter(ISR_CAMERA);
+  CMW_CAMERA_PIPE_VsyncEventCallback(DCMIPP_PIPE1);
+  sim_isr_exit();
+
+  sim_camera_frame_start(DCMIPP_PIPE1);
+  sim_camera_frame_start(DCMIPP_PIPE2);
+}
+
+static uint64_t sim_camera_jitter(void)
+{
+  if (!sim_conf.jitter_us)
+    return 0;
+
+  return (uint64_t) (rand() % (2 * sim_conf.jitter_us + 1));
+}
+
+/* Timeline file holds one frame end timestamp per line, in microseconds */
+static int sim_camera_run_file(const char *path, uint64_t t0)
+{
+  unsigned long long ts;
+  int frames = 0;
+  FILE *f;
+
+  f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return -1;
+  }
+
+  while (fscanf(f, "%llu", &ts) == 1) {
+    sim_sleep_until_us(t0 + ts);
+    sim_camera_event(sim_now_us());
+    frames++;
+  }
+  fclose(f);
+
+  return frames;
+}
+
+static int sim_camera_run_periodic(uint64_t t0)
+{
+  const uint64_t period_us = 1000000ULL / (uint64_t) sim_conf.fps;
+  int i;
+
+  for (i = 0; i < sim_conf.frames; i++) {
+    sim_sleep_until_us(t0 + (i + 1) * period_us + sim_camera_jitter());
+    sim_camera_event(sim_now_us());
+  }
+
+  return sim_conf.frames;
+}
+
+int sim_camera_run(void)
+{
+  uint64_t t0 = sim_now_us();
+
+  if (sim_conf.timeline)
+    return sim_camera_run_file(sim_conf.timeline, t0);
+
+  return sim_camera_run_periodic(t0);
+}
+
+void CAM_Init(void)
+{
+  venc_width = sim_conf.width;
+  venc_height = sim_conf.height;
+}
+
+static void CAM_PipeStart(uint32_t pipe, uint8_t *dst)
+{
+  pthread_mutex_lock(&sim_camera_lock);
+  sim_pipes[pipe].dst = dst;
+  sim_pipes[pipe].pending = NULL;
+  sim_pipes[pipe].is_started = 1;
+  sim_pipes[pipe].frame_id++;
+  pthread_mutex_unlock(&sim_camera_lock);
+}
+
+void CAM_DisplayPipe_Start(uint8_t *display_pipe_dst, uint32_t cam_mode)
+{
+  assert(cam_mode == CMW_MODE_CONTINUOUS);
+  CAM_PipeStart(DCMIPP_PIPE1, display_pipe_dst);
+}
+
+void CAM_NNPipe_Start(uint8_t *nn_pipe_dst, uint32_t cam_mode)
+{
+  assert(cam_mode == CMW_MODE_CONTINUOUS);
+  CAM_PipeStart(DCMIPP_PIPE2, nn_pipe_dst);
+}
+
+static int CAM_SetPipeAddress(uint32_t pipe, uint8_t *dst)
+{
+  if (!dst)
+    return -1;
+
+  pthread_mutex_lock(&sim_camera_lock);
+  sim_pipes[pipe].pending = dst;
+  sim_pipes[pipe].is_updated = 1;
+  pthread_mutex_unlock(&sim_camera_lock);
+
+  return 0;
+}
+
+/* New size applies to next frame; running frame keeps its geometry in the model */
+int CAM_DisplayPipe_SetSize(int width, int height)
+{
+  if (width <= 0 || height <= 0 || width > sim_conf.width || height > sim_conf.height)
+    return -1;
+
+  venc_width = width;
+  venc_height = height;
+  sim_report_lock();
+  sim_report.cam_resizes++;
+  sim_report_unlock();
+
+  return 0;
+}
+
+int CAM_DisplayPipe_UpdateAddress(uint8_t *display_pipe_dst)
+{
+  return CAM_SetPipeAddress(DCMIPP_PIPE1, display_pipe_dst);
+}
+
+int CAM_NNPipe_UpdateAddress(uint8_t *nn_pipe_dst)
+{
+  return CAM_SetPipeAddress(DCMIPP_PIPE2, nn_pipe_dst);
+}
+
+void CAM_IspUpdate(void)
+{
+  sim_cpu_busy_us(sim_conf.isp_us);
+}
+
+uint32_t CAM_GetFrameId(uint32_t pipe)
+{
+  uint32_t frame_id;
+
+  pthread_mutex_lock(&sim_camera_lock);
+  frame_id = sim_pipes[pipe].frame_id;
+  pthread_mutex_unlock(&sim_camera_lock);
+
+  return frame_id;
+}
+
+/* Auto exposure is not modeled: full frame period exposure, no gain */
+void CAM_GetSensorState(int32_t *exposure, int32_t *gain)
+{
+  *exposure = 1000000 / sim_conf.fps;
+  *gain = 0;
+}
+
+int CAM_GetVencWidth(void)
+{
+  assert(venc_width);
+
+  return venc_width;
+}
+
+int CAM_GetVencHeight(void)
+{
+  assert(venc_height);
+
+  return venc_height;
+}
@@ -0,0 +1,291 @@
+/**
+ ******************************************************************************
+ * @file    sim_dma2d.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "fal/fal_dma2d.h"
+#include "sim.h"
+
+/* Queued transfers are executed in software by a worker thread that plays the
+ * role of the DMA2D engine and raises completion from "interrupt" context. Next
+ * transfer starts when previous one ends, as it does from the completion ISR.
+ */
+typedef struct {
+  int is_fill;
+  fal_dma2d_fill_t fill;
+  fal_dma2d_blend_t blend;
+} sim_dma2d_op_t;
+
+static pthread_mutex_t sim_dma2d_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_dma2d_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t sim_dma2d_thread;
+static int sim_dma2d_is_init;
+static sim_dma2d_op_t sim_dma2d_queue[FAL_DMA2D_QUEUE_LEN];
+static fal_dma2d_fence_t sim_dma2d_queued;
+static fal_dma2d_fence_t sim_dma2d_done;
+static fal_dma2d_fence_t sim_dma2d_wait_fence;
+static fal_dma2d_cb_t sim_dma2d_wait_cb;
+static void *sim_dma2d_wait_user;
+
+static int sim_dma2d_is_done(fal_dma2d_fence_t fence)
+{
+  return (int32_t) (sim_dma2d_done - fence) >= 0;
+}
+
+/* DMA2D blending, output alpha is computed so dst can be a transparent layer */
+static uint32_t sim_dma2d_blend_pixel(uint32_t fg, uint32_t bg)
+{
+  uint32_t a_fg = fg >> 24;
+  uint32_t a_bg = bg >> 24;
+  uint32_t a_mult = a_fg * a_bg / 255;
+  uint32_t a_out = a_fg + a_bg - a_mult;
+  uint32_t res = a_out << 24;
+  int shift;
+
+  if (!a_out)
+    return 0;
+
+  for (shift = 0; shift < 24; shift += 8) {
+    uint32_t f = (fg >> shift) & 0xff;
+    uint32_t b = (bg >> shift) & 0xff;
+
+    res |= (((f * a_fg + b * a_bg - b * a_mult) / a_out) & 0xff) << shift;
+  }
+
+  return res;
+}
+
+/* Returns pixels fetched, memory traffic is accumulated in bytes */
+static uint32_t sim_dma2d_do_fill(const fal_dma2d_fill_t *cfg, uint64_t *bytes)
+{
+  uint32_t *dst = (uint32_t *) cfg->dst;
+  uint32_t x, y;
+
+  for (y = 0; y < cfg->height; y++) {
+    for (x = 0; x < cfg->width; x++) {
+      uint32_t *p = &dst[(cfg->y_offset + y) * cfg->dst_width + cfg->x_offset + x];
+
+      *p = cfg->is_blend ? sim_dma2d_blend_pixel(cfg->color, *p) : cfg->color;
+    }
+  }
+
+  /* A blended fill reads the background back */
+  *bytes = (uint64_t) (cfg->is_blend ? 8 : 4) * cfg->width * cfg->height;
+
+  return (cfg->is_blend ? 2 : 1) * cfg->width * cfg->height;
+}
+
+static uint32_t sim_dma2d_src_pixel(const fal_dma2d_blend_t *cfg, uint32_t x, uint32_t y)
+{
+  uint32_t stride = cfg->src_stride ? cfg->src_stride : cfg->src_width;
+  uint32_t pos = y * stride + x;
+  uint32_t a;
+
+  switch (cfg->src_format) {
+  case FAL_DMA2D_FORMAT_A8:
+    a = cfg->src[pos];
+    break;
+  case FAL_DMA2D_FORMAT_A4:
+    a = ((cfg->src[pos / 2] >> ((pos & 1) * 4)) & 0xf) * 0x11;
+    break;
+  default:
+    return ((const uint32_t *) cfg->src)[pos];
+  }
+
+  return (a << 24) | (cfg->src_color & 0xffffff);
+}
+
+static uint32_t sim_dma2d_do_blend(const fal_dma2d_blend_t *cfg, uint64_t *bytes)
+{
+  static const uint32_t src_bits[] = {
+    [FAL_DMA2D_FORMAT_ARGB8888] = 32,
+    [FAL_DMA2D_FORMAT_A8] = 8,
+    [FAL_DMA2D_FORMAT_A4] = 4,
+  };
+  uint32_t *dst = (uint32_t *) cfg->dst;
+  uint32_t pixels = cfg->src_width * cfg->src_height;
+  uint32_t x, y;
+
+  for (y = 0; y < cfg->src_height; y++) {
+    for (x = 0; x < cfg->src_width; x++) {
+      uint32_t *p = &dst[(cfg->y_offset + y) * cfg->dst_width + cfg->x_offset + x];
+
+      *p = sim_dma2d_blend_pixel(sim_dma2d_src_pixel(cfg, x, y), *p);
+    }
+  }
+
+  /* source fetch, background fetch and write back */
+  *bytes = (uint64_t) pixels * src_bits[cfg->src_format] / 8 + 8ULL * pixels;
+
+  /* Two input layers are fetched per output pixel */
+  return 2 * pixels;
+}
+
+static void *sim_dma2d_worker(void *arg)
+{
+  fal_dma2d_cb_t on_complete;
+  fal_dma2d_cb_t wait_cb;
+  sim_dma2d_op_t op;
+  uint64_t start_us = 0;
+  uint64_t bytes;
+  uint32_t pixels;
+  uint64_t cost_us;
+  void *wait_user;
+  void *user;
+
+  (void) arg;
+  while (1) {
+    pthread_mutex_lock(&sim_dma2d_lock);
+    while (sim_dma2d_done == sim_dma2d_queued)
+      pthread_cond_wait(&sim_dma2d_cond, &sim_dma2d_lock);
+    op = sim_dma2d_queue[(sim_dma2d_done + 1) % FAL_DMA2D_QUEUE_LEN];
+    pthread_mutex_unlock(&sim_dma2d_lock);
+
+    /* Idle engine starts on queueing, a busy one when previous transfer ends */
+    if (!start_us)
+      start_us = sim_now_us();
+    if (op.is_fill) {
+      pixels = sim_dma2d_do_fill(&op.fill, &bytes);
+      on_complete = op.fill.on_complete;
+      user = op.fill.user;
+    } else {
+      pixels = sim_dma2d_do_blend(&op.blend, &bytes);
+      on_complete = op.blend.on_complete;
+      user = op.blend.user;
+    }
+    cost_us = sim_conf.dma2d_setup_us + (uint64_t) pixels * 1000000ULL / sim_conf.dma2d_mpix_s;
+    sim_sleep_until_us(start_us + cost_us);
+
+    sim_report_lock();
+    sim_report.dma2d_ops++;
+    sim_report.dma2d_busy_us += cost_us;
+    sim_report.dma2d_bytes += bytes;
+    sim_report_unlock();
+
+    pthread_mutex_lock(&sim_dma2d_lock);
+    sim_dma2d_done++;
+    start_us = sim_dma2d_done != sim_dma2d_queued ? start_us + cost_us : 0;
+    wait_cb = NULL;
+    wait_user = NULL;
+    if (sim_dma2d_wait_cb && sim_dma2d_is_done(sim_dma2d_wait_fence)) {
+      wait_cb = sim_dma2d_wait_cb;
+      wait_user = sim_dma2d_wait_user;
+      sim_dma2d_wait_cb = NULL;
+    }
+    pthread_mutex_unlock(&sim_dma2d_lock);
+
+    sim_isr_enter(ISR_DMA2D);
+    if (on_complete)
+      on_complete(user);
+    if (wait_cb)
+      wait_cb(wait_user);
+    sim_isr_exit();
+  }
+
+  return NULL;
+}
+
+static int sim_dma2d_push(const sim_dma2d_op_t *op)
+{
+  int ret;
+
+  pthread_mutex_lock(&sim_dma2d_lock);
+  if (!sim_dma2d_is_init) {
+    ret = pthread_create(&sim_dma2d_thread, NULL, sim_dma2d_worker, NULL);
+    assert(ret == 0);
+    sim_dma2d_is_init = 1;
+  }
+  if (sim_dma2d_queued - sim_dma2d_done == FAL_DMA2D_QUEUE_LEN) {
+    pthread_mutex_unlock(&sim_dma2d_lock);
+    return -1;
+  }
+  sim_dma2d_queue[(sim_dma2d_queued + 1) % FAL_DMA2D_QUEUE_LEN] = *op;
+  sim_dma2d_queued++;
+  pthread_cond_signal(&sim_dma2d_cond);
+  pthread_mutex_unlock(&sim_dma2d_lock);
+
+  return 0;
+}
+
+int FAL_DMA2D_Blend(const fal_dma2d_blend_t *cfg)
+{
+  sim_dma2d_op_t op = { .is_fill = 0 };
+
+  if (!cfg || !cfg->dst || !cfg->src || cfg->src_format > FAL_DMA2D_FORMAT_A4)
+    return -1;
+
+  op.blend = *cfg;
+
+  return sim_dma2d_push(&op);
+}
+
+int FAL_DMA2D_Fill(const fal_dma2d_fill_t *cfg)
+{
+  sim_dma2d_op_t op = { .is_fill = 1 };
+
+  if (!cfg || !cfg->dst)
+    return -1;
+
+  op.fill = *cfg;
+
+  return sim_dma2d_push(&op);
+}
+
+fal_dma2d_fence_t FAL_DMA2D_GetFence(void)
+{
+  fal_dma2d_fence_t fence;
+
+  pthread_mutex_lock(&sim_dma2d_lock);
+  fence = sim_dma2d_queued;
+  pthread_mutex_unlock(&sim_dma2d_lock);
+
+  return fence;
+}
+
+int FAL_DMA2D_IsDone(fal_dma2d_fence_t fence)
+{
+  int is_done;
+
+  pthread_mutex_lock(&sim_dma2d_lock);
+  is_done = sim_dma2d_is_done(fence);
+  pthread_mutex_unlock(&sim_dma2d_lock);
+
+  return is_done;
+}
+
+int FAL_DMA2D_NotifyFence(fal_dma2d_fence_t fence, fal_dma2d_cb_t cb, void *user)
+{
+  int is_done;
+
+  pthread_mutex_lock(&sim_dma2d_lock);
+  is_done = sim_dma2d_is_done(fence);
+  if (!is_done) {
+    sim_dma2d_wait_fence = fence;
+    sim_dma2d_wait_user = user;
+    sim_dma2d_wait_cb = cb;
+  }
+  pthread_mutex_unlock(&sim_dma2d_lock);
+
+  return is_done;
+}
+
+void FAL_DMA2D_IRQHandler(void)
+{
+}
@@ -0,0 +1,259 @@
+/**
+ ******************************************************************************
+ * @file    sim_encoder.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <assert.h>
+#include <string.h>
+
+#include "fal/fal_encoder.h"
+#include "sim.h"
+
+#define SIM_ENCODER_TRACKED_OUTPUTS 8
+
+typedef struct {
+  const uint8_t *p_out;
+  uint64_t capture_ts;
+} sim_encoder_output_t;
+
+static struct VENC_Context {
+  ENC_Conf_t conf;
+  int is_init;
+  uint64_t pic_cnt;
+  /* sliced encodes, for enc_fail_period */
+  uint32_t sliced_cnt;
+  int gop_len;
+  int default_bitrate;
+  ENC_RateCtrl_t rc;
+  sim_encoder_output_t outputs[SIM_ENCODER_TRACKED_OUTPUTS];
+} VENC_Instance;
+
+/* Output buffers are tracked so the USB model can time frames queued in a ring */
+static void sim_encoder_track(struct VENC_Context *p_ctx, const uint8_t *p_out, uint64_t capture_ts)
+{
+  int free_slot = -1;
+  int i;
+
+  for (i = 0; i < SIM_ENCODER_TRACKED_OUTPUTS; i++) {
+    if (p_ctx->outputs[i].p_out == p_out) {
+      p_ctx->outputs[i].capture_ts = capture_ts;
+      return;
+    }
+    if (!p_ctx->outputs[i].p_out && free_slot < 0)
+      free_slot = i;
+  }
+  assert(free_slot >= 0);
+  p_ctx->outputs[free_slot].p_out = p_out;
+  p_ctx->outputs[free_slot].capture_ts = capture_ts;
+}
+
+static void sim_encoder_complete_rc(struct VENC_Context *p_ctx, ENC_RateCtrl_t *p_rc)
+{
+  if (!p_rc->bitrate)
+    p_rc->bitrate = p_ctx->default_bitrate;
+  if (!p_rc->gop_size)
+    p_rc->gop_size = p_ctx->conf.fps;
+  if (!p_rc->qp)
+    p_rc->qp = 25;
+  if (!p_rc->qp_min)
+    p_rc->qp_min = 10;
+  if (!p_rc->qp_max)
+    p_rc->qp_max = 51;
+}
+
+void ENC_Init(ENC_Conf_t *p_conf)
+{
+  struct VENC_Context *p_ctx = &VENC_Instance;
+  int ret;
+
+  memset(p_ctx, 0, sizeof(*p_ctx));
+  p_ctx->conf = *p_conf;
+  p_ctx->default_bitrate = ((p_conf->width * p_conf->height * 12) * p_conf->fps) / 30;
+  p_ctx->is_init = 1;
+
+  /* JPEG frames are all intra and sized like H264 intra frames at fixed qp */
+  if (p_conf->codec == ENC_CODEC_JPEG) {
+    p_ctx->rc.mode = ENC_RATE_CTRL_CQP;
+    p_ctx->rc.gop_size = 1;
+    p_ctx->rc.qp = p_conf->jpeg_qlevel ? p_conf->jpeg_qlevel : 6;
+    p_ctx->rc.qp_min = p_ctx->rc.qp;
+    p_ctx->rc.qp_max = p_ctx->rc.qp;
+    sim_encoder_complete_rc(p_ctx, &p_ctx->rc);
+    return;
+  }
+
+  p_ctx->is_init = 0;
+  ret = ENC_SetRateControl(&p_conf->rate_ctrl);
+  assert(ret == 0);
+  p_ctx->is_init = 1;
+}
+
+int ENC_SetRateControl(const ENC_RateCtrl_t *p_rc)
+{
+  struct VENC_Context *p_ctx = &VENC_Instance;
+  ENC_RateCtrl_t rc = *p_rc;
+
+  if (p_ctx->conf.codec == ENC_CODEC_JPEG)
+    return -1;
+
+  sim_encoder_complete_rc(p_ctx, &rc);
+  if (rc.mode > ENC_RATE_CTRL_CQP || rc.gop_size < 1 || rc.gop_size > 300 || rc.qp > 51 ||
+      rc.qp_max > 51 || rc.qp_min > rc.qp_max ||
+      (rc.mode != ENC_RATE_CTRL_CQP && rc.bitrate < 10000))
+    return -1;
+
+  if (p_ctx->is_init) {
+    sim_report_lock();
+    sim_report.enc_rc_changes++;
+    sim_report_unlock();
+  }
+  p_ctx->rc = rc;
+  p_ctx->gop_len = rc.gop_size - 1;
+
+  return 0;
+}
+
+void ENC_GetRateControl(ENC_RateCtrl_t *p_rc)
+{
+  *p_rc = VENC_Instance.rc;
+}
+
+/* Frame sizes and encode time given on command line match the capture size at the default
+ * bitrate. Smaller streams and rate control scale them.
+ */
+static size_t sim_encoder_frame_len(struct VENC_Context *p_ctx, int is_intra)
+{
+  uint64_t len = is_intra ? sim_conf.enc_i_bytes : sim_conf.enc_p_bytes;
+  uint64_t frame_bits_ref = (uint64_t) sim_conf.width * sim_conf.height * 12 / 30;
+  uint64_t pixels_ref = (uint64_t) sim_conf.width * sim_conf.height;
+
+  if (p_ctx->rc.mode == ENC_RATE_CTRL_CQP)
+    return len * p_ctx->conf.width * p_ctx->conf.height / pixels_ref;
+
+  return len * (uint64_t) p_ctx->rc.bitrate / (frame_bits_ref * p_ctx->conf.fps);
+}
+
+static uint32_t sim_encoder_enc_us(struct VENC_Context *p_ctx)
+{
+  uint64_t pixels_ref = (uint64_t) sim_conf.width * sim_conf.height;
+
+  return (uint32_t) (sim_conf.enc_us * (uint64_t) p_ctx->conf.width * p_ctx->conf.height / pixels_ref);
+}
+
+/* Bytes VENC fetches from the frame buffer */
+static size_t sim_encoder_in_len(struct VENC_Context *p_ctx)
+{
+  size_t pixels = (size_t) p_ctx->conf.width * p_ctx->conf.height;
+
+  return p_ctx->conf.input == ENC_INPUT_NV12 ? pixels * 3 / 2 : pixels * 4;
+}
+
+void ENC_DeInit(void)
+{
+  VENC_Instance.is_init = 0;
+}
+
+/* Slice count as the hardware would produce it for slice_rows macroblock rows */
+static int sim_encoder_slice_nb(struct VENC_Context *p_ctx)
+{
+  int slice_rows = sim_conf.enc_slice_rows ? sim_conf.enc_slice_rows : p_ctx->conf.slice_rows;
+  int mb_rows = (p_ctx->conf.height + 15) / 16;
+
+  if (!slice_rows || p_ctx->conf.codec == ENC_CODEC_JPEG)
+    return 1;
+
+  return (mb_rows + slice_rows - 1) / slice_rows;
+}
+
+int ENC_EncodeFrameSliced(uint8_t *p_in, uint8_t *p_out, size_t out_len, int is_intra_force,
+                          ENC_SliceReadyCb_t cb, void *cb_arg)
+{
+  struct VENC_Context *p_ctx = &VENC_Instance;
+  size_t frame_len;
+  int slice_nb;
+  int is_intra;
+  int is_fail;
+  int i;
+
+  assert(p_ctx->is_init);
+
+  is_intra = is_intra_force || (p_ctx->pic_cnt % (p_ctx->gop_len + 1) == 0);
+  frame_len = sim_encoder_frame_len(p_ctx, is_intra);
+  slice_nb = sim_encoder_slice_nb(p_ctx);
+
+  if (frame_len > out_len) {
+    sim_sleep_us(sim_encoder_enc_us(p_ctx));
+    sim_report_lock();
+    sim_report.enc_errors++;
+    sim_report_unlock();
+    return -1;
+  }
+
+  memset(p_out, is_intra ? 0x65 : 0x41, frame_len);
+  sim_report_lock();
+  sim_encoder_track(p_ctx, p_out, sim_camera_buffer_ts(p_in));
+  sim_report_unlock();
+
+  /* VENC runs while the calling thread blocks on its completion. Every slice but the last
+   * one is reported through cb, the last one by the return value. With enc_fail_period, some
+   * sliced frames fail once their first slice is reported.
+   */
+  is_fail = cb && slice_nb > 1 && sim_conf.enc_fail_period && ++p_ctx->sliced_cnt % sim_conf.enc_fail_period == 0;
+  for (i = 0; i < slice_nb; i++) {
+    sim_sleep_us(sim_encoder_enc_us(p_ctx) / slice_nb);
+    if (cb && i != slice_nb - 1)
+      cb(cb_arg, frame_len * (i + 1) / slice_nb);
+    if (is_fail) {
+      sim_report_lock();
+      sim_report.enc_errors++;
+      sim_report_unlock();
+      return -1;
+    }
+  }
+
+  sim_report_lock();
+  sim_report.enc_frames++;
+  sim_report.enc_in_bytes += sim_encoder_in_len(p_ctx);
+  if (is_intra)
+    sim_report.enc_intra++;
+  sim_report_unlock();
+  p_ctx->pic_cnt++;
+
+  return (int) frame_len;
+}
+
+int ENC_EncodeFrame(uint8_t *p_in, uint8_t *p_out, size_t out_len, int is_intra_force)
+{
+  return ENC_EncodeFrameSliced(p_in, p_out, out_len, is_intra_force, NULL, NULL);
+}
+
+uint64_t sim_encoder_capture_ts(const void *p_out)
+{
+  struct VENC_Context *p_ctx = &VENC_Instance;
+  uint64_t ts = 0;
+  int i;
+
+  sim_report_lock();
+  for (i = 0; i < SIM_ENCODER_TRACKED_OUTPUTS; i++) {
+    if (p_ctx->outputs[i].p_out == p_out) {
+      ts = p_ctx->outputs[i].capture_ts;
+      break;
+    }
+  }
+  sim_report_unlock();
+
+  return ts;
+}
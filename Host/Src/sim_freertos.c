@@ -0,0 +1,278 @@
+/**
+ ******************************************************************************
+ * @file    sim_freertos.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "sim.h"
+#include "task.h"
+
+#define SIM_RTOS_TASK_MAX_NB 16
+
+static _Thread_local StaticTask_t *sim_rtos_current;
+static pthread_mutex_t sim_rtos_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static StaticTask_t *sim_rtos_tasks[SIM_RTOS_TASK_MAX_NB];
+static int sim_rtos_task_nb;
+/* Stands for the kernel idle task in uxTaskGetSystemState() */
+static StaticTask_t sim_rtos_idle = {.name = "IDLE", .priority = tskIDLE_PRIORITY,
+                                     .stack_depth = configMINIMAL_STACK_SIZE};
+
+static void sim_rtos_deadline(struct timespec *ts, TickType_t ticks)
+{
+  clock_gettime(CLOCK_MONOTONIC, ts);
+  ts->tv_sec += ticks / 1000;
+  ts->tv_nsec += (long) (ticks % 1000) * 1000000L;
+  if (ts->tv_nsec >= 1000000000L) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000L;
+  }
+}
+
+static void sim_rtos_sem_init(StaticSemaphore_t *sem, UBaseType_t max, UBaseType_t initial)
+{
+  pthread_condattr_t attr;
+  int ret;
+
+  ret = pthread_mutex_init(&sem->lock, NULL);
+  assert(ret == 0);
+  ret = pthread_condattr_init(&attr);
+  assert(ret == 0);
+  ret = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  assert(ret == 0);
+  ret = pthread_cond_init(&sem->cond, &attr);
+  assert(ret == 0);
+  pthread_condattr_destroy(&attr);
+
+  sem->count = initial;
+  sem->max = max;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(UBaseType_t max, UBaseType_t initial, StaticSemaphore_t *buffer)
+{
+  if (!buffer || initial > max)
+    return NULL;
+
+  sim_rtos_sem_init(buffer, max, initial);
+
+  return buffer;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+  /* No priority inheritance on host */
+  return xSemaphoreCreateCountingStatic(1, 1, buffer);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+  pthread_cond_destroy(&sem->cond);
+  pthread_mutex_destroy(&sem->lock);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+  struct timespec deadline;
+  BaseType_t res = pdTRUE;
+  int ret = 0;
+
+  if (ticks != portMAX_DELAY)
+    sim_rtos_deadline(&deadline, ticks);
+
+  pthread_mutex_lock(&sem->lock);
+  while (sem->count == 0 && ret != ETIMEDOUT) {
+    if (ticks == 0)
+      ret = ETIMEDOUT;
+    else if (ticks == portMAX_DELAY)
+      ret = pthread_cond_wait(&sem->cond, &sem->lock);
+    else
+      ret = pthread_cond_timedwait(&sem->cond, &sem->lock, &deadline);
+  }
+  if (sem->count)
+    sem->count--;
+  else
+    res = pdFALSE;
+  pthread_mutex_unlock(&sem->lock);
+
+  return res;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  BaseType_t res = pdFALSE;
+
+  pthread_mutex_lock(&sem->lock);
+  if (sem->count < sem->max) {
+    sem->count++;
+    pthread_cond_signal(&sem->cond);
+    res = pdTRUE;
+  }
+  pthread_mutex_unlock(&sem->lock);
+
+  return res;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *higher_priority_task_woken)
+{
+  if (higher_priority_task_woken)
+    *higher_priority_task_woken = pdFALSE;
+
+  return xSemaphoreGive(sem);
+}
+
+static void *sim_rtos_task_entry(void *arg)
+{
+  StaticTask_t *tcb = arg;
+
+  sim_rtos_current = tcb;
+  tcb->fct(tcb->arg);
+
+  return NULL;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fct, const char *name, uint32_t stack_depth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb)
+{
+  int ret;
+
+  /* Static stacks are sized for the target; host threads keep their default stack */
+  (void) stack;
+
+  tcb->fct = fct;
+  tcb->arg = arg;
+  tcb->name = name;
+  tcb->priority = priority;
+  tcb->stack_depth = stack_depth;
+  tcb->busy_us = 0;
+  /* Notification value is a counter saturating far beyond what the pipeline uses */
+  sim_rtos_sem_init(&tcb->notify, 0xffffffffUL, 0);
+  ret = pthread_create(&tcb->thread, NULL, sim_rtos_task_entry, tcb);
+  if (ret)
+    return NULL;
+  pthread_detach(tcb->thread);
+
+  pthread_mutex_lock(&sim_rtos_tasks_lock);
+  assert(sim_rtos_task_nb < SIM_RTOS_TASK_MAX_NB);
+  sim_rtos_tasks[sim_rtos_task_nb++] = tcb;
+  pthread_mutex_unlock(&sim_rtos_tasks_lock);
+
+  return tcb;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+  return sim_rtos_current;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  xSemaphoreGive(&task->notify);
+
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken)
+{
+  xSemaphoreGiveFromISR(&task->notify, higher_priority_task_woken);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks)
+{
+  StaticSemaphore_t *notify = &sim_rtos_current->notify;
+  uint32_t value;
+
+  if (xSemaphoreTake(notify, ticks) == pdFALSE)
+    return 0;
+
+  pthread_mutex_lock(&notify->lock);
+  value = (uint32_t) notify->count + 1;
+  if (clear_count_on_exit)
+    notify->count = 0;
+  pthread_mutex_unlock(&notify->lock);
+
+  return value;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+  return (TickType_t) (sim_now_us() / 1000);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  sim_sleep_us((uint64_t) ticks * 1000);
+}
+
+BaseType_t xPortIsInsideInterrupt(void)
+{
+  return sim_is_isr() ? pdTRUE : pdFALSE;
+}
+
+/* Run time counter ticks at 100 kHz like TIM4 on target */
+configRUN_TIME_COUNTER_TYPE sim_rtos_run_time_counter(void)
+{
+  return (configRUN_TIME_COUNTER_TYPE) (sim_now_us() / 10);
+}
+
+configRUN_TIME_COUNTER_TYPE ulTaskGetIdleRunTimeCounter(void)
+{
+  uint64_t now = sim_now_us();
+  uint64_t busy = sim_cpu_busy_total_us();
+
+  return (configRUN_TIME_COUNTER_TYPE) ((busy < now ? now - busy : 0) / 10);
+}
+
+/* Busy time outside of a task, main thread or simulated peripherals, is not charged */
+void sim_rtos_task_busy_us(uint32_t us)
+{
+  if (sim_rtos_current)
+    __atomic_fetch_add(&sim_rtos_current->busy_us, us, __ATOMIC_RELAXED);
+}
+
+/* Host stacks are not the target ones, watermarks report them untouched */
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t status_nb,
+                                 configRUN_TIME_COUNTER_TYPE *total_run_time)
+{
+  UBaseType_t nb = 0;
+  StaticTask_t *tcb;
+  int i;
+
+  pthread_mutex_lock(&sim_rtos_tasks_lock);
+  if (status_nb < (UBaseType_t) sim_rtos_task_nb + 1) {
+    pthread_mutex_unlock(&sim_rtos_tasks_lock);
+    return 0;
+  }
+  for (i = 0; i <= sim_rtos_task_nb; i++) {
+    tcb = i < sim_rtos_task_nb ? sim_rtos_tasks[i] : &sim_rtos_idle;
+    status[nb].xHandle = tcb;
+    status[nb].pcTaskName = tcb->name;
+    status[nb].uxCurrentPriority = tcb->priority;
+    status[nb].ulRunTimeCounter = (configRUN_TIME_COUNTER_TYPE) (__atomic_load_n(&tcb->busy_us, __ATOMIC_RELAXED) / 10);
+    status[nb].usStackHighWaterMark = (configSTACK_DEPTH_TYPE) tcb->stack_depth;
+    nb++;
+  }
+  pthread_mutex_unlock(&sim_rtos_tasks_lock);
+  status[nb - 1].ulRunTimeCounter = ulTaskGetIdleRunTimeCounter();
+  if (total_run_time)
+    *total_run_time = sim_rtos_run_time_counter();
+
+  return nb;
+}
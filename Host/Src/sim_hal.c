@@ -0,0 +1,174 @@
+/**
+ ******************************************************************************
+ * @file    sim_hal.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "sim.h"
+#include "stm32n6570_discovery.h"
+#include "stm32n6xx_hal.h"
+
+/* Waits shorter than this are spun to keep sub-100us peripheral timings meaningful */
+#define SIM_SPIN_THRESHOLD_US 200
+
+CoreDebug_Type sim_core_debug;
+PCD_TypeDef sim_usb1_otg_hs;
+uint32_t SystemCoreClock = 800000000UL;
+
+static pthread_mutex_t sim_report_mutex = PTHREAD_MUTEX_INITIALIZER;
+static _Atomic uint64_t sim_cpu_busy_acc;
+static _Thread_local int sim_isr_nesting;
+static _Thread_local isr_src_t sim_isr_src;
+static _Thread_local uint32_t sim_isr_ts;
+static _Thread_local DWT_Type sim_dwt_view;
+static uint64_t sim_epoch_us;
+
+static uint64_t sim_clock_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+uint64_t sim_now_us(void)
+{
+  if (!sim_epoch_us)
+    sim_epoch_us = sim_clock_us();
+
+  return sim_clock_us() - sim_epoch_us;
+}
+
+/* Per thread register view so CYCCNT refreshes do not race. The counter always
+ * runs on host, CTRL is ignored.
+ */
+DWT_Type *sim_dwt(void)
+{
+  sim_dwt_view.CYCCNT = (uint32_t) (sim_now_us() * (SystemCoreClock / 1000000UL));
+
+  return &sim_dwt_view;
+}
+
+void sim_sleep_until_us(uint64_t deadline_us)
+{
+  uint64_t now = sim_now_us();
+  struct timespec ts;
+
+  while (now < deadline_us) {
+    if (deadline_us - now > SIM_SPIN_THRESHOLD_US) {
+      uint64_t sleep_us = deadline_us - now - SIM_SPIN_THRESHOLD_US / 2;
+
+      ts.tv_sec = sleep_us / 1000000ULL;
+      ts.tv_nsec = (long) (sleep_us % 1000000ULL) * 1000L;
+      nanosleep(&ts, NULL);
+    }
+    now = sim_now_us();
+  }
+}
+
+void sim_sleep_us(uint64_t us)
+{
+  sim_sleep_until_us(sim_now_us() + us);
+}
+
+void sim_cpu_busy_us(uint32_t us)
+{
+  sim_sleep_us(us);
+  atomic_fetch_add(&sim_cpu_busy_acc, us);
+  sim_rtos_task_busy_us(us);
+}
+
+uint64_t sim_cpu_busy_total_us(void)
+{
+  return atomic_load(&sim_cpu_busy_acc);
+}
+
+void sim_isr_enter(isr_src_t src)
+{
+  if (!sim_isr_nesting++) {
+    sim_isr_src = src;
+    sim_isr_ts = app_stats_isr_enter();
+  }
+}
+
+void sim_isr_exit(void)
+{
+  if (!--sim_isr_nesting)
+    app_stats_isr_exit(sim_isr_src, sim_isr_ts);
+}
+
+int sim_is_isr(void)
+{
+  return sim_isr_nesting > 0;
+}
+
+void sim_report_lock(void)
+{
+  pthread_mutex_lock(&sim_report_mutex);
+}
+
+void sim_report_unlock(void)
+{
+  pthread_mutex_unlock(&sim_report_mutex);
+}
+
+uint32_t HAL_GetTick(void)
+{
+  return (uint32_t) (sim_now_us() / 1000);
+}
+
+void HAL_Delay(uint32_t delay)
+{
+  sim_sleep_us((uint64_t) delay * 1000);
+}
+
+int32_t BSP_LED_On(Led_TypeDef led)
+{
+  (void) led;
+
+  return BSP_ERROR_NONE;
+}
+
+int32_t BSP_LED_Off(Led_TypeDef led)
+{
+  (void) led;
+
+  return BSP_ERROR_NONE;
+}
+
+int32_t BSP_PB_Init(Button_TypeDef button, ButtonMode_TypeDef mode)
+{
+  (void) button;
+  (void) mode;
+
+  return BSP_ERROR_NONE;
+}
+
+/* USER1 held down from boot means the debug overlay toggles on once. USER2 is pressed every other
+ * model_switch_ms period, so models alternate every two periods.
+ */
+int32_t BSP_PB_GetState(Button_TypeDef button)
+{
+  if (button == BUTTON_USER2)
+    return sim_conf.model_switch_ms && (sim_now_us() / 1000 / sim_conf.model_switch_ms) % 2 ? GPIO_PIN_SET :
+                                                                                              GPIO_PIN_RESET;
+
+  return sim_conf.debug_overlay ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
@@ -0,0 +1,210 @@
+/**
+ ******************************************************************************
+ * @file    sim_ipplug.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <stdio.h>
+
+#include "sim.h"
+
+/* DCMIPP IPPlug has 640 DPREG words of 8 bytes shared by the write clients. Client2 drains
+ * pipe1 and client5 pipe2, see DCMIPP_IpPlugInit(). Pipes produce lines at a constant rate
+ * over the active part of the frame while the other PSRAM masters start with the frame, which
+ * is the worst overlap. Each active master gets at most a fair share of PSRAM bandwidth, the
+ * IPPlug gets the rest and splits it between non empty FIFOs according to WLRU ratios
+ * (ratio + 1 parts each). A FIFO overflow is a lost line on target.
+ */
+#define SIM_IPPLUG_DPREG_NB 640
+#define SIM_IPPLUG_DPREG_BYTES 8
+#define SIM_IPPLUG_ACTIVE_PCT 90
+#define SIM_IPPLUG_STEP_US 1
+#define SIM_IPPLUG_MASTER_NB 3
+
+typedef struct {
+  int split;
+  int wlru[2];
+} sim_ipplug_conf_t;
+
+typedef struct {
+  double peak[2];
+  double overflow;
+  /* bytes other masters still have to move when next frame starts */
+  double late;
+} sim_ipplug_res_t;
+
+static const int sim_ipplug_sweep_wlru[][2] = {{15, 0}, {7, 7}, {0, 15}};
+
+/* Weighted max-min share of budget, what a requester does not need goes to the others */
+static void sim_ipplug_share(const double *demand, const double *weight, int nb, double budget, double *grant)
+{
+  double weight_sum;
+  double part;
+  int is_capped;
+  int i;
+
+  for (i = 0; i < nb; i++)
+    grant[i] = 0;
+  do {
+    weight_sum = 0;
+    for (i = 0; i < nb; i++)
+      if (grant[i] < demand[i])
+        weight_sum += weight[i];
+    if (weight_sum == 0 || budget <= 0)
+      return;
+    is_capped = 0;
+    part = budget;
+    for (i = 0; i < nb; i++) {
+      if (grant[i] >= demand[i])
+        continue;
+      if (grant[i] + part * weight[i] / weight_sum >= demand[i]) {
+        budget -= demand[i] - grant[i];
+        grant[i] = demand[i];
+        is_capped = 1;
+      }
+    }
+    if (!is_capped) {
+      for (i = 0; i < nb; i++)
+        if (grant[i] < demand[i])
+          grant[i] += part * weight[i] / weight_sum;
+      return;
+    }
+  } while (1);
+}
+
+static void sim_ipplug_eval(const sim_ipplug_load_t *load, const sim_ipplug_conf_t *conf, double psram_mbps,
+                            sim_ipplug_res_t *res)
+{
+  const double period_us = 1e6 / sim_conf.fps;
+  const double active_us = period_us * SIM_IPPLUG_ACTIVE_PCT / 100;
+  const double step_bytes = psram_mbps * SIM_IPPLUG_STEP_US;
+  const double master_bytes[SIM_IPPLUG_MASTER_NB] = {load->enc_bytes, load->nn_bytes, load->overlay_bytes};
+  const uint32_t master_us[SIM_IPPLUG_MASTER_NB] = {load->enc_us, load->nn_us, load->overlay_us};
+  const double port_weight[SIM_IPPLUG_MASTER_NB + 1] = {1, 1, 1, 1};
+  const double fifo_weight[2] = {conf->wlru[0] + 1, conf->wlru[1] + 1};
+  double port_demand[SIM_IPPLUG_MASTER_NB + 1];
+  double port_grant[SIM_IPPLUG_MASTER_NB + 1];
+  double master_rate[SIM_IPPLUG_MASTER_NB];
+  double master_left[SIM_IPPLUG_MASTER_NB] = {0};
+  double fifo_grant[2];
+  double capacity[2];
+  double fifo[2] = {0, 0};
+  double t;
+  int frame;
+  int i;
+
+  capacity[0] = (double) conf->split * SIM_IPPLUG_DPREG_BYTES;
+  capacity[1] = (double) (SIM_IPPLUG_DPREG_NB - conf->split) * SIM_IPPLUG_DPREG_BYTES;
+  for (i = 0; i < SIM_IPPLUG_MASTER_NB; i++) {
+    t = master_us[i] ? master_us[i] : active_us;
+    master_rate[i] = master_bytes[i] / (t < period_us ? t : period_us);
+  }
+  res->peak[0] = res->peak[1] = 0;
+  res->overflow = 0;
+  res->late = 0;
+
+  /* first frame fills the pipeline, only second one is reported */
+  for (frame = 0; frame < 2; frame++) {
+    for (i = 0; i < SIM_IPPLUG_MASTER_NB; i++)
+      master_left[i] += master_bytes[i];
+    for (t = 0; t < period_us; t += SIM_IPPLUG_STEP_US) {
+      if (t < active_us) {
+        fifo[0] += load->pipe_bytes[0] / active_us * SIM_IPPLUG_STEP_US;
+        fifo[1] += load->pipe_bytes[1] / active_us * SIM_IPPLUG_STEP_US;
+      }
+      /* peak is taken before drain as a step worth of line data lands at once */
+      for (i = 0; i < 2; i++)
+        if (frame && capacity[i] > 0 && fifo[i] / capacity[i] > res->peak[i])
+          res->peak[i] = fifo[i] > capacity[i] ? 1 : fifo[i] / capacity[i];
+
+      /* masters run at their own pace, IPPlug drains as fast as it is allowed */
+      for (i = 0; i < SIM_IPPLUG_MASTER_NB; i++) {
+        port_demand[i] = master_rate[i] * SIM_IPPLUG_STEP_US;
+        port_demand[i] = port_demand[i] < master_left[i] ? port_demand[i] : master_left[i];
+      }
+      port_demand[SIM_IPPLUG_MASTER_NB] = fifo[0] + fifo[1];
+      sim_ipplug_share(port_demand, port_weight, SIM_IPPLUG_MASTER_NB + 1, step_bytes, port_grant);
+      for (i = 0; i < SIM_IPPLUG_MASTER_NB; i++)
+        master_left[i] -= port_grant[i];
+      sim_ipplug_share(fifo, fifo_weight, 2, port_grant[SIM_IPPLUG_MASTER_NB], fifo_grant);
+
+      for (i = 0; i < 2; i++) {
+        fifo[i] -= fifo_grant[i];
+        if (fifo[i] > capacity[i]) {
+          if (frame)
+            res->overflow += fifo[i] - capacity[i];
+          fifo[i] = capacity[i];
+        }
+      }
+    }
+  }
+  for (i = 0; i < SIM_IPPLUG_MASTER_NB; i++)
+    res->late += master_left[i] > 1 ? master_left[i] : 0;
+}
+
+/* Lowest PSRAM bandwidth, 0 when even 64 GB/s is not enough. With is_late_ok only FIFO
+ * overflows count, else every master must also be done within the frame period.
+ */
+static double sim_ipplug_min_mbps(const sim_ipplug_load_t *load, const sim_ipplug_conf_t *conf, int is_late_ok)
+{
+  sim_ipplug_res_t res;
+  double lo = 1;
+  double hi = 65536;
+  double mid;
+  int i;
+
+  sim_ipplug_eval(load, conf, hi, &res);
+  if (res.overflow > 0 || (!is_late_ok && res.late > 0))
+    return 0;
+  for (i = 0; i < 20; i++) {
+    mid = (lo + hi) / 2;
+    sim_ipplug_eval(load, conf, mid, &res);
+    if (res.overflow > 0 || (!is_late_ok && res.late > 0))
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  return hi;
+}
+
+void sim_ipplug_report(const sim_ipplug_load_t *load)
+{
+  sim_ipplug_conf_t conf = {sim_conf.ipplug_split, {sim_conf.ipplug_wlru[0], sim_conf.ipplug_wlru[1]}};
+  sim_ipplug_res_t res;
+  unsigned int w;
+
+  sim_ipplug_eval(load, &conf, sim_conf.psram_mbps, &res);
+  printf("ipplug      : split %d/%d wlru %d/%d at %u MB/s, pipe1 peak %.1f %%, pipe2 peak %.1f %%, "
+         "%.0f B lost, %.0f B late, needs %.0f MB/s (%.0f MB/s without line loss)\n", conf.split, SIM_IPPLUG_DPREG_NB - conf.split, conf.wlru[0], conf.wlru[1],
+         sim_conf.psram_mbps, res.peak[0] * 100, res.peak[1] * 100, res.overflow, res.late,
+         sim_ipplug_min_mbps(load, &conf, 0), sim_ipplug_min_mbps(load, &conf, 1));
+  if (!sim_conf.ipplug_sweep)
+    return;
+
+  printf("  %-8s", "split");
+  for (w = 0; w < sizeof(sim_ipplug_sweep_wlru) / sizeof(sim_ipplug_sweep_wlru[0]); w++)
+    printf("  wlru %2d/%-2d", sim_ipplug_sweep_wlru[w][0], sim_ipplug_sweep_wlru[w][1]);
+  printf("   (MB/s without line loss)\n");
+  for (conf.split = 80; conf.split < SIM_IPPLUG_DPREG_NB; conf.split += 80) {
+    printf("  %3d/%-3d ", conf.split, SIM_IPPLUG_DPREG_NB - conf.split);
+    for (w = 0; w < sizeof(sim_ipplug_sweep_wlru) / sizeof(sim_ipplug_sweep_wlru[0]); w++) {
+      conf.wlru[0] = sim_ipplug_sweep_wlru[w][0];
+      conf.wlru[1] = sim_ipplug_sweep_wlru[w][1];
+      printf("  %11.0f", sim_ipplug_min_mbps(load, &conf, 1));
+    }
+    printf("\n");
+  }
+}
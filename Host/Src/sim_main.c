@@ -0,0 +1,516 @@
+/**
+ ******************************************************************************
+ * @file    sim_main.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app/app.h"
+#include "svc/app_stats.h"
+#include "svc/app_trace.h"
+#include "svc/nn_service.h"
+#include "sim.h"
+
+#define SIM_DRAIN_MS 300
+
+sim_conf_t sim_conf = {
+  .fps = 30,
+  .frames = 150,
+  .jitter_us = 0,
+  .timeline = NULL,
+  .width = 1280,
+  .height = 720,
+  .isp_us = 500,
+  .nn_us = 20000,
+  .nn_epoch_blocks = 8,
+  .nn_init_us = 2000,
+  .alt_nn_us = 12000,
+  .reloc_install_us = 3000,
+  .reloc_is_invalid = 0,
+  .model_switch_ms = 0,
+  .pp_us = 1000,
+  .detections = 3,
+  .roi_us = 3000,
+  .enc_us = 8000,
+  .enc_p_bytes = 20 * 1024,
+  .enc_i_bytes = 120 * 1024,
+  .enc_slice_rows = 0,
+  .enc_fail_period = 0,
+  .dma2d_setup_us = 2,
+  .dma2d_mpix_s = 200000000,
+  .usb_kbps = 192000,
+  .usb_start_ms = 100,
+  .usb_stream = 0,
+  .usb_switch_stream = 0,
+  .usb_switch_ms = 0,
+  .debug_overlay = 0,
+  .psram_mbps = 500,
+  .ipplug_split = 560,
+  .ipplug_wlru = {15, 0},
+  .ipplug_sweep = 0,
+  .trace = NULL,
+  .cpu_stats = NULL,
+};
+
+sim_report_t sim_report;
+
+static const struct option sim_options[] = {
+  {"fps", required_argument, NULL, 'f'},
+  {"frames", required_argument, NULL, 'n'},
+  {"jitter-us", required_argument, NULL, 'j'},
+  {"timeline", required_argument, NULL, 't'},
+  {"size", required_argument, NULL, 's'},
+  {"isp-us", required_argument, NULL, 'I'},
+  {"nn-us", required_argument, NULL, 'N'},
+  {"nn-blocks", required_argument, NULL, 'B'},
+  {"nn-init-us", required_argument, NULL, 'K'},
+  {"alt-nn-us", required_argument, NULL, 'A'},
+  {"reloc-install-us", required_argument, NULL, 'L'},
+  {"reloc-invalid", no_argument, NULL, 'V'},
+  {"model-switch-ms", required_argument, NULL, 'Y'},
+  {"pp-us", required_argument, NULL, 'P'},
+  {"detections", required_argument, NULL, 'd'},
+  {"roi-us", required_argument, NULL, 'r'},
+  {"enc-us", required_argument, NULL, 'E'},
+  {"enc-p-bytes", required_argument, NULL, 'p'},
+  {"enc-i-bytes", required_argument, NULL, 'i'},
+  {"enc-slice-rows", required_argument, NULL, 'R'},
+  {"enc-fail-period", required_argument, NULL, 'F'},
+  {"dma2d-setup-us", required_argument, NULL, 'S'},
+  {"dma2d-mpix-s", required_argument, NULL, 'M'},
+  {"usb-kbps", required_argument, NULL, 'u'},
+  {"usb-stream", required_argument, NULL, 'U'},
+  {"usb-switch", required_argument, NULL, 'W'},
+  {"debug-overlay", no_argument, NULL, 'D'},
+  {"psram-mbps", required_argument, NULL, 'm'},
+  {"ipplug-split", required_argument, NULL, 'x'},
+  {"ipplug-wlru", required_argument, NULL, 'w'},
+  {"ipplug-sweep", no_argument, NULL, 'X'},
+  {"trace", required_argument, NULL, 'T'},
+  {"cpu-stats", required_argument, NULL, 'C'},
+  {"help", no_argument, NULL, 'h'},
+  {NULL, 0, NULL, 0},
+};
+
+static void sim_usage(const char *prog)
+{
+  printf("Usage: %s [options]\n", prog);
+  printf("  --fps N              frame rate of the generated timeline (%d)\n", sim_conf.fps);
+  printf("  --frames N           number of frames to replay (%d)\n", sim_conf.frames);
+  printf("  --jitter-us N        max frame event jitter (%u)\n", sim_conf.jitter_us);
+  printf("  --timeline FILE      replay frame end timestamps (us, one per line)\n");
+  printf("  --size WxH           capture/encode resolution (%dx%d)\n", sim_conf.width, sim_conf.height);
+  printf("  --isp-us N           ISP update cpu time (%u)\n", sim_conf.isp_us);
+  printf("  --nn-us N            inference time (%u)\n", sim_conf.nn_us);
+  printf("  --nn-blocks N        epoch blocks per inference (%d)\n", sim_conf.nn_epoch_blocks);
+  printf("  --nn-init-us N       network init cpu time (%u)\n", sim_conf.nn_init_us);
+  printf("  --alt-nn-us N        alt detector inference time (%u)\n", sim_conf.alt_nn_us);
+  printf("  --reloc-install-us N relocatable detector install cpu time (%u)\n", sim_conf.reloc_install_us);
+  printf("  --reloc-invalid      model partition holds no valid binary\n");
+  printf("  --model-switch-ms N  USER2 toggles the detector model every 2 N ms, 0 never (%u)\n",
+         sim_conf.model_switch_ms);
+  printf("  --pp-us N            postprocess cpu time (%u)\n", sim_conf.pp_us);
+  printf("  --detections N       synthetic detections per frame (%d)\n", sim_conf.detections);
+  printf("  --roi-us N           cascade second stage inference time per ROI (%u)\n", sim_conf.roi_us);
+  printf("  --enc-us N           encode time per frame (%u)\n", sim_conf.enc_us);
+  printf("  --enc-p-bytes N      P frame size (%u)\n", sim_conf.enc_p_bytes);
+  printf("  --enc-i-bytes N      I frame size (%u)\n", sim_conf.enc_i_bytes);
+  printf("  --enc-slice-rows N   macroblock rows per slice, 0 keeps firmware setting (%d)\n",
+         sim_conf.enc_slice_rows);
+  printf("  --enc-fail-period N  every Nth sliced frame fails after its first slice, 0 never (%u)\n",
+         sim_conf.enc_fail_period);
+  printf("  --dma2d-setup-us N   DMA2D per transfer overhead (%u)\n", sim_conf.dma2d_setup_us);
+  printf("  --dma2d-mpix-s N     DMA2D throughput in pixels/s (%u)\n", sim_conf.dma2d_mpix_s);
+  printf("  --usb-kbps N         USB drain rate (%u)\n", sim_conf.usb_kbps);
+  printf("  --usb-stream N       advertised stream index the host opens (%d)\n", sim_conf.usb_stream);
+  printf("  --usb-switch N@MS    host reopens on stream N at MS ms\n");
+  printf("  --debug-overlay      enable the debug statistics overlay\n");
+  printf("  --psram-mbps N       PSRAM bandwidth left to the pipeline masters (%u)\n", sim_conf.psram_mbps);
+  printf("  --ipplug-split N     IPPlug DPREG words of pipe1, pipe2 gets the rest of 640 (%d)\n",
+         sim_conf.ipplug_split);
+  printf("  --ipplug-wlru A,B    IPPlug WLRU ratios of pipe1 and pipe2 (%d,%d)\n", sim_conf.ipplug_wlru[0],
+         sim_conf.ipplug_wlru[1]);
+  printf("  --ipplug-sweep       also evaluate a range of IPPlug splits and ratios\n");
+  printf("  --trace FILE         write the pipeline trace ring as Chrome trace JSON\n");
+  printf("  --cpu-stats FILE     write the last per task and interrupt cpu stats as JSON\n");
+}
+
+static int sim_parse_args(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt_long(argc, argv, "h", sim_options, NULL)) != -1) {
+    switch (opt) {
+    case 'f':
+      sim_conf.fps = atoi(optarg);
+      break;
+    case 'n':
+      sim_conf.frames = atoi(optarg);
+      break;
+    case 'j':
+      sim_conf.jitter_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 't':
+      sim_conf.timeline = optarg;
+      break;
+    case 's':
+      if (sscanf(optarg, "%dx%d", &sim_conf.width, &sim_conf.height) != 2)
+        return -1;
+      break;
+    case 'I':
+      sim_conf.isp_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'N':
+      sim_conf.nn_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'B':
+      sim_conf.nn_epoch_blocks = atoi(optarg);
+      break;
+    case 'K':
+      sim_conf.nn_init_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'A':
+      sim_conf.alt_nn_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'L':
+      sim_conf.reloc_install_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'V':
+      sim_conf.reloc_is_invalid = 1;
+      break;
+    case 'Y':
+      sim_conf.model_switch_ms = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'P':
+      sim_conf.pp_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'd':
+      sim_conf.detections = atoi(optarg);
+      break;
+    case 'r':
+      sim_conf.roi_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'E':
+      sim_conf.enc_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'p':
+      sim_conf.enc_p_bytes = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'i':
+      sim_conf.enc_i_bytes = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'R':
+      sim_conf.enc_slice_rows = atoi(optarg);
+      break;
+    case 'F':
+      sim_conf.enc_fail_period = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'S':
+      sim_conf.dma2d_setup_us = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'M':
+      sim_conf.dma2d_mpix_s = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'u':
+      sim_conf.usb_kbps = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'U':
+      sim_conf.usb_stream = atoi(optarg);
+      break;
+    case 'W':
+      if (sscanf(optarg, "%d@%u", &sim_conf.usb_switch_stream, &sim_conf.usb_switch_ms) != 2)
+        return -1;
+      break;
+    case 'D':
+      sim_conf.debug_overlay = 1;
+      break;
+    case 'm':
+      sim_conf.psram_mbps = (uint32_t) strtoul(optarg, NULL, 0);
+      break;
+    case 'x':
+      sim_conf.ipplug_split = atoi(optarg);
+      break;
+    case 'w':
+      if (sscanf(optarg, "%d,%d", &sim_conf.ipplug_wlru[0], &sim_conf.ipplug_wlru[1]) != 2)
+        return -1;
+      break;
+    case 'X':
+      sim_conf.ipplug_sweep = 1;
+      break;
+    case 'T':
+      sim_conf.trace = optarg;
+      break;
+    case 'C':
+      sim_conf.cpu_stats = optarg;
+      break;
+    default:
+      return -1;
+    }
+  }
+
+  if (sim_conf.fps <= 0 || sim_conf.frames <= 0 || sim_conf.width <= 0 || sim_conf.height <= 0 ||
+      sim_conf.width > 1280 || sim_conf.height > 720 || !sim_conf.dma2d_mpix_s || !sim_conf.usb_kbps ||
+      sim_conf.enc_slice_rows < 0 || sim_conf.usb_stream < 0 || sim_conf.usb_switch_stream < 0 ||
+      (sim_conf.usb_switch_ms && sim_conf.usb_switch_ms <= sim_conf.usb_start_ms) || !sim_conf.psram_mbps ||
+      sim_conf.ipplug_split < 0 || sim_conf.ipplug_split > 640 || sim_conf.ipplug_wlru[0] < 0 ||
+      sim_conf.ipplug_wlru[0] > 15 || sim_conf.ipplug_wlru[1] < 0 || sim_conf.ipplug_wlru[1] > 15)
+    return -1;
+
+  return 0;
+}
+
+static int sim_cmp_u32(const void *a, const void *b)
+{
+  uint32_t va = *(const uint32_t *) a;
+  uint32_t vb = *(const uint32_t *) b;
+
+  return (va > vb) - (va < vb);
+}
+
+static uint32_t sim_percentile(const uint32_t *sorted, uint32_t nb, int pct)
+{
+  uint32_t idx;
+
+  if (!nb)
+    return 0;
+  idx = (uint32_t) (((uint64_t) nb * (uint64_t) pct + 99) / 100);
+
+  return sorted[idx ? idx - 1 : 0];
+}
+
+static void sim_print_time_stat(const char *label, const time_stat_t *stat)
+{
+  printf("  %-18s last %7.2f ms  mean %6.2f ms  p50 %6.2f  p90 %6.2f  p99 %6.2f  max %6.2f ms  n %d\n", label,
+         stat->last / 1000.0, stat->mean / 1000, time_stat_percentile(stat, 50) / 1000.0,
+         time_stat_percentile(stat, 90) / 1000.0, time_stat_percentile(stat, 99) / 1000.0,
+         time_stat_max(stat) / 1000.0, stat->total);
+}
+
+static const char *sim_bw_label[BW_MASTER_NB] = {
+  [BW_CAPTURE_DISPLAY] = "capture display",
+  [BW_CAPTURE_NN] = "capture nn",
+  [BW_NN_IN] = "nn input",
+  [BW_NN_OUT] = "nn output",
+  [BW_VENC_IN] = "venc input",
+  [BW_VENC_REF] = "venc reference",
+  [BW_VENC_OUT] = "venc output",
+  [BW_OVERLAY] = "overlay",
+};
+
+/* Per camera frame, not per dp thread iteration, so stages running at nn rate are averaged */
+static double sim_bw_frame_bytes(const stat_info_t *si, bw_master_t master)
+{
+  if (!si->bw_elapsed_ms)
+    return 0;
+
+  return (double) si->bw[master].acc * 1000 / si->bw_elapsed_ms / sim_conf.fps;
+}
+
+static void sim_print_bw(const stat_info_t *si)
+{
+  sim_ipplug_load_t load = { 0 };
+  double psram = 0;
+  double bytes;
+  int i;
+
+  for (i = 0; i < BW_MASTER_NB; i++) {
+    bytes = sim_bw_frame_bytes(si, i);
+    if (app_stats_bw_is_psram(i))
+      psram += bytes;
+    printf("  bw %-15s %8.1f kB/frame %7.1f MB/s %s\n", sim_bw_label[i], bytes / 1024,
+           bytes * sim_conf.fps / 1e6, app_stats_bw_is_psram(i) ? "psram" : "internal");
+  }
+  printf("psram       : %.1f kB/frame, %.1f MB/s\n", psram / 1024, psram * sim_conf.fps / 1e6);
+
+  load.pipe_bytes[0] = sim_bw_frame_bytes(si, BW_CAPTURE_DISPLAY);
+  load.pipe_bytes[1] = sim_bw_frame_bytes(si, BW_CAPTURE_NN);
+  load.enc_bytes = sim_bw_frame_bytes(si, BW_VENC_IN) + sim_bw_frame_bytes(si, BW_VENC_REF);
+  load.enc_us = sim_conf.enc_us;
+  load.nn_bytes = sim_bw_frame_bytes(si, BW_NN_IN);
+  load.nn_us = sim_conf.nn_us;
+  load.overlay_bytes = sim_bw_frame_bytes(si, BW_OVERLAY);
+  sim_report_lock();
+  load.overlay_us = sim_report.uvc_frames ? (uint32_t) (sim_report.dma2d_busy_us / sim_report.uvc_frames) : 0;
+  sim_report_unlock();
+  sim_ipplug_report(&load);
+}
+
+/* Host stacks differ from the target ones, only run time shares are meaningful */
+static void sim_print_npu(void)
+{
+  const nn_service_model_t *model;
+  uint32_t i;
+
+  printf("npu         :");
+  for (i = 0; i < nn_service_count(); i++) {
+    model = nn_service_get(i);
+    printf(" %s priority %d %u preemptions %u selects", model->name, model->priority, model->preempt_nb,
+           model->select_nb);
+    if (model->is_reloc)
+      printf(" install %.2f ms", model->install_us / 1000.0);
+    printf(" init %.2f ms switch %.3f ms%s", model->init_us / 1000.0, model->switch_us / 1000.0,
+           i + 1 < nn_service_count() ? "," : "\n");
+  }
+}
+
+static void sim_print_cpu(const stat_info_t *si)
+{
+  const cpu_stat_t *cpu = &si->cpu;
+  int i;
+
+  printf("cpu         : last %u ms window\n", cpu->period_ms);
+  for (i = 0; i < cpu->task_nb; i++)
+    printf("  task %-13s %5.1f %% (priority %lu)\n", cpu->task[i].name, cpu->task[i].load,
+           (unsigned long) cpu->task[i].priority);
+  for (i = 0; i < ISR_SRC_NB; i++)
+    printf("  isr %-14s %5.2f %%, %u calls, longest %u us\n", app_stats_isr_name(i), cpu->isr[i].load,
+           cpu->isr[i].nb, cpu->isr[i].max_us);
+}
+
+static void sim_print_report(int frames, uint64_t duration_us)
+{
+  static uint32_t sorted[SIM_LATENCY_SAMPLES_MAX];
+  stat_info_t si;
+  uint32_t nb;
+
+  stat_info_copy(&si);
+
+  sim_report_lock();
+  nb = sim_report.latency_nb;
+  memcpy(sorted, sim_report.latency_us, nb * sizeof(sorted[0]));
+  qsort(sorted, nb, sizeof(sorted[0]), sim_cmp_u32);
+
+  printf("timeline    : %d frames in %.3f s (%s)\n", frames, duration_us / 1e6,
+         sim_conf.timeline ? sim_conf.timeline : "periodic");
+  printf("capture     : pipe1 %u frames, pipe2 %u frames\n", sim_report.pipe_frames[1], sim_report.pipe_frames[2]);
+  printf("nn          : %u input drops (%.1f %%)\n", sim_report.nn_drops,
+         sim_report.pipe_frames[2] ? 100.0 * sim_report.nn_drops / sim_report.pipe_frames[2] : 0.0);
+  printf("encoder     : %u frames (%u intra), %u errors, %u rate control changes\n", sim_report.enc_frames,
+         sim_report.enc_intra, sim_report.enc_errors, sim_report.enc_rc_changes);
+  printf("uvc         : %u delivered, %u rejected, %u aborted, %.1f kB/frame\n", sim_report.uvc_frames,
+         sim_report.uvc_rejects, sim_report.uvc_aborts,
+         sim_report.uvc_frames ? sim_report.uvc_bytes / 1024.0 / sim_report.uvc_frames : 0.0);
+  printf("streams     : %u switches, %u display pipe resizes, %dx%d at end\n", sim_report.uvc_switches,
+         sim_report.cam_resizes, CAM_GetVencWidth(), CAM_GetVencHeight());
+  printf("display     : %u of %u captured frames delivered (%u dropped)\n", sim_report.uvc_frames,
+         sim_report.pipe_frames[1],
+         sim_report.pipe_frames[1] > sim_report.uvc_frames ? sim_report.pipe_frames[1] - sim_report.uvc_frames : 0);
+  printf("dma2d       : %u transfers, %.2f ms busy and %.1f kB traffic per delivered frame\n",
+         sim_report.dma2d_ops, sim_report.uvc_frames ? sim_report.dma2d_busy_us / 1000.0 / sim_report.uvc_frames : 0.0,
+         sim_report.uvc_frames ? sim_report.dma2d_bytes / 1024.0 / sim_report.uvc_frames : 0.0);
+  printf("frame memory: %.1f kB written by capture, %.1f kB read by encoder per frame\n",
+         sim_report.pipe_frames[1] ? sim_report.capture_bytes / 1024.0 / sim_report.pipe_frames[1] : 0.0,
+         sim_report.enc_frames ? sim_report.enc_in_bytes / 1024.0 / sim_report.enc_frames : 0.0);
+  printf("glass-to-usb: p50 %.2f ms  p90 %.2f ms  p99 %.2f ms  max %.2f ms (%u samples)\n",
+         sim_percentile(sorted, nb, 50) / 1000.0, sim_percentile(sorted, nb, 90) / 1000.0,
+         sim_percentile(sorted, nb, 99) / 1000.0, nb ? sorted[nb - 1] / 1000.0 : 0.0, nb);
+  sim_report_unlock();
+
+  printf("app stats   :\n");
+  sim_print_time_stat("nn total", &si.nn_total_time);
+  sim_print_time_stat("nn inference", &si.nn_inference_time);
+  sim_print_time_stat("nn prepare", &si.nn_prepare_time);
+  sim_print_time_stat("nn npu idle", &si.nn_idle_time);
+  sim_print_time_stat("disp total", &si.disp_total_time);
+  sim_print_time_stat("disp pp", &si.nn_pp_time);
+  sim_print_time_stat("disp roi", &si.nn_roi_time);
+  sim_print_time_stat("disp display", &si.disp_display_time);
+  sim_print_time_stat("disp encode", &si.disp_enc_time);
+  sim_print_time_stat("glass to usb", &si.glass_to_usb_time);
+  sim_print_time_stat("usb drain", &si.uvc_drain_time);
+  printf("  venc bitrate       %d kbps, %u decreases, %u increases, %u skipped frames\n",
+         si.venc_bitrate.bitrate / 1000, si.venc_bitrate.decrease_nb, si.venc_bitrate.increase_nb,
+         si.venc_bitrate.skip_nb);
+  printf("  roi                %.2f run and %.2f skipped per frame, %u frames\n",
+         si.roi.frame_nb ? (double) si.roi.run_nb / si.roi.frame_nb : 0.0,
+         si.roi.frame_nb ? (double) si.roi.skip_nb / si.roi.frame_nb : 0.0, si.roi.frame_nb);
+  sim_print_npu();
+  sim_print_cpu(&si);
+  sim_print_bw(&si);
+}
+
+static void sim_trace_out(const char *str, void *arg)
+{
+  fputs(str, arg);
+}
+
+static int sim_write_trace(void)
+{
+  FILE *f;
+
+  if (!sim_conf.trace)
+    return 0;
+  f = fopen(sim_conf.trace, "w");
+  if (!f) {
+    perror(sim_conf.trace);
+    return -1;
+  }
+  app_trace_dump(sim_trace_out, f);
+  fclose(f);
+
+  return 0;
+}
+
+static int sim_write_cpu_stats(void)
+{
+  FILE *f;
+
+  if (!sim_conf.cpu_stats)
+    return 0;
+  f = fopen(sim_conf.cpu_stats, "w");
+  if (!f) {
+    perror(sim_conf.cpu_stats);
+    return -1;
+  }
+  app_stats_cpu_dump(sim_trace_out, f);
+  fclose(f);
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t start_us;
+  int frames;
+
+  if (sim_parse_args(argc, argv)) {
+    sim_usage(argv[0]);
+    return 1;
+  }
+
+  /* latch the time base before any thread exists */
+  sim_now_us();
+
+  app_run();
+
+  start_us = sim_now_us();
+  frames = sim_camera_run();
+  if (frames < 0)
+    return 1;
+  sim_sleep_us(SIM_DRAIN_MS * 1000);
+
+  sim_print_report(frames, sim_now_us() - start_us);
+  if (sim_write_trace())
+    return 1;
+  if (sim_write_cpu_stats())
+    return 1;
+
+  /* pipeline threads never return */
+  exit(0);
+}
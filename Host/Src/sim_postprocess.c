@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * @file    sim_postprocess.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include "app_postprocess.h"
+#include "sim.h"
+
+#define SIM_PP_MAX_DETECTIONS 10
+
+/* Synthetic detections drifting across the frame so overlays change every frame */
+static od_pp_outBuffer_t sim_pp_boxes[SIM_PP_MAX_DETECTIONS];
+static uint32_t sim_pp_frame;
+
+int32_t app_postprocess_init(void *params_postprocess, NN_Instance_TypeDef *NN_Instance)
+{
+  (void) params_postprocess;
+  (void) NN_Instance;
+
+  sim_pp_frame = 0;
+
+  return AI_OD_POSTPROCESS_ERROR_NO;
+}
+
+int32_t app_postprocess_run(void *pInput[], int nb_input, void *pOutput, void *pInput_param)
+{
+  od_pp_out_t *out = pOutput;
+  int nb = sim_conf.detections;
+  int i;
+
+  (void) pInput;
+  (void) nb_input;
+  (void) pInput_param;
+
+  sim_cpu_busy_us(sim_conf.pp_us);
+
+  if (nb > SIM_PP_MAX_DETECTIONS)
+    nb = SIM_PP_MAX_DETECTIONS;
+  for (i = 0; i < nb; i++) {
+    sim_pp_boxes[i].x_center = 0.1f + 0.8f * (float) ((sim_pp_frame * 7 + i * 97) % 100) / 100.0f;
+    sim_pp_boxes[i].y_center = 0.2f + 0.6f * (float) ((i * 31) % 100) / 100.0f;
+    sim_pp_boxes[i].width = 0.15f;
+    sim_pp_boxes[i].height = 0.2f;
+    /* cascade visits boxes by decreasing confidence */
+    sim_pp_boxes[i].conf = 0.9f - 0.05f * i;
+    sim_pp_boxes[i].class_index = 0;
+  }
+  sim_pp_frame++;
+
+  out->pOutBuff = sim_pp_boxes;
+  out->nb_detect = nb;
+
+  return AI_OD_POSTPROCESS_ERROR_NO;
+}
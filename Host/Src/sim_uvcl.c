@@ -0,0 +1,251 @@
+/**
+ ******************************************************************************
+ * @file    sim_uvcl.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+
+#include "sim.h"
+#include "uvcl.h"
+
+/* USB host model: the host opens advertised stream usb_stream usb_start_ms
+ * after boot and drains each frame at usb_kbps. Like the library, one frame
+ * can be queued while another one is on the wire. A progressive frame is
+ * drained as its bytes are produced, polling at the USB HS microframe rate.
+ * With usb_switch_ms set, the host closes the stream once the frame on the
+ * wire is done and opens usb_switch_stream SIM_UVCL_SWITCH_GAP_US later.
+ */
+typedef struct {
+  UVCL_Conf_t conf;
+  UVCL_Callbacks_t *cbs;
+  int is_streaming;
+  void *p_frame;
+  int frame_size;
+  UVCL_FrameProgress_t *p_progress;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+} sim_uvcl_ctx_t;
+
+static sim_uvcl_ctx_t sim_uvcl = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+};
+
+PCD_HandleTypeDef uvcl_pcd_handle;
+
+static void sim_uvcl_record_delivery(int frame_size, uint64_t capture_ts)
+{
+  uint64_t now = sim_now_us();
+
+  sim_report_lock();
+  sim_report.uvc_frames++;
+  sim_report.uvc_bytes += (uint64_t) frame_size;
+  if (capture_ts && sim_report.latency_nb < SIM_LATENCY_SAMPLES_MAX)
+    sim_report.latency_us[sim_report.latency_nb++] = (uint32_t) (now - capture_ts);
+  sim_report_unlock();
+}
+
+#define SIM_UVCL_MICROFRAME_US 125
+#define SIM_UVCL_SWITCH_GAP_US 20000
+
+static void sim_uvcl_drain(int len)
+{
+  /* kbps is kilobits per second, i.e. bits per millisecond */
+  sim_sleep_us((uint64_t) len * 8ULL * 1000ULL / sim_conf.usb_kbps);
+}
+
+/* Returns -1 if the producer aborted the frame */
+static int sim_uvcl_drain_progressive(UVCL_FrameProgress_t *progress)
+{
+  int is_complete;
+  int frame_size;
+  int sent = 0;
+
+  while (1) {
+    is_complete = progress->is_complete;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    frame_size = progress->frame_size;
+    if (is_complete && progress->is_error) {
+      return -1;
+    } else if (frame_size > sent) {
+      sim_uvcl_drain(frame_size - sent);
+      sent = frame_size;
+    } else if (is_complete) {
+      break;
+    } else {
+      sim_sleep_us(SIM_UVCL_MICROFRAME_US);
+    }
+  }
+
+  return sent;
+}
+
+static void sim_uvcl_start(sim_uvcl_ctx_t *p_ctx, int stream_idx)
+{
+  pthread_mutex_lock(&p_ctx->lock);
+  p_ctx->is_streaming = 1;
+  pthread_mutex_unlock(&p_ctx->lock);
+  sim_isr_enter(ISR_USB);
+  if (p_ctx->cbs->streaming_active)
+    p_ctx->cbs->streaming_active(p_ctx->cbs, p_ctx->conf.streams[stream_idx]);
+  sim_isr_exit();
+}
+
+/* Same as library: queued frame is released on stop */
+static void sim_uvcl_stop(sim_uvcl_ctx_t *p_ctx)
+{
+  void *frame;
+
+  pthread_mutex_lock(&p_ctx->lock);
+  p_ctx->is_streaming = 0;
+  frame = p_ctx->p_frame;
+  p_ctx->p_frame = NULL;
+  pthread_mutex_unlock(&p_ctx->lock);
+  sim_isr_enter(ISR_USB);
+  if (frame)
+    p_ctx->cbs->frame_release(p_ctx->cbs, frame);
+  if (p_ctx->cbs->streaming_inactive)
+    p_ctx->cbs->streaming_inactive(p_ctx->cbs);
+  sim_isr_exit();
+}
+
+static void sim_uvcl_switch(sim_uvcl_ctx_t *p_ctx)
+{
+  sim_uvcl_stop(p_ctx);
+  sim_sleep_us(SIM_UVCL_SWITCH_GAP_US);
+  sim_uvcl_start(p_ctx, sim_conf.usb_switch_stream);
+  sim_report_lock();
+  sim_report.uvc_switches++;
+  sim_report_unlock();
+}
+
+static void *sim_uvcl_thread(void *arg)
+{
+  sim_uvcl_ctx_t *p_ctx = arg;
+  uint64_t switch_us = (uint64_t) sim_conf.usb_switch_ms * 1000;
+  int is_switch_pending = sim_conf.usb_switch_ms != 0;
+  UVCL_FrameProgress_t *progress;
+  uint64_t capture_ts;
+  int frame_size;
+  void *frame;
+
+  sim_sleep_us((uint64_t) sim_conf.usb_start_ms * 1000);
+  sim_uvcl_start(p_ctx, sim_conf.usb_stream);
+
+  while (1) {
+    if (is_switch_pending && sim_now_us() >= switch_us) {
+      sim_uvcl_switch(p_ctx);
+      is_switch_pending = 0;
+    }
+
+    pthread_mutex_lock(&p_ctx->lock);
+    /* Poll while a switch is pending so it happens on time with no frame queued */
+    if (is_switch_pending && !p_ctx->p_frame) {
+      pthread_mutex_unlock(&p_ctx->lock);
+      sim_sleep_us(SIM_UVCL_MICROFRAME_US);
+      continue;
+    }
+    while (!p_ctx->p_frame)
+      pthread_cond_wait(&p_ctx->cond, &p_ctx->lock);
+    frame = p_ctx->p_frame;
+    frame_size = p_ctx->frame_size;
+    progress = p_ctx->p_progress;
+    p_ctx->p_frame = NULL;
+    pthread_mutex_unlock(&p_ctx->lock);
+    capture_ts = sim_encoder_capture_ts(frame);
+
+    if (progress)
+      frame_size = sim_uvcl_drain_progressive(progress);
+    else
+      sim_uvcl_drain(frame_size);
+    if (frame_size >= 0) {
+      sim_uvcl_record_delivery(frame_size, capture_ts);
+    } else {
+      sim_report_lock();
+      sim_report.uvc_aborts++;
+      sim_report_unlock();
+    }
+
+    sim_isr_enter(ISR_USB);
+    p_ctx->cbs->frame_release(p_ctx->cbs, frame);
+    sim_isr_exit();
+  }
+
+  return NULL;
+}
+
+int UVCL_Init(PCD_TypeDef *pcd_instance, UVCL_Conf_t *conf, UVCL_Callbacks_t *cbs)
+{
+  int ret;
+
+  if (!conf || !cbs || !cbs->frame_release || conf->streams_nb < 1)
+    return -1;
+  if (sim_conf.usb_stream >= conf->streams_nb || sim_conf.usb_switch_stream >= conf->streams_nb)
+    return -1;
+
+  uvcl_pcd_handle.Instance = pcd_instance;
+  sim_uvcl.conf = *conf;
+  sim_uvcl.cbs = cbs;
+  ret = pthread_create(&sim_uvcl.thread, NULL, sim_uvcl_thread, &sim_uvcl);
+
+  return ret ? -1 : 0;
+}
+
+int UVCL_Deinit(void)
+{
+  return 0;
+}
+
+void UVCL_IRQHandler(void)
+{
+}
+
+static int sim_uvcl_show(void *frame, int frame_size, UVCL_FrameProgress_t *progress)
+{
+  sim_uvcl_ctx_t *p_ctx = &sim_uvcl;
+  int ret = -1;
+
+  pthread_mutex_lock(&p_ctx->lock);
+  if (p_ctx->is_streaming && !p_ctx->p_frame && frame && (frame_size || progress)) {
+    p_ctx->frame_size = frame_size;
+    p_ctx->p_progress = progress;
+    p_ctx->p_frame = frame;
+    pthread_cond_signal(&p_ctx->cond);
+    ret = 0;
+  }
+  pthread_mutex_unlock(&p_ctx->lock);
+
+  if (ret) {
+    sim_report_lock();
+    sim_report.uvc_rejects++;
+    sim_report_unlock();
+  }
+
+  return ret;
+}
+
+int UVCL_ShowFrame(void *frame, int frame_size)
+{
+  return sim_uvcl_show(frame, frame_size, NULL);
+}
+
+int UVCL_ShowFrameProgressive(void *frame, UVCL_FrameProgress_t *progress)
+{
+  return sim_uvcl_show(frame, 0, progress);
+}
@@ -47,8 +47,22 @@
 
 #define CAMERA_FPS 30
 
+/* Display pipe output, read as is by the encoder. CAPTURE_YUV420SP captures NV12 (YUV420 semi-planar,
+ * chroma plane right after luma): 1.5 bytes per pixel instead of 4 with ARGB8888, and no color
+ * conversion in the encoder. DMA2D can't write YUV, so overlay is then blended by cpu. Off by default.
+ */
+#define CAPTURE_YUV420SP 0
+
+#if CAPTURE_YUV420SP
+#define CAPTURE_FORMAT DCMIPP_PIXEL_PACKER_FORMAT_YUV420_2
+/* luma plane, chroma plane has the same pitch */
+#define CAPTURE_BPP 1
+#define CAPTURE_FRAME_SIZE(w, h) ((w) * (h) * 3 / 2)
+#else
 #define CAPTURE_FORMAT DCMIPP_PIXEL_PACKER_FORMAT_ARGB8888
 #define CAPTURE_BPP 4
+#define CAPTURE_FRAME_SIZE(w, h) ((w) * (h) * CAPTURE_BPP)
+#endif
 
 /* Model Related Info */
 #define NN_WIDTH 224
@@ -56,6 +70,102 @@
 #define NN_FORMAT DCMIPP_PIXEL_PACKER_FORMAT_RGB888_YUV444_1
 #define NN_BPP 3
 
+/* Cascade: once the detector output is postprocessed, crop each detection from the capture frame
+ * and run a second model on it, e.g. a classifier whose top class replaces the detector one. The
+ * model is generated with network name Roi (Model/network_roi.c, to add to the build) and takes a
+ * NN_ROI_WIDTH x NN_ROI_HEIGHT RGB888 input. ROIs run by decreasing confidence while they fit in
+ * NN_ROI_BUDGET_US per frame, at most NN_ROI_MAX of them.
+ */
+#ifndef APP_NN_CASCADE
+#define APP_NN_CASCADE 0
+#endif
+#define NN_ROI_WIDTH 96
+#define NN_ROI_HEIGHT 96
+/* Bytes, at least the Roi model output size */
+#define NN_ROI_OUTPUT_SIZE 1024
+#define NN_ROI_BUDGET_US 8000
+#define NN_ROI_MAX 4
+
+/* Second detector the pipeline can switch to between frames, e.g. a night or a far range model.
+ * It is generated with network name Alt (Model/network_alt.c, to add to the build), takes the same
+ * input and postprocess as the default model and its output fits the default one's. Both are
+ * initialized at boot so a switch does not pay LL_ATON_RT_Init_Network(). USER2 toggles models.
+ */
+#ifndef APP_NN_ALT_MODEL
+#define APP_NN_ALT_MODEL 0
+#endif
+
+/* Detector installed at boot from a relocatable binary (stedgeai --reloc) programmed at
+ * NN_RELOC_FLASH_ADDR, so that updating it is a data only operation. Its code and data are copied to
+ * PSRAM, its weights stay in flash. It must fit the default model input, output and postprocess. The
+ * statically linked model is used when the partition holds no valid binary.
+ */
+#ifndef APP_NN_RELOC
+#define APP_NN_RELOC 0
+#endif
+#define NN_RELOC_FLASH_ADDR 0x71000000
+#define NN_RELOC_EXEC_RAM_SIZE (512 * 1024)
+#define NN_RELOC_EXT_RAM_SIZE (1024 * 1024)
+
+/* Models share the NPU at epoch block boundaries, highest priority first then earliest deadline.
+ * The detector keeps its frame rate whatever runs beside it.
+ */
+#define NN_PRIORITY 1
+#define NN_DEADLINE_US (1000000 / CAMERA_FPS)
+#define NN_ROI_PRIORITY 0
+#define NN_ROI_DEADLINE_US NN_ROI_BUDGET_US
+
+/* NN queues depth, up to BQUEUE_MAX_BUFFERS. Outputs are three stages deep: one prepared for frame
+ * N + 1, one written by the NPU for frame N and one postprocessed for frame N - 1.
+ */
+#define NN_INPUT_BUFFER_NB 3
+#define NN_OUTPUT_BUFFER_NB 3
+
+/* Encoder output slots handed to UVCL without copy. UVCL holds up to two frames
+ * (one on the wire, one queued), a third slot keeps the encoder busy meanwhile. Slots
+ * live in AXI_SRAM_UNCACHED and share 528 KB, 176 KB each with 3 slots.
+ */
+#define VENC_OUT_BUFFER_NB 3
+
+/* Low latency mode: encode in slices of VENC_SLICE_ROWS macroblock rows and start USB
+ * transfer on first slice. 0 encodes a frame in one slice.
+ */
+#define VENC_SLICE_ROWS 0
+
+/* Encoder rate control. Defines: ENC_RATE_CTRL_VBR; ENC_RATE_CTRL_CVBR; ENC_RATE_CTRL_CQP;
+ * VENC_BITRATE in bits per second, 0 derives it from resolution. Both can be changed at
+ * runtime with app_display_set_rate_control().
+ */
+#define VENC_RATE_CTRL_MODE ENC_RATE_CTRL_VBR
+#define VENC_BITRATE 0
+
+/* Lower bitrate below VENC_BITRATE when USB cannot drain frames in time. Unused with ENC_RATE_CTRL_CQP */
+#define VENC_ADAPTIVE_BITRATE 1
+
+/* UVC streams advertised to the host as { size divider, fps divider } applied to VENC_WIDTH x
+ * VENC_HEIGHT at CAMERA_FPS. Display pipe and encoder are reconfigured on the stream host opens.
+ * Use { { 1, 1 } } to only expose full size.
+ */
+#define UVC_STREAM_DIVIDERS { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } }
+
+/* Also advertise each stream as MJPEG, for hosts where H264 decode adds latency. Frames are
+ * encoded with VENC_JPEG_QLEVEL quantization level (1 to 9) and no rate control.
+ */
+#define UVC_STREAM_MJPEG 1
+#define VENC_JPEG_QLEVEL 6
+
+/* Render text panels in their own ARGB buffers in internal ram, redrawn only when their content
+ * changes, then blended on the frame in a single transfer each. This saves DMA2D work for panels
+ * that rarely change but costs a full panel blend per frame, so it is off by default.
+ */
+#define OVERLAY_REGIONS 0
+
+/* Keep the last APP_TRACE_DEPTH pipeline events (stage begin/end per frame, DWT timestamps). Turning
+ * the debug overlay off with USER1 dumps them on the console as a Chrome trace event array. 0
+ * disables tracing.
+ */
+#define APP_TRACE_DEPTH 1024
+
 /* Delay display by CAPTURE_DELAY frame number */
 #define CAPTURE_DELAY 1
 
@@ -21,5 +21,9 @@
 
 void app_pipeline_init(void);
 void app_pipeline_start(void);
+/* Detector models registered by the pipeline, the default one is 0 */
+int app_pipeline_model_nb(void);
+/* Callable from any task, nn thread switches to model idx before its next frame */
+void app_pipeline_model_request(int idx);
 
 #endif
@@ -27,8 +27,11 @@ void CAM_Init(void);
 void CAM_DisplayPipe_Start(uint8_t *display_pipe_dst, uint32_t cam_mode);
 void CAM_NNPipe_Start(uint8_t *nn_pipe_dst, uint32_t cam_mode);
 void CAM_IspUpdate(void);
+int CAM_DisplayPipe_SetSize(int width, int height);
 int CAM_DisplayPipe_UpdateAddress(uint8_t *display_pipe_dst);
 int CAM_NNPipe_UpdateAddress(uint8_t *nn_pipe_dst);
+uint32_t CAM_GetFrameId(uint32_t pipe);
+void CAM_GetSensorState(int32_t *exposure, int32_t *gain);
 
 int CAM_GetVencWidth(void);
 int CAM_GetVencHeight(void);
@@ -21,8 +21,22 @@
 
 #include <stdint.h>
 
+#define FAL_DMA2D_QUEUE_LEN 32
+
 typedef void (*fal_dma2d_cb_t)(void *user);
 
+/* Sequence number of a queued transfer. It is done once this transfer and all earlier ones completed */
+typedef uint32_t fal_dma2d_fence_t;
+
+typedef enum {
+  FAL_DMA2D_FORMAT_ARGB8888,
+  /* Alpha only, color is given by src_color */
+  FAL_DMA2D_FORMAT_A8,
+  /* Same as A8 with two pixels per byte, first one in low nibble. Lines start on a byte */
+  FAL_DMA2D_FORMAT_A4,
+} fal_dma2d_format_t;
+
+/* Blend src over dst. Destination is ARGB8888 */
 typedef struct {
   uint8_t *dst;
   uint32_t dst_width;
@@ -30,6 +44,11 @@ typedef struct {
   uint8_t *src;
   uint32_t src_width;
   uint32_t src_height;
+  /* src line length in pixels, 0 when equal to src_width */
+  uint32_t src_stride;
+  fal_dma2d_format_t src_format;
+  /* RGB of A8/A4 sources */
+  uint32_t src_color;
   uint32_t x_offset;
   uint32_t y_offset;
   fal_dma2d_cb_t on_complete;
@@ -46,14 +65,26 @@ typedef struct {
   uint32_t x_offset;
   uint32_t y_offset;
   uint32_t color;
+  /* Blend color alpha over dst instead of overwriting it */
+  int is_blend;
   fal_dma2d_cb_t on_complete;
   fal_dma2d_cb_t on_error;
   void *user;
 } fal_dma2d_fill_t;
 
+/* Transfers are queued and chained from the completion interrupt. They return -1 when the
+ * queue is full. Queueing is done from task context only, callbacks run from interrupt.
+ */
 int FAL_DMA2D_Blend(const fal_dma2d_blend_t *cfg);
 int FAL_DMA2D_Fill(const fal_dma2d_fill_t *cfg);
+/* Fence of last queued transfer */
+fal_dma2d_fence_t FAL_DMA2D_GetFence(void);
+int FAL_DMA2D_IsDone(fal_dma2d_fence_t fence);
+/* Calls cb from interrupt once fence is done, unless it is already done where it returns 1.
+ * There is a single waiter at a time.
+ */
+int FAL_DMA2D_NotifyFence(fal_dma2d_fence_t fence, fal_dma2d_cb_t cb, void *user);
+/* Called by DMA2D_IRQHandler() */
 void FAL_DMA2D_IRQHandler(void);
-void DMA2D_IRQHandler(void);
 
 #endif /* FAL_DMA2D_H */
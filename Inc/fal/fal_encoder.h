@@ -21,14 +21,67 @@
 #include <stddef.h>
 #include <stdint.h>
 
+typedef enum {
+  ENC_CODEC_H264,
+  ENC_CODEC_JPEG,
+} ENC_Codec_t;
+
+/* Frame layout of p_in */
+typedef enum {
+  /* Packed 32 bits per pixel */
+  ENC_INPUT_ARGB8888,
+  /* YUV420 semi-planar, interleaved chroma plane right after luma one */
+  ENC_INPUT_NV12,
+} ENC_Input_t;
+
+typedef enum {
+  ENC_RATE_CTRL_VBR,
+  /* Constrained VBR: VBR held close to target by a half second buffer, not a strict HRD CBR */
+  ENC_RATE_CTRL_CVBR,
+  ENC_RATE_CTRL_CQP,
+} ENC_RateCtrlMode_t;
+
+/* Zero fields select defaults: bitrate from resolution, gop_size of fps frames, qp 25, qp
+ * range 10 to 51.
+ */
 typedef struct {
+  ENC_RateCtrlMode_t mode;
+  /* Target in bits per second. Unused in CQP mode */
+  int bitrate;
+  /* Distance between two intra frames, including the first one */
+  int gop_size;
+  /* Fixed qp in CQP mode, initial qp otherwise */
+  int qp;
+  /* Bounds of rate controlled qp. Unused in CQP mode */
+  int qp_min;
+  int qp_max;
+} ENC_RateCtrl_t;
+
+typedef struct {
+  ENC_Codec_t codec;
+  ENC_Input_t input;
   int width;
   int height;
   int fps;
+  /* Slice height in macroblock rows. 0 encodes each picture in one slice. H264 only */
+  int slice_rows;
+  /* H264 only. JPEG has no rate control and reports ENC_RATE_CTRL_CQP with qp set to jpeg_qlevel */
+  ENC_RateCtrl_t rate_ctrl;
+  /* JPEG quantization level from 1 (smallest frames) to 9 (best quality). 0 selects 6 */
+  int jpeg_qlevel;
 } ENC_Conf_t;
 
+/* len is the number of bytes of p_out ready so far */
+typedef void (*ENC_SliceReadyCb_t)(void *cb_arg, size_t len);
+
 void ENC_Init(ENC_Conf_t *p_conf);
 void ENC_DeInit(void);
+/* Applies from next encoded frame. Must be called from the encoding task. Fails for JPEG */
+int ENC_SetRateControl(const ENC_RateCtrl_t *p_rc);
+void ENC_GetRateControl(ENC_RateCtrl_t *p_rc);
 int ENC_EncodeFrame(uint8_t *p_in, uint8_t *p_out, size_t out_len, int is_intra_force);
+/* Same as ENC_EncodeFrame() with cb called as slices complete. cb runs in caller context */
+int ENC_EncodeFrameSliced(uint8_t *p_in, uint8_t *p_out, size_t out_len, int is_intra_force,
+                          ENC_SliceReadyCb_t cb, void *cb_arg);
 
 #endif
@@ -22,11 +22,15 @@
 #include <stdint.h>
 
 #include "fal/fal_encoder.h"
+#include "svc/buffer_queue.h"
 #include "app_postprocess.h"
 #include "uvcl.h"
 
 void app_display_init(void);
 int app_display_setup(const ENC_Conf_t *enc_conf, const UVCL_Conf_t *uvcl_conf);
-int app_display_render(uint8_t *frame_buffer, od_pp_out_t *pp_out);
+int app_display_render(uint8_t *frame_buffer, const bqueue_meta_t *meta, od_pp_out_t *pp_out);
+/* Can be called from any task. Change is applied before next encoded frame */
+void app_display_set_rate_control(const ENC_RateCtrl_t *rc);
+void app_display_get_rate_control(ENC_RateCtrl_t *rc);
 
 #endif
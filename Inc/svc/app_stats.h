@@ -22,23 +22,151 @@
 #include <stdint.h>
 
 #include "FreeRTOS.h"
+#include "task.h"
 
 #define CPU_LOAD_HISTORY_DEPTH 8
+/* Histogram buckets: 1 us wide below 16 us, then 8 per power of two up to 2^26 us */
+#define TIME_STAT_BUCKET_NB 192
+/* Samples per histogram window, percentiles cover the last one to two windows */
+#define TIME_STAT_WINDOW 128
+/* Must cover every task in the system, uxTaskGetSystemState() fails otherwise */
+#define TASK_STAT_MAX_NB 12
+#define TASK_STAT_NAME_LEN 16
+#define TASK_STAT_PERIOD_MS 1000
 
 typedef struct {
+  uint8_t bucket[TIME_STAT_BUCKET_NB];
+  uint32_t nb;
+  uint32_t max;
+} time_hist_t;
+
+/* Durations in us */
+typedef struct {
+  /* Odd while the writer updates the stat, see stat_info_copy() */
+  uint32_t seq;
   int last;
   int total;
   uint64_t acc;
   float mean;
+  time_hist_t hist[2];
+  int hist_cur;
 } time_stat_t;
 
+typedef struct {
+  uint32_t seq;
+  int bitrate;
+  uint32_t decrease_nb;
+  uint32_t increase_nb;
+  uint32_t skip_nb;
+} bitrate_stat_t;
+
+/* Cascade ROIs since boot */
+typedef struct {
+  uint32_t seq;
+  uint32_t frame_nb;
+  uint32_t run_nb;
+  uint32_t skip_nb;
+  /* ROIs run by the last frame */
+  int last;
+} roi_stat_t;
+
+/* Memory traffic of each bus master, estimated from the buffers the stages move */
+typedef enum {
+  /* DCMIPP pipe1 writes, PSRAM */
+  BW_CAPTURE_DISPLAY,
+  /* DCMIPP pipe2 writes, PSRAM */
+  BW_CAPTURE_NN,
+  /* NPU reads network input, PSRAM */
+  BW_NN_IN,
+  /* NPU writes network output, internal ram */
+  BW_NN_OUT,
+  /* VENC reads frame, PSRAM */
+  BW_VENC_IN,
+  /* VENC reads reference and writes reconstructed frame, PSRAM */
+  BW_VENC_REF,
+  /* VENC writes stream, internal ram */
+  BW_VENC_OUT,
+  /* DMA2D or cpu overlay, frame and text strips in PSRAM, region redraws included */
+  BW_OVERLAY,
+  BW_MASTER_NB,
+} bw_master_t;
+
+/* Bytes per app_stats_bw_update() period, i.e. per frame handled by dp thread */
+typedef struct {
+  uint32_t last;
+  int total;
+  uint64_t acc;
+  float mean;
+} bw_stat_t;
+
+/* Interrupt handlers timed by app_stats_isr_enter() / app_stats_isr_exit(). They share one NVIC
+ * priority so none preempts another.
+ */
+typedef enum {
+  /* CSI and DCMIPP handlers */
+  ISR_CAMERA,
+  /* USB OTG HS handler, class work is deferred to uvcl irq thread */
+  ISR_USB,
+  ISR_DMA2D,
+  ISR_SRC_NB,
+} isr_src_t;
+
+typedef struct {
+  char name[TASK_STAT_NAME_LEN];
+  UBaseType_t priority;
+  /* % of run time over last period, interrupts that preempted the task included */
+  float load;
+  /* lowest free stack ever, in bytes */
+  uint32_t stack_free;
+  /* in bytes, 0 when task was not registered with app_stats_task_register() */
+  uint32_t stack_size;
+} task_stat_t;
+
+typedef struct {
+  /* % of cpu cycles over last period */
+  float load;
+  uint32_t nb;
+  uint32_t max_us;
+} isr_stat_t;
+
+/* Refreshed every TASK_STAT_PERIOD_MS by app_stats_task_update() */
+typedef struct {
+  uint32_t seq;
+  int task_nb;
+  task_stat_t task[TASK_STAT_MAX_NB];
+  isr_stat_t isr[ISR_SRC_NB];
+  uint32_t period_ms;
+} cpu_stat_t;
+
+/* Receives the dump text piece by piece */
+typedef void (*app_stats_out_t)(const char *str, void *arg);
+
+/* Each stat has a single writer thread and its own sequence counter: writers never wait and
+ * readers retry a stat when it changed while being copied.
+ */
 typedef struct {
   time_stat_t nn_total_time;
   time_stat_t nn_inference_time;
+  /* next output buffer preparation, overlapped with the inference */
+  time_stat_t nn_prepare_time;
+  /* NPU idle between two detector inferences, the wait for a camera frame excluded */
+  time_stat_t nn_idle_time;
   time_stat_t disp_total_time;
   time_stat_t nn_pp_time;
+  /* all ROIs of a frame */
+  time_stat_t nn_roi_time;
   time_stat_t disp_display_time;
   time_stat_t disp_enc_time;
+  time_stat_t glass_to_usb_time;
+  time_stat_t uvc_drain_time;
+  bitrate_stat_t venc_bitrate;
+  roi_stat_t roi;
+  cpu_stat_t cpu;
+  /* Sequence counter of the members below, kept last */
+  uint32_t bw_seq;
+  bw_stat_t bw[BW_MASTER_NB];
+  /* time covered by bw, so rates are acc / bw_elapsed_ms */
+  uint32_t bw_elapsed_ms;
 } stat_info_t;
 
 typedef struct {
@@ -56,8 +184,32 @@ typedef struct {
 void app_stats_init(void);
 stat_info_t *app_stats_state(void);
 void time_stat_update(time_stat_t *p_stat, int value);
+/* pct in [1, 100], result is the upper bound of the bucket holding the sample */
+uint32_t time_stat_percentile(const time_stat_t *p_stat, int pct);
+uint32_t time_stat_max(const time_stat_t *p_stat);
+void bitrate_stat_update(bitrate_stat_t *p_stat, const bitrate_stat_t *value);
+void roi_stat_update(roi_stat_t *p_stat, int run_nb, int skip_nb);
+/* Must not be called from a context that preempts stat writers */
 void stat_info_copy(stat_info_t *copy);
 void app_stats_cpuload_update(void);
 void app_stats_cpuload_get(float *cpu_load_last, float *cpu_load_last_second, float *cpu_load_last_five_seconds);
+/* Stack size is not known to the run time stats, stack_depth in words as given to xTaskCreateStatic() */
+void app_stats_task_register(TaskHandle_t hdl, uint32_t stack_depth);
+/* Samples per task run time and stack watermarks once per TASK_STAT_PERIOD_MS, from a single task */
+void app_stats_task_update(void);
+/* One JSON object per line with the last cpu_stat_t. Must not preempt app_stats_task_update() caller */
+void app_stats_cpu_dump(app_stats_out_t out, void *arg);
+/* Called first and last in the handler, returns the entry timestamp */
+uint32_t app_stats_isr_enter(void);
+void app_stats_isr_exit(isr_src_t src, uint32_t ts);
+const char *app_stats_isr_name(isr_src_t src);
+/* Each master is only counted from one context, ISR included */
+void app_stats_bw_add(bw_master_t master, uint32_t bytes);
+/* Fold bytes counted since previous call in stat_info_t, from a single task */
+void app_stats_bw_update(void);
+int app_stats_bw_is_psram(bw_master_t master);
+uint32_t app_stats_timestamp(void);
+uint32_t app_stats_elapsed_us(uint32_t ts);
+uint32_t app_stats_cycles_to_us(uint32_t cycles);
 
 #endif
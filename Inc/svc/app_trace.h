@@ -0,0 +1,67 @@
+/**
+ ******************************************************************************
+ * @file    app_trace.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SVC_APP_TRACE_H
+#define SVC_APP_TRACE_H
+
+#include <stdint.h>
+
+/* Pipeline events, each one is always recorded from the same context */
+typedef enum {
+  /* DCMIPP frame events, ISR */
+  TRACE_CAPTURE_DISPLAY,
+  TRACE_CAPTURE_NN,
+  /* isp thread */
+  TRACE_ISP_UPDATE,
+  /* nn thread */
+  TRACE_NN_INFERENCE,
+  TRACE_NN_SWITCH,
+  /* dp thread */
+  TRACE_NN_PP,
+  TRACE_NN_ROI,
+  TRACE_DISP_DISPLAY,
+  TRACE_DISP_ENC,
+  /* UVCL frame release callback */
+  TRACE_UVC_RELEASE,
+  TRACE_EVENT_NB,
+} trace_event_t;
+
+typedef enum {
+  TRACE_BEGIN,
+  TRACE_END,
+  TRACE_INSTANT,
+} trace_phase_t;
+
+/* Receives the dump text piece by piece */
+typedef void (*app_trace_out_t)(const char *str, void *arg);
+
+/* Ring holds last APP_TRACE_DEPTH events. app_trace_dump_request() dumps it on the console from a
+ * low priority task, as a Chrome trace event array, followed by app_stats_cpu_dump() line.
+ */
+void app_trace_init(void);
+/* Callable from any context, DWT cycle counter timestamp */
+void app_trace_record(trace_event_t event, trace_phase_t phase, uint32_t frame_id);
+void app_trace_dump_request(void);
+/* Recording is suspended while the ring is written to out */
+void app_trace_dump(app_trace_out_t out, void *arg);
+
+#define app_trace_begin(event, frame_id) app_trace_record(event, TRACE_BEGIN, frame_id)
+#define app_trace_end(event, frame_id) app_trace_record(event, TRACE_END, frame_id)
+#define app_trace_instant(event, frame_id) app_trace_record(event, TRACE_INSTANT, frame_id)
+
+#endif
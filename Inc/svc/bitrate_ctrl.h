@@ -0,0 +1,50 @@
+/**
+ ******************************************************************************
+ * @file    bitrate_ctrl.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#ifndef SVC_BITRATE_CTRL_H
+#define SVC_BITRATE_CTRL_H
+
+#include <stdint.h>
+
+/* Adapts encoder target to the USB link. Input is the time each frame takes to drain
+ * to the host, compared to the frame period: bitrate backs off multiplicatively when
+ * the link is near saturation or a frame had to be skipped, and recovers additively
+ * when it stays lightly loaded.
+ */
+typedef struct {
+  int bitrate_max;
+  int bitrate_min;
+  int bitrate;
+  /* To add to configured qp_min */
+  int qp_min_delta;
+  int fps;
+  int frame_period_us;
+  /* Drain time over frame period in per mille, averaged */
+  int load;
+  int frames_since_change;
+  int backoff_level;
+  uint32_t decrease_nb;
+  uint32_t increase_nb;
+} bitrate_ctrl_t;
+
+void bitrate_ctrl_init(bitrate_ctrl_t *p_ctrl, int bitrate_max, int fps);
+/* Return 1 when bitrate or qp_min_delta changed */
+int bitrate_ctrl_on_drain(bitrate_ctrl_t *p_ctrl, int drain_us);
+int bitrate_ctrl_on_skip(bitrate_ctrl_t *p_ctrl);
+
+#endif
@@ -19,28 +19,62 @@
 #ifndef SVC_BUFFER_QUEUE_H
 #define SVC_BUFFER_QUEUE_H
 
+#include <stdatomic.h>
 #include <stdint.h>
 
 #include "FreeRTOS.h"
 #include "semphr.h"
+#include "task.h"
 
-#define BQUEUE_MAX_BUFFERS 2
+#define BQUEUE_MAX_BUFFERS 8
+
+typedef enum {
+  BQUEUE_MODE_SEM,
+  BQUEUE_MODE_SPSC,
+} bqueue_mode_t;
+
+/* Per buffer frame metadata. Only the owner of a buffer may access its metadata */
+typedef struct {
+  uint32_t frame_id;
+  uint32_t ancillary_frame_id;
+  uint32_t capture_ts;
+  int32_t exposure;
+  int32_t gain;
+  /* nn_service handle of the model that produced an nn output */
+  int32_t nn_model;
+} bqueue_meta_t;
 
 typedef struct {
+  bqueue_mode_t mode;
+  /* BQUEUE_MODE_SEM */
   SemaphoreHandle_t free;
   StaticSemaphore_t free_buffer;
   SemaphoreHandle_t ready;
   StaticSemaphore_t ready_buffer;
+  /* BQUEUE_MODE_SPSC: each counter has a single writer, waiters are woken by task notification */
+  atomic_uint put_free_nb;
+  atomic_uint put_ready_nb;
+  uint32_t get_free_nb;
+  uint32_t get_ready_nb;
+  _Atomic(TaskHandle_t) producer;
+  _Atomic(TaskHandle_t) consumer;
   int buffer_nb;
   uint8_t *buffers[BQUEUE_MAX_BUFFERS];
+  bqueue_meta_t metas[BQUEUE_MAX_BUFFERS];
   int free_idx;
   int ready_idx;
 } bqueue_t;
 
 int bqueue_init(bqueue_t *bq, int buffer_nb, uint8_t **buffers);
+/* Single producer (task or ISR) / single consumer (task) ring without kernel objects. Its puts
+ * are task context only, an ISR producer uses bqueue_put_ready_from_isr().
+ */
+int bqueue_init_spsc(bqueue_t *bq, int buffer_nb, uint8_t **buffers);
 uint8_t *bqueue_get_free(bqueue_t *bq, int is_blocking);
 void bqueue_put_free(bqueue_t *bq);
 uint8_t *bqueue_get_ready(bqueue_t *bq);
 void bqueue_put_ready(bqueue_t *bq);
+void bqueue_put_ready_from_isr(bqueue_t *bq);
+bqueue_meta_t *bqueue_get_meta(bqueue_t *bq, uint8_t *buffer);
 
 #endif /* SVC_BUFFER_QUEUE_H */
@@ -22,13 +22,137 @@
 
 #include "fonts.h"
 
+typedef enum {
+  DRAW_FORMAT_ARGB8888,
+  /* Alpha only pixels, expanded with a fixed color by DMA2D */
+  DRAW_FORMAT_A8,
+  /* Same as A8 with two pixels per byte */
+  DRAW_FORMAT_A4,
+  /* List destination only: YUV420 semi-planar, chroma plane after luma. DMA2D can't write it,
+   * commands are blended by cpu as they are recorded.
+   */
+  DRAW_FORMAT_NV12,
+} DRAW_Format_t;
+
+/* Glyphs are stored as alpha only so DMA2D fetches 1 or 0.5 byte per pixel. Text is drawn with
+ * color over an optional bg_color box, no box when bg_color alpha is 0.
+ */
 typedef struct {
   uint16_t width;
   uint16_t height;
+  /* glyph line length in pixels, even for DRAW_FORMAT_A4 */
+  uint16_t stride;
+  DRAW_Format_t format;
+  uint32_t color;
+  uint32_t bg_color;
   uint8_t *data;
 } DRAW_Font_t;
 
+#define DRAW_LINE_CHAR_MAX 64
+#define DRAW_LIST_CMD_NB 96
+#define DRAW_LIST_TEXT_SIZE 2048
+#define DRAW_TEXT_CACHE_ENTRY_NB 24
+#define DRAW_TEXT_CACHE_ENTRY_SIZE (16 * 1024)
+
+/* Strings rendered once in a strip of the font format and blended in one transfer while they don't change */
+typedef struct {
+  DRAW_Font_t *p_font;
+  char text[DRAW_LINE_CHAR_MAX + 1];
+  int len;
+  uint32_t last_use;
+  /* bumped each time the strip is rendered, copies of the strip record it */
+  uint32_t rev;
+  uint8_t *p_strip;
+} DRAW_TextEntry_t;
+
+typedef struct {
+  DRAW_TextEntry_t entries[DRAW_TEXT_CACHE_ENTRY_NB];
+  uint32_t gen;
+  uint32_t hit_nb;
+  uint32_t miss_nb;
+} DRAW_TextCache_t;
+
+typedef enum {
+  DRAW_CMD_FILL,
+  DRAW_CMD_FILL_BLEND,
+  DRAW_CMD_COPY,
+  DRAW_CMD_TEXT,
+} DRAW_CmdType_t;
+
+typedef struct {
+  DRAW_CmdType_t type;
+  int16_t x_pos;
+  int16_t y_pos;
+  int16_t width;
+  int16_t height;
+  union {
+    uint32_t color;
+    struct {
+      uint8_t *p_src;
+      uint16_t stride;
+      uint16_t format;
+      uint32_t color;
+      /* text cache strip revision, so a region signature sees the text a reused strip holds */
+      uint32_t rev;
+    } copy;
+    struct {
+      DRAW_Font_t *p_font;
+      uint16_t pos;
+      uint16_t len;
+      uint32_t color;
+    } text;
+  };
+} DRAW_Cmd_t;
+
+/* Commands recorded for one destination buffer. They are queued to DMA2D while recording goes
+ * on, so the caller only waits once for the whole list, as late as it can.
+ */
+typedef struct {
+  uint8_t *p_dst;
+  int dst_width;
+  int dst_height;
+  DRAW_Format_t dst_format;
+  DRAW_TextCache_t *p_cache;
+  /* recorded positions are relative to dst, which sits at origin of the frame */
+  int x_origin;
+  int y_origin;
+  /* region list, commands are held until DRAW_RegionEnd() */
+  int is_deferred;
+  int is_sig_valid;
+  DRAW_Cmd_t cmds[DRAW_LIST_CMD_NB];
+  int cmd_nb;
+  char text[DRAW_LIST_TEXT_SIZE];
+  int text_len;
+  /* next transfer to queue */
+  int push_cmd;
+  int push_char;
+  uint32_t transfer_nb;
+  /* memory traffic of issued transfers, destination read and write included */
+  uint32_t byte_nb;
+  /* fal_dma2d fence of last queued transfer */
+  uint32_t fence;
+} DRAW_List_t;
+
+/* Part of the overlay rendered in its own ARGB8888 buffer, then blended on the frame in one
+ * transfer. Buffer is only redrawn when recorded commands differ from previous frame.
+ */
+typedef struct {
+  uint8_t *p_buf;
+  int buf_size;
+  int x_pos;
+  int y_pos;
+  int width;
+  int height;
+  uint32_t sig;
+  int is_valid;
+} DRAW_Region_t;
+
+/* Font is setup as DRAW_FORMAT_A8 white text over 25% black */
 int DRAW_FontSetup(sFONT *p_font_in, DRAW_Font_t *p_font);
+/* format is DRAW_FORMAT_A8 or DRAW_FORMAT_A4 */
+int DRAW_FontSetupFormat(sFONT *p_font_in, DRAW_Font_t *p_font, DRAW_Format_t format);
+/* color is RGB, bg_color is ARGB */
+void DRAW_FontSetColor(DRAW_Font_t *p_font, uint32_t color, uint32_t bg_color);
 void DRAW_RectArgbHw(uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos, int width, int height,
                      uint32_t color);
 void DRAW_FillArgbHw(uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos, int width, int height,
@@ -38,6 +162,42 @@ void DRAW_PrintfArgbHw(DRAW_Font_t *p_font, uint8_t *p_dst, int dst_width, int d
 void DRAW_CopyArgbHW(uint8_t *p_dst, int dst_width, int dst_height, uint8_t *p_src, int src_width, int src_height,
                      int x_offset, int y_offset);
 
+/* p_mem holds DRAW_TEXT_CACHE_ENTRY_NB strips of DRAW_TEXT_CACHE_ENTRY_SIZE bytes, 32 bytes aligned */
+void DRAW_TextCacheInit(DRAW_TextCache_t *p_cache, uint8_t *p_mem);
+
+/* A full list is queued on the fly so recording never fails. p_cache can be NULL. Strips of a
+ * cache are reused, so previous list using it must be complete.
+ */
+void DRAW_ListBegin(DRAW_List_t *p_list, uint8_t *p_dst, int dst_width, int dst_height, DRAW_TextCache_t *p_cache);
+/* dst_format is DRAW_FORMAT_ARGB8888 or DRAW_FORMAT_NV12, DRAW_ListBegin() uses DRAW_FORMAT_ARGB8888 */
+void DRAW_ListBeginFormat(DRAW_List_t *p_list, uint8_t *p_dst, int dst_width, int dst_height, DRAW_Format_t dst_format,
+                          DRAW_TextCache_t *p_cache);
+void DRAW_ListFill(DRAW_List_t *p_list, int x_pos, int y_pos, int width, int height, uint32_t color);
+void DRAW_ListRect(DRAW_List_t *p_list, int x_pos, int y_pos, int width, int height, uint32_t color);
+void DRAW_ListCopy(DRAW_List_t *p_list, uint8_t *p_src, int src_width, int src_height, int x_offset, int y_offset);
+void DRAW_ListPrintf(DRAW_List_t *p_list, DRAW_Font_t *p_font, int x_pos, int y_pos, const char * format, ...);
+/* Queue remaining commands, without waiting for them */
+void DRAW_ListSubmit(DRAW_List_t *p_list);
+/* Wait for queued commands. Returns the number of DMA2D transfers (cpu blends for DRAW_FORMAT_NV12)
+ * issued since DRAW_ListBegin()
+ */
+uint32_t DRAW_ListWait(DRAW_List_t *p_list);
+/* DRAW_ListSubmit() then DRAW_ListWait() */
+uint32_t DRAW_ListExec(DRAW_List_t *p_list);
+/* Blend region buffer on list destination */
+void DRAW_ListRegion(DRAW_List_t *p_list, DRAW_Region_t *p_region);
+
+/* p_buf and buf_size are 32 bytes aligned */
+void DRAW_RegionInit(DRAW_Region_t *p_region, uint8_t *p_buf, int buf_size);
+/* Record region content in p_list with frame coordinates, commands outside region are dropped.
+ * Text cache is shared with the frame list, which must begin first. Returns -1 if buffer is
+ * too small.
+ */
+int DRAW_RegionBegin(DRAW_Region_t *p_region, DRAW_List_t *p_list, DRAW_TextCache_t *p_cache, int x_pos, int y_pos,
+                     int width, int height);
+/* Queue region redraw if content changed. Returns 1 when it is redrawn */
+int DRAW_RegionEnd(DRAW_Region_t *p_region, DRAW_List_t *p_list);
+
 /* Implement this if you are using Hw family API */
 void DRAW_HwLock(void *dma2d_handle);
 void DRAW_HwUnlock(void);
@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ * @file    nn_cascade.h
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#ifndef NN_CASCADE_H
+#define NN_CASCADE_H
+
+#include <stdint.h>
+
+#include "svc/nn_service.h"
+#include "od_pp_output_if.h"
+
+/* Second stage model run on each detection ROI. Its input is RGB888, width x height. The same
+ * input and output buffers are reused for every ROI.
+ */
+typedef struct {
+  nn_service_handle_t model;
+  int width;
+  int height;
+  uint8_t *input;
+  uint8_t *output;
+  /* Time given to ROIs per frame, crop included */
+  uint32_t budget_us;
+  /* ROIs considered per frame, 0 for no limit */
+  int roi_max;
+} nn_cascade_conf_t;
+
+typedef struct {
+  nn_cascade_conf_t conf;
+  /* Running estimate of a ROI cost, 0 until the first one ran */
+  uint32_t roi_cost_us;
+} nn_cascade_t;
+
+/* Frame detections are relative to, in the capture format */
+typedef struct {
+  const uint8_t *buffer;
+  int width;
+  int height;
+} nn_cascade_frame_t;
+
+typedef struct {
+  int run_nb;
+  int skip_nb;
+} nn_cascade_res_t;
+
+int nn_cascade_init(nn_cascade_t *ctx, const nn_cascade_conf_t *conf);
+/* Detections are visited by decreasing confidence. A ROI only runs when its estimated cost still
+ * fits the budget, the remaining ones are skipped. class_index of a ROI that ran becomes the
+ * second stage top class, skipped ones keep the detector class.
+ */
+int nn_cascade_run(nn_cascade_t *ctx, const nn_cascade_frame_t *frame, od_pp_outBuffer_t *dets, int det_nb,
+                   nn_cascade_res_t *res);
+
+#endif
@@ -36,13 +36,35 @@ typedef enum
   NN_SERVICE_ERR_FULL = -3,
   NN_SERVICE_ERR_NO_BUFFERS = -4,
   NN_SERVICE_ERR_IO = -5,
+  NN_SERVICE_ERR_BUSY = -6,
+  NN_SERVICE_ERR_RELOC = -7,
 } nn_service_status_t;
 
+/* Relocatable model binary (stedgeai --reloc) and the RAM it is installed into. Only used when the
+ * runtime is built with LL_ATON_RT_RELOC.
+ */
+typedef struct
+{
+  uintptr_t file;
+  /* code and data are copied there, 8 bytes aligned */
+  uint8_t *exec_ram;
+  uint32_t exec_ram_size;
+  /* external memory pool of the model, if it requests one */
+  uint8_t *ext_ram;
+  uint32_t ext_ram_size;
+} nn_service_reloc_cfg_t;
+
 typedef struct
 {
   const char *name;
+  /* installed by nn_service_register() when reloc is set, it must not be declared with a network */
   NN_Instance_TypeDef *instance;
+  const nn_service_reloc_cfg_t *reloc;
   uint32_t postprocess_type;
+  /* NPU arbitration, see nn_service_run() */
+  int priority;
+  /* relative to nn_service_run() call, 0 for none */
+  uint32_t deadline_us;
 } nn_service_model_cfg_t;
 
 typedef struct
@@ -55,15 +77,54 @@ typedef struct
   uint32_t user_input_count;
   uint32_t user_output_count;
   uint32_t postprocess_type;
+  int priority;
+  uint32_t deadline_us;
   uint8_t is_initialized;
+  uint8_t is_reloc;
+  /* ll_aton_reloc_install() duration, 0 for a statically linked model */
+  uint32_t install_us;
+  /* epoch block boundaries where the model handed the NPU over to another one */
+  uint32_t preempt_nb;
+  /* LL_ATON_RT_Init_Network() duration, 0 until initialized */
+  uint32_t init_us;
+  /* last nn_service_select() of this model, init included when it was not done yet */
+  uint32_t switch_us;
+  uint32_t select_nb;
 } nn_service_model_t;
 
 nn_service_status_t nn_service_init(void);
+/* A relocatable model is installed first, NN_SERVICE_ERR_RELOC when the binary is not valid or does
+ * not fit in the given RAM, the caller can then fall back to a statically linked model.
+ */
 nn_service_status_t nn_service_register(const nn_service_model_cfg_t *cfg, nn_service_handle_t *out_handle);
+/* Initializes every registered model not initialized yet, so that selecting one later costs no
+ * LL_ATON_RT_Init_Network(). Call once all models are registered, before inferences start.
+ */
+nn_service_status_t nn_service_preinit(void);
 nn_service_status_t nn_service_select(nn_service_handle_t handle);
+/* Expected nn_service_select() duration, i.e. the last measured one. UINT32_MAX while the model is
+ * not initialized, as its init cost is not known yet.
+ */
+uint32_t nn_service_switch_cost_us(nn_service_handle_t handle);
 const nn_service_model_t *nn_service_active(void);
 const nn_service_model_t *nn_service_get(nn_service_handle_t handle);
 nn_service_status_t nn_service_prepare_io(uint8_t *input, uint32_t input_len, uint8_t *output, uint32_t output_len);
+/* Sets the model user buffers and runs one inference, blocking the caller until it is done. Models
+ * run from different tasks share the NPU at epoch block boundaries: the highest priority waiting
+ * model gets it, then the earliest deadline, and a running model only hands it over to a better
+ * ranked one. A model can only run from one task at a time.
+ */
+nn_service_status_t nn_service_run(nn_service_handle_t handle, uint8_t *input, uint32_t input_len, uint8_t *output,
+                                   uint32_t output_len);
+/* nn_service_run() in two halves. Start returns once the first epoch block is in flight, so the caller
+ * can prepare its next frame while the NPU works, then wait runs the remaining blocks. Start blocks
+ * while another model holds the NPU, but never hands it over once granted; wait can. The next block
+ * only starts in wait: keep the work in between shorter than a block, and run no other inference from
+ * the same task meanwhile.
+ */
+nn_service_status_t nn_service_run_start(nn_service_handle_t handle, uint8_t *input, uint32_t input_len,
+                                         uint8_t *output, uint32_t output_len);
+nn_service_status_t nn_service_run_wait(nn_service_handle_t handle);
 uint32_t nn_service_max_input_size(void);
 uint32_t nn_service_max_output_size(void);
 uint32_t nn_service_count(void);
@@ -703,6 +703,28 @@ int32_t CMW_CAMERA_GetSensorInfo(ISP_SensorInfoTypeDef *info)
   return CMW_ERROR_NONE;
 }
 
+/**
+  * @brief  Get the ISP handle of the connected sensor.
+  * @note   Gives access to the ISP frame counters
+  * @retval ISP handle or NULL if the connected sensor has no ISP
+  */
+ISP_HandleTypeDef *CMW_CAMERA_GetIspHandle(void)
+{
+  switch (connected_sensor)
+  {
+#if defined(USE_IMX335_SENSOR)
+    case CMW_IMX335_Sensor:
+      return &camera_bsp.imx335_bsp.hIsp;
+#endif
+#if defined(USE_VD66GY_SENSOR)
+    case CMW_VD66GY_Sensor:
+      return &camera_bsp.vd66gy_bsp.hIsp;
+#endif
+    default:
+      return NULL;
+  }
+}
+
 
 
 int32_t CMW_CAMERA_Run()
@@ -179,6 +179,7 @@ int32_t CMW_CAMERA_SetTestPattern(int32_t mode);
 int32_t CMW_CAMERA_GetTestPattern(int32_t *mode);
 
 int32_t CMW_CAMERA_GetSensorInfo(ISP_SensorInfoTypeDef *info);
+ISP_HandleTypeDef *CMW_CAMERA_GetIspHandle(void);
 
 HAL_StatusTypeDef MX_DCMIPP_ClockConfig(DCMIPP_HandleTypeDef *hdcmipp);
 
@@ -52,6 +52,17 @@ typedef struct {
   int is_immediate_mode;
 } UVCL_Conf_t;
 
+/* Progress of a frame handed over before being fully produced. The producer grows
+ * frame_size and sets is_complete once frame_size is final. A producer that can't finish
+ * the frame sets is_error before is_complete: the rest of the frame is not sent, the host
+ * sees it flagged with the payload header error bit, and the frame is released.
+ */
+typedef struct {
+  volatile int frame_size;
+  volatile int is_complete;
+  volatile int is_error;
+} UVCL_FrameProgress_t;
+
 typedef struct uvcl_callbacks {
   void (*streaming_active)(struct uvcl_callbacks *cbs, UVCL_StreamConf_t stream);
   void (*streaming_inactive)(struct uvcl_callbacks *cbs);
@@ -65,5 +76,9 @@ int UVCL_Deinit(void);
 void UVCL_IRQHandler(void);
 /* return 0 if frame will be displayed. else it won't be displayed */
 int UVCL_ShowFrame(void *frame, int frame_size);
+/* Same as UVCL_ShowFrame() but transmission starts while frame is still produced.
+ * progress must stay valid until frame is released.
+ */
+int UVCL_ShowFrameProgressive(void *frame, UVCL_FrameProgress_t *progress);
 
 #endif
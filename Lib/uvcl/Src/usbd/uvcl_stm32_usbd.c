@@ -194,8 +194,7 @@ static uint8_t USB_DISP_DataInImpl(USBD_HandleTypeDef *p_dev, int is_incomplete)
 
   /* Send next frame packet */
   on_fly_ctx = p_ctx->on_fly_ctx;
-  //printf("S %d\n", on_fly_ctx->packet_index);
-  len = on_fly_ctx->packet_index == (on_fly_ctx->packet_nb - 1) ? on_fly_ctx->last_packet_size + 2 : packet_size;
+  len = UVCL_GetOnFlyCtxPacketLen(p_ctx, packet_size);
   memcpy(&p_ctx->packet[2], on_fly_ctx->cursor, len - 2);
   USBD_LL_Transmit(p_dev, 0x81, p_ctx->packet, len);
 
@@ -103,8 +103,7 @@ static void UVCL_DataIn(struct UX_DEVICE_CLASS_VIDEO_STREAM_STRUCT *stream)
 
   /* Send next frame packet */
   on_fly_ctx = p_ctx->on_fly_ctx;
-  //printf("S %d\n", on_fly_ctx->packet_index);
-  len = on_fly_ctx->packet_index == (on_fly_ctx->packet_nb - 1) ? on_fly_ctx->last_packet_size + 2 : packet_size;
+  len = UVCL_GetOnFlyCtxPacketLen(p_ctx, packet_size);
   memcpy(&p_ctx->packet[2], on_fly_ctx->cursor, len - 2);
   UVCL_SendPacket(p_ctx, stream, len);
 
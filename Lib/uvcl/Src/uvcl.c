@@ -68,19 +68,31 @@ static int UVCL_FpsOk(UVCL_Ctx_t *p_ctx)
   return 0;
 }
 
+static void UVCL_RefreshProgress(UVCL_OnFlyCtx_t *on_fly_ctx)
+{
+  UVCL_FrameProgress_t *progress = on_fly_ctx->progress;
+
+  /* is_complete is read first so the size and error read after it are the final ones */
+  on_fly_ctx->is_complete = progress->is_complete;
+  __DMB();
+  on_fly_ctx->frame_size = progress->frame_size;
+  on_fly_ctx->is_error = on_fly_ctx->is_complete && progress->is_error;
+}
+
 static void UVCL_FillSentData(UVCL_Ctx_t *p_ctx, UVCL_OnFlyCtx_t *on_fly_ctx, uint8_t *p_frame, int fsize,
-                             int packet_size)
+                             UVCL_FrameProgress_t *progress)
 {
-  on_fly_ctx->packet_nb = (fsize + packet_size - 1) / (packet_size - 2);
-  on_fly_ctx->last_packet_size = fsize % (packet_size - 2);
-  if (!on_fly_ctx->last_packet_size)
-  {
-    on_fly_ctx->packet_nb--;
-    on_fly_ctx->last_packet_size = packet_size - 2;
-  }
+  on_fly_ctx->frame_size = fsize;
+  on_fly_ctx->sent = 0;
+  on_fly_ctx->is_complete = 1;
+  on_fly_ctx->is_error = 0;
+  on_fly_ctx->progress = progress;
+  if (progress)
+    UVCL_RefreshProgress(on_fly_ctx);
   on_fly_ctx->p_frame = p_frame;
   on_fly_ctx->cursor = p_frame;
-  p_ctx->packet[1] ^= 1;
+  p_ctx->packet[1] &= ~UVC_PAYLOAD_HEADER_ERR;
+  p_ctx->packet[1] ^= UVC_PAYLOAD_HEADER_FID;
 
   p_ctx->is_starting = 0;
   p_ctx->frame_start = HAL_GetTick();
@@ -91,7 +103,7 @@ static UVCL_OnFlyCtx_t *UVCL_StartSelectedRaw(UVCL_Ctx_t *p_ctx, int packet_size
   UVCL_OnFlyCtx_t *on_fly_ctx = &p_ctx->on_fly_storage_ctx;
 
   on_fly_ctx->frame_index = -1;
-  UVCL_FillSentData(p_ctx, on_fly_ctx, p_ctx->p_frame, p_ctx->frame_size, packet_size);
+  UVCL_FillSentData(p_ctx, on_fly_ctx, p_ctx->p_frame, p_ctx->frame_size, p_ctx->p_progress);
 
   __DMB();
   p_ctx->p_frame = NULL;
@@ -464,17 +476,39 @@ int UVCL_handle_setup_request(UVCL_Ctx_t *p_ctx, UVCL_SetupReq_t *req)
   return ret;
 }
 
+/* Header only packets are sent while a progressive frame waits for more data. An aborted
+ * one ends with a header only packet carrying the error bit.
+ */
+int UVCL_GetOnFlyCtxPacketLen(UVCL_Ctx_t *p_ctx, int packet_size)
+{
+  UVCL_OnFlyCtx_t *on_fly_ctx = p_ctx->on_fly_ctx;
+  int remaining;
+
+  assert(on_fly_ctx);
+
+  if (!on_fly_ctx->is_complete)
+    UVCL_RefreshProgress(on_fly_ctx);
+  if (on_fly_ctx->is_error) {
+    p_ctx->packet[1] |= UVC_PAYLOAD_HEADER_ERR;
+    return 2;
+  }
+
+  remaining = on_fly_ctx->frame_size - on_fly_ctx->sent;
+
+  return 2 + (remaining < packet_size - 2 ? remaining : packet_size - 2);
+}
+
 void UVCL_UpdateOnFlyCtx(UVCL_Ctx_t *p_ctx, int len)
 {
   UVCL_OnFlyCtx_t *on_fly_ctx = p_ctx->on_fly_ctx;
 
   assert(on_fly_ctx);
 
-  on_fly_ctx->packet_index = (on_fly_ctx->packet_index + 1) % on_fly_ctx->packet_nb;
   on_fly_ctx->cursor += len - 2;
+  on_fly_ctx->sent += len - 2;
   on_fly_ctx->prev_len = len;
 
-  if (on_fly_ctx->packet_index)
+  if (!on_fly_ctx->is_error && (!on_fly_ctx->is_complete || on_fly_ctx->sent < on_fly_ctx->frame_size))
     return ;
 
   /* Once displayed we can make frame free */
@@ -634,6 +668,33 @@ int UVCL_ShowFrame(void *frame, int frame_size)
     return -1;
 
   p_ctx->frame_size = frame_size;
+  p_ctx->p_progress = NULL;
+  __DMB();
+  p_ctx->p_frame = frame;
+
+  if (p_ctx->state == UVCL_STATUS_STOP) {
+    p_ctx->p_frame = NULL;
+    return -1;
+  }
+
+  return 0;
+}
+
+int UVCL_ShowFrameProgressive(void *frame, UVCL_FrameProgress_t *progress)
+{
+  UVCL_Ctx_t *p_ctx = p_ctx_single;
+
+  if (p_ctx->state != UVCL_STATUS_STREAMING)
+    return -1;
+  if (p_ctx->p_frame)
+    return -1;
+  if (!frame)
+    return -1;
+  if (!progress)
+    return -1;
+
+  p_ctx->frame_size = 0;
+  p_ctx->p_progress = progress;
   __DMB();
   p_ctx->p_frame = frame;
 
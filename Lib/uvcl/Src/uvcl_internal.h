@@ -44,6 +44,10 @@
 #define UVC_ISO_FS_MPS                                  1023
 #define UVC_ISO_HS_MPS                                  (USBL_PACKET_PER_MICRO_FRAME * 1024)
 
+/* Payload header bmHeaderInfo bits */
+#define UVC_PAYLOAD_HEADER_FID                          0x01U
+#define UVC_PAYLOAD_HEADER_ERR                          0x40U
+
 #define USB_REQ_TYPE_STANDARD                          0x00U
 #define USB_REQ_TYPE_CLASS                             0x20U
 #define USB_REQ_TYPE_VENDOR                            0x40U
@@ -136,11 +140,14 @@ typedef struct {
 typedef struct {
   int frame_index;
   uint8_t *cursor;
-  int packet_nb;
-  int packet_index;
-  int last_packet_size;
+  int frame_size;
+  int sent;
+  int is_complete;
+  int is_error;
   int prev_len;
   uint8_t *p_frame;
+  /* Only for frames still being produced */
+  UVCL_FrameProgress_t *progress;
 } UVCL_OnFlyCtx_t;
 
 typedef struct {
@@ -160,6 +167,7 @@ typedef struct {
   int is_starting;
   uint8_t *p_frame;
   int frame_size;
+  UVCL_FrameProgress_t *p_progress;
   UVCL_OnFlyCtx_t on_fly_storage_ctx;
   UVCL_OnFlyCtx_t *on_fly_ctx;
   UVC_VideoControlTypeDef UVC_VideoCommitControl;
@@ -169,6 +177,7 @@ typedef struct {
 } UVCL_Ctx_t;
 
 UVCL_OnFlyCtx_t *UVCL_StartNewFrameTransmission(UVCL_Ctx_t *p_ctx, int packet_size);
+int UVCL_GetOnFlyCtxPacketLen(UVCL_Ctx_t *p_ctx, int packet_size);
 void UVCL_UpdateOnFlyCtx(UVCL_Ctx_t *p_ctx, int len);
 void UVCL_AbortOnFlyCtx(UVCL_Ctx_t *p_ctx);
 int UVCL_handle_setup_request(UVCL_Ctx_t *p_ctx, UVCL_SetupReq_t *req);
@@ -23,10 +23,38 @@
 
 #include "app/app_config.h"
 #include "app/app_pipeline.h"
+#include "utils.h"
 #include "svc/app_display.h"
 #include "svc/app_stats.h"
+#include "svc/app_trace.h"
 #include "stm32n6570_discovery.h"
 
+static const int uvc_stream_dividers[][2] = UVC_STREAM_DIVIDERS;
+
+static void app_uvc_streams_add(UVCL_Conf_t *uvcl_conf, int payload_type)
+{
+  UVCL_StreamConf_t *stream;
+  int i;
+
+  assert(uvcl_conf->streams_nb + ARRAY_NB(uvc_stream_dividers) <= UVCL_MAX_STREAM_CONF_NB);
+  for (i = 0; i < ARRAY_NB(uvc_stream_dividers); i++) {
+    stream = &uvcl_conf->streams[uvcl_conf->streams_nb++];
+    /* Keep width a multiple of 16 for encoder and pipe pitch */
+    stream->width = (VENC_WIDTH / uvc_stream_dividers[i][0]) & ~15;
+    stream->height = (VENC_HEIGHT / uvc_stream_dividers[i][0]) & ~1;
+    stream->fps = CAMERA_FPS / uvc_stream_dividers[i][1];
+    stream->payload_type = payload_type;
+  }
+}
+
+static void app_uvc_streams_init(UVCL_Conf_t *uvcl_conf)
+{
+  uvcl_conf->streams_nb = 0;
+  app_uvc_streams_add(uvcl_conf, UVCL_PAYLOAD_FB_H264);
+  if (UVC_STREAM_MJPEG)
+    app_uvc_streams_add(uvcl_conf, UVCL_PAYLOAD_FB_JPEG);
+}
+
 void app_run(void)
 {
   UVCL_Conf_t uvcl_conf = { 0 };
@@ -35,25 +63,33 @@ void app_run(void)
 
   printf("Init application\n");
   CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 
   ret = BSP_PB_Init(BUTTON_USER1, BUTTON_MODE_GPIO);
   assert(ret == BSP_ERROR_NONE);
+#if APP_NN_ALT_MODEL
+  ret = BSP_PB_Init(BUTTON_USER2, BUTTON_MODE_GPIO);
+  assert(ret == BSP_ERROR_NONE);
+#endif
 
   app_stats_init();
+  app_trace_init();
   app_display_init();
   app_pipeline_init();
 
   CAM_Init();
 
+  enc_conf.codec = ENC_CODEC_H264;
   enc_conf.width = VENC_WIDTH;
   enc_conf.height = VENC_HEIGHT;
   enc_conf.fps = CAMERA_FPS;
+  enc_conf.input = CAPTURE_YUV420SP ? ENC_INPUT_NV12 : ENC_INPUT_ARGB8888;
+  enc_conf.slice_rows = VENC_SLICE_ROWS;
+  enc_conf.rate_ctrl.mode = VENC_RATE_CTRL_MODE;
+  enc_conf.rate_ctrl.bitrate = VENC_BITRATE;
+  enc_conf.jpeg_qlevel = VENC_JPEG_QLEVEL;
 
-  uvcl_conf.streams[0].width = VENC_WIDTH;
-  uvcl_conf.streams[0].height = VENC_HEIGHT;
-  uvcl_conf.streams[0].fps = CAMERA_FPS;
-  uvcl_conf.streams[0].payload_type = UVCL_PAYLOAD_FB_H264;
-  uvcl_conf.streams_nb = 1;
+  app_uvc_streams_init(&uvcl_conf);
   uvcl_conf.is_immediate_mode = 1;
 
   ret = app_display_setup(&enc_conf, &uvcl_conf);
@@ -29,10 +29,13 @@
 #include "fal/fal_camera.h"
 #include "svc/app_display.h"
 #include "svc/app_stats.h"
+#include "svc/app_trace.h"
 #include "svc/buffer_queue.h"
+#include "svc/nn_cascade.h"
 #include "svc/nn_service.h"
 #include "isp_api.h"
 #include "network.h"
+#include "stm32n6570_discovery.h"
 #include "stm32n6xx_hal.h"
 #include "utils.h"
 #include "FreeRTOS.h"
@@ -53,18 +56,38 @@
 #define NN_OUTPUT_BUFFER_SIZE_ALIGN ALIGN_VALUE(NN_OUTPUT_BUFFER_SIZE, 32)
 
 /* capture buffers */
-static uint8_t capture_buffer[CAPTURE_BUFFER_NB][VENC_MAX_WIDTH * VENC_MAX_HEIGHT * CAPTURE_BPP] ALIGN_32 IN_PSRAM;
+static uint8_t capture_buffer[CAPTURE_BUFFER_NB][CAPTURE_FRAME_SIZE(VENC_MAX_WIDTH, VENC_MAX_HEIGHT)] ALIGN_32 IN_PSRAM;
 static int capture_buffer_disp_idx = 1;
 static int capture_buffer_capt_idx = 0;
+static bqueue_meta_t capture_meta[CAPTURE_BUFFER_NB];
 
 /* model */
 LL_ATON_DECLARE_NAMED_NN_INSTANCE_AND_INTERFACE(Default);
-static uint8_t nn_input_buffers[2][NN_INPUT_BUFFER_SIZE] ALIGN_32 IN_PSRAM;
+static uint8_t nn_input_buffers[NN_INPUT_BUFFER_NB][NN_INPUT_BUFFER_SIZE] ALIGN_32 IN_PSRAM;
 static bqueue_t nn_input_queue;
-static uint8_t nn_output_buffers[2][NN_OUTPUT_BUFFER_SIZE_ALIGN] ALIGN_32;
+static uint8_t *nn_pipe_dst;
+static uint8_t nn_output_buffers[NN_OUTPUT_BUFFER_NB][NN_OUTPUT_BUFFER_SIZE_ALIGN] ALIGN_32;
 static bqueue_t nn_output_queue;
 static nn_service_handle_t nn_model_handle = NN_SERVICE_INVALID_HANDLE;
 static const nn_service_model_t *nn_model;
+#if APP_NN_RELOC
+/* network is set by ll_aton_reloc_install() */
+static NN_Instance_TypeDef NN_Instance_Reloc;
+static uint8_t nn_reloc_exec_ram[NN_RELOC_EXEC_RAM_SIZE] ALIGN_32 IN_PSRAM;
+static uint8_t nn_reloc_ext_ram[NN_RELOC_EXT_RAM_SIZE] ALIGN_32 IN_PSRAM;
+#endif
+#if APP_NN_ALT_MODEL
+LL_ATON_DECLARE_NAMED_NN_INSTANCE_AND_INTERFACE(Alt);
+#endif
+/* Detector models, nn_model_request indexes it */
+static nn_service_handle_t nn_model_handles[1 + APP_NN_ALT_MODEL];
+static volatile int nn_model_request;
+#if APP_NN_CASCADE
+LL_ATON_DECLARE_NAMED_NN_INSTANCE_AND_INTERFACE(Roi);
+static uint8_t nn_roi_input_buffer[NN_ROI_WIDTH * NN_ROI_HEIGHT * 3] ALIGN_32;
+static uint8_t nn_roi_output_buffer[NN_ROI_OUTPUT_SIZE] ALIGN_32;
+static nn_cascade_t nn_cascade;
+#endif
 
 /* tasks */
 static StaticTask_t nn_thread;
@@ -76,12 +99,43 @@ static StackType_t isp_thread_stack[2 *configMINIMAL_STACK_SIZE];
 static SemaphoreHandle_t isp_sem;
 static StaticSemaphore_t isp_sem_buffer;
 
+/* Called on frame end, before the next vsync bumps the ISP frame ids */
+static void app_frame_meta_fill(bqueue_meta_t *meta)
+{
+  meta->frame_id = CAM_GetFrameId(DCMIPP_PIPE1);
+  meta->ancillary_frame_id = CAM_GetFrameId(DCMIPP_PIPE2);
+  meta->capture_ts = app_stats_timestamp();
+  CAM_GetSensorState(&meta->exposure, &meta->gain);
+}
+
+/* Pick the capture buffer holding the frame the inference ran on. Fall back on
+ * the CAPTURE_DELAY buffer when the frame has already been overwritten.
+ */
+static int app_capture_buffer_select(uint32_t frame_id)
+{
+  int capt_idx = capture_buffer_capt_idx;
+  int i;
+
+  if (!frame_id)
+    return capture_buffer_disp_idx;
+
+  for (i = 0; i < CAPTURE_BUFFER_NB; i++) {
+    if (i != capt_idx && capture_meta[i].frame_id == frame_id)
+      return i;
+  }
+
+  return capture_buffer_disp_idx;
+}
+
 static void app_main_pipe_frame_event(void)
 {
   int next_disp_idx = (capture_buffer_disp_idx + 1) % CAPTURE_BUFFER_NB;
   int next_capt_idx = (capture_buffer_capt_idx + 1) % CAPTURE_BUFFER_NB;
   int ret;
 
+  app_stats_bw_add(BW_CAPTURE_DISPLAY, CAPTURE_FRAME_SIZE(VENC_WIDTH, VENC_HEIGHT));
+  app_frame_meta_fill(&capture_meta[capture_buffer_capt_idx]);
+  app_trace_instant(TRACE_CAPTURE_DISPLAY, capture_meta[capture_buffer_capt_idx].frame_id);
   ret = CAM_DisplayPipe_UpdateAddress(capture_buffer[next_capt_idx]);
   assert(ret == 0);
 
@@ -94,11 +148,16 @@ static void app_ancillary_pipe_frame_event(void)
   uint8_t *next_buffer;
   int ret;
 
+  /* Pipe keeps writing current buffer when there is no free one */
+  app_stats_bw_add(BW_CAPTURE_NN, NN_INPUT_BUFFER_SIZE);
+  app_trace_instant(TRACE_CAPTURE_NN, CAM_GetFrameId(DCMIPP_PIPE1));
   next_buffer = bqueue_get_free(&nn_input_queue, 0);
   if (next_buffer) {
     ret = CAM_NNPipe_UpdateAddress(next_buffer);
     assert(ret == 0);
-    bqueue_put_ready(&nn_input_queue);
+    app_frame_meta_fill(bqueue_get_meta(&nn_input_queue, nn_pipe_dst));
+    bqueue_put_ready_from_isr(&nn_input_queue);
+    nn_pipe_dst = next_buffer;
   }
 }
 
@@ -112,15 +171,48 @@ static void app_main_pipe_vsync_event(void)
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
+#if APP_NN_ALT_MODEL
+/* USER2 toggles detector models */
+static void app_model_button_update(void)
+{
+  static int prev_button_state = GPIO_PIN_RESET;
+  int cur_button_state;
+
+  cur_button_state = BSP_PB_GetState(BUTTON_USER2);
+  if (cur_button_state == GPIO_PIN_SET && prev_button_state == GPIO_PIN_RESET)
+    app_pipeline_model_request((nn_model_request + 1) % app_pipeline_model_nb());
+  prev_button_state = cur_button_state;
+}
+#endif
+
+/* Output buffer the next inference writes, owned by the nn thread until put ready. It is invalidated
+ * for any model, as one may be selected in between.
+ */
+static uint8_t *nn_output_prepare(int is_blocking)
+{
+  uint8_t *output_buffer;
+
+  output_buffer = bqueue_get_free(&nn_output_queue, is_blocking);
+  if (output_buffer)
+    FAL_CacheInvalidate(output_buffer, sizeof(nn_output_buffers[0]));
+
+  return output_buffer;
+}
+
+/* Three stages: while the NPU runs frame N, this thread prepares the output of frame N + 1 and the dp
+ * thread postprocesses frame N - 1. The NPU then only idles on camera frames.
+ */
 static void nn_thread_fct(void *arg)
 {
   stat_info_t *stats = app_stats_state();
+  uint8_t *output_next;
   uint32_t nn_period_ms;
   uint32_t nn_period[2];
-  uint8_t *nn_pipe_dst;
   uint32_t nn_out_len;
   uint32_t nn_in_len;
+  uint32_t input_wait_us;
   uint32_t total_ts;
+  uint32_t done_ts;
   uint32_t ts;
   int ret;
 
@@ -135,32 +227,65 @@ static void nn_thread_fct(void *arg)
   nn_pipe_dst = bqueue_get_free(&nn_input_queue, 0);
   assert(nn_pipe_dst);
   CAM_NNPipe_Start(nn_pipe_dst, CMW_MODE_CONTINUOUS);
+  output_next = nn_output_prepare(1);
+  done_ts = 0;
   while (1)
   {
     uint8_t *capture_buffer_local;
     uint8_t *output_buffer;
+    bqueue_meta_t *meta;
 
     nn_period[0] = nn_period[1];
     nn_period[1] = HAL_GetTick();
     nn_period_ms = nn_period[1] - nn_period[0];
 
+    /* Models are initialized at boot, a switch costs no more than a frame boundary */
+    if (nn_model_handles[nn_model_request] != nn_model_handle) {
+      nn_model_handle = nn_model_handles[nn_model_request];
+      ret = nn_service_select(nn_model_handle);
+      assert(ret == NN_SERVICE_OK);
+      nn_model = nn_service_active();
+      nn_in_len = nn_model->user_input_size;
+      nn_out_len = nn_model->user_output_size;
+      app_trace_instant(TRACE_NN_SWITCH, CAM_GetFrameId(DCMIPP_PIPE2));
+    }
+
+    ts = app_stats_timestamp();
     capture_buffer_local = bqueue_get_ready(&nn_input_queue);
     assert(capture_buffer_local);
-    output_buffer = bqueue_get_free(&nn_output_queue, 1);
-    assert(output_buffer);
+    input_wait_us = app_stats_elapsed_us(ts);
+    /* dp thread was still holding every buffer when the previous inference ran */
+    if (!output_next)
+      output_next = nn_output_prepare(1);
+    output_buffer = output_next;
+    meta = bqueue_get_meta(&nn_input_queue, capture_buffer_local);
+    *bqueue_get_meta(&nn_output_queue, output_buffer) = *meta;
+    bqueue_get_meta(&nn_output_queue, output_buffer)->nn_model = nn_model_handle;
+
+    total_ts = app_stats_timestamp();
+    app_trace_begin(TRACE_NN_INFERENCE, meta->frame_id);
+    ret = nn_service_run_start(nn_model_handle, capture_buffer_local, nn_in_len, output_buffer, nn_out_len);
+    assert(ret == NN_SERVICE_OK);
+    if (done_ts)
+      time_stat_update(&stats->nn_idle_time, app_stats_elapsed_us(done_ts) - input_wait_us);
 
-    total_ts = HAL_GetTick();
-    ts = HAL_GetTick();
-    FAL_CacheInvalidate(output_buffer, nn_out_len);
-    ret = nn_service_prepare_io(capture_buffer_local, nn_in_len, output_buffer, nn_out_len);
+    /* Never block here, the NPU would stall at the next block boundary */
+    ts = app_stats_timestamp();
+    output_next = nn_output_prepare(0);
+    time_stat_update(&stats->nn_prepare_time, app_stats_elapsed_us(ts));
+
+    ret = nn_service_run_wait(nn_model_handle);
     assert(ret == NN_SERVICE_OK);
-    Run_Inference(nn_model->instance);
-    time_stat_update(&stats->nn_inference_time, HAL_GetTick() - ts);
+    done_ts = app_stats_timestamp();
+    app_trace_end(TRACE_NN_INFERENCE, meta->frame_id);
+    time_stat_update(&stats->nn_inference_time, app_stats_elapsed_us(total_ts));
+    app_stats_bw_add(BW_NN_IN, nn_in_len);
+    app_stats_bw_add(BW_NN_OUT, nn_out_len);
 
     bqueue_put_free(&nn_input_queue);
     bqueue_put_ready(&nn_output_queue);
 
-    time_stat_update(&stats->nn_total_time, HAL_GetTick() - total_ts);
+    time_stat_update(&stats->nn_total_time, app_stats_elapsed_us(total_ts));
   }
 }
 
@@ -170,9 +295,14 @@ static void dp_thread_fct(void *arg)
   od_pp_out_t pp_output;
   stat_info_t *stats = app_stats_state();
   const nn_service_model_t *model = nn_model;
+#if APP_NN_CASCADE
+  nn_cascade_frame_t roi_frame;
+  nn_cascade_res_t roi_res;
+#endif
   uint32_t total_ts;
   void *pp_input;
   int is_dp_done;
+  int disp_idx;
   uint32_t ts;
   int ret;
 
@@ -180,24 +310,54 @@ static void dp_thread_fct(void *arg)
   app_postprocess_init(&pp_params, model->instance);
   while (1)
   {
+    bqueue_meta_t *meta;
     uint8_t *output_buffer;
 
     output_buffer = bqueue_get_ready(&nn_output_queue);
     assert(output_buffer);
-    total_ts = HAL_GetTick();
-
-    ts = HAL_GetTick();
+    total_ts = app_stats_timestamp();
+    meta = bqueue_get_meta(&nn_output_queue, output_buffer);
+#if APP_NN_ALT_MODEL
+    app_model_button_update();
+#endif
+
+    /* Output of the other model, quantization parameters differ */
+    if (meta->nn_model != model->handle) {
+      model = nn_service_get(meta->nn_model);
+      assert(model);
+      app_postprocess_init(&pp_params, model->instance);
+    }
+
+    ts = app_stats_timestamp();
+    app_trace_begin(TRACE_NN_PP, meta->frame_id);
     pp_input = (void *) output_buffer;
     pp_output.pOutBuff = NULL;
     ret = app_postprocess_run((void * []){pp_input}, 1, &pp_output, &pp_params);
     assert(ret == AI_OD_POSTPROCESS_ERROR_NO);
-    time_stat_update(&stats->nn_pp_time, HAL_GetTick() - ts);
+    app_trace_end(TRACE_NN_PP, meta->frame_id);
+    time_stat_update(&stats->nn_pp_time, app_stats_elapsed_us(ts));
     app_stats_cpuload_update();
-
-    is_dp_done = app_display_render(capture_buffer[capture_buffer_disp_idx], &pp_output);
+    app_stats_task_update();
+
+    disp_idx = app_capture_buffer_select(meta->frame_id);
+#if APP_NN_CASCADE
+    /* Detector is done with the NPU until next frame, ROIs run in its shadow */
+    roi_frame.buffer = capture_buffer[disp_idx];
+    roi_frame.width = VENC_WIDTH;
+    roi_frame.height = VENC_HEIGHT;
+    ts = app_stats_timestamp();
+    app_trace_begin(TRACE_NN_ROI, meta->frame_id);
+    ret = nn_cascade_run(&nn_cascade, &roi_frame, pp_output.pOutBuff, pp_output.nb_detect, &roi_res);
+    assert(ret == 0);
+    app_trace_end(TRACE_NN_ROI, meta->frame_id);
+    time_stat_update(&stats->nn_roi_time, app_stats_elapsed_us(ts));
+    roi_stat_update(&stats->roi, roi_res.run_nb, roi_res.skip_nb);
+#endif
+    is_dp_done = app_display_render(capture_buffer[disp_idx], &capture_meta[disp_idx], &pp_output);
 
     if (is_dp_done)
-      time_stat_update(&stats->disp_total_time, HAL_GetTick() - total_ts);
+      time_stat_update(&stats->disp_total_time, app_stats_elapsed_us(total_ts));
+    app_stats_bw_update();
 
     bqueue_put_free(&nn_output_queue);
   }
@@ -211,7 +371,9 @@ static void isp_thread_fct(void *arg)
     ret = xSemaphoreTake(isp_sem, portMAX_DELAY);
     assert(ret == pdTRUE);
 
+    app_trace_begin(TRACE_ISP_UPDATE, CAM_GetFrameId(DCMIPP_PIPE1));
     CAM_IspUpdate();
+    app_trace_end(TRACE_ISP_UPDATE, CAM_GetFrameId(DCMIPP_PIPE1));
   }
 }
 
@@ -221,24 +383,96 @@ void app_pipeline_init(void)
     .name = "default",
     .instance = &NN_Instance_Default,
     .postprocess_type = POSTPROCESS_TYPE,
+    .priority = NN_PRIORITY,
+    .deadline_us = NN_DEADLINE_US,
   };
+  uint8_t *nn_inputs[NN_INPUT_BUFFER_NB];
+  uint8_t *nn_outputs[NN_OUTPUT_BUFFER_NB];
   int ret;
+  int i;
 
   ret = nn_service_init();
   assert(ret == NN_SERVICE_OK);
+#if APP_NN_RELOC
+  {
+    nn_service_reloc_cfg_t reloc = {
+      .file = NN_RELOC_FLASH_ADDR,
+      .exec_ram = nn_reloc_exec_ram,
+      .exec_ram_size = sizeof(nn_reloc_exec_ram),
+      .ext_ram = nn_reloc_ext_ram,
+      .ext_ram_size = sizeof(nn_reloc_ext_ram),
+    };
+    nn_service_model_cfg_t reloc_cfg = nn_cfg;
+
+    reloc_cfg.name = "reloc";
+    reloc_cfg.instance = &NN_Instance_Reloc;
+    reloc_cfg.reloc = &reloc;
+    ret = nn_service_register(&reloc_cfg, &nn_model_handle);
+    /* Erased or invalid partition, keep the firmware model */
+    if (ret == NN_SERVICE_ERR_RELOC)
+      ret = nn_service_register(&nn_cfg, &nn_model_handle);
+  }
+#else
   ret = nn_service_register(&nn_cfg, &nn_model_handle);
+#endif
+  assert(ret == NN_SERVICE_OK);
+  nn_model_handles[0] = nn_model_handle;
+#if APP_NN_ALT_MODEL
+  {
+    nn_service_model_cfg_t alt_cfg = nn_cfg;
+
+    alt_cfg.name = "alt";
+    alt_cfg.instance = &NN_Instance_Alt;
+    ret = nn_service_register(&alt_cfg, &nn_model_handles[1]);
+    assert(ret == NN_SERVICE_OK);
+  }
+#endif
+  for (i = 0; i < app_pipeline_model_nb(); i++) {
+    nn_model = nn_service_get(nn_model_handles[i]);
+    assert(nn_model);
+    assert(nn_model->user_input_size <= sizeof(nn_input_buffers[0]));
+    assert(nn_model->user_output_size <= sizeof(nn_output_buffers[0]));
+    assert(nn_model->postprocess_type == POSTPROCESS_TYPE);
+  }
+#if APP_NN_CASCADE
+  {
+    nn_service_model_cfg_t roi_cfg = {
+      .name = "roi",
+      .instance = &NN_Instance_Roi,
+      .priority = NN_ROI_PRIORITY,
+      .deadline_us = NN_ROI_DEADLINE_US,
+    };
+    nn_cascade_conf_t cascade_conf = {
+      .width = NN_ROI_WIDTH,
+      .height = NN_ROI_HEIGHT,
+      .input = nn_roi_input_buffer,
+      .output = nn_roi_output_buffer,
+      .budget_us = NN_ROI_BUDGET_US,
+      .roi_max = NN_ROI_MAX,
+    };
+
+    ret = nn_service_register(&roi_cfg, &cascade_conf.model);
+    assert(ret == NN_SERVICE_OK);
+    assert(nn_service_get(cascade_conf.model)->user_output_size <= sizeof(nn_roi_output_buffer));
+    ret = nn_cascade_init(&nn_cascade, &cascade_conf);
+    assert(ret == 0);
+  }
+#endif
+  /* Every model is initialized before the pipeline starts, switches only swap the active one */
+  ret = nn_service_preinit();
   assert(ret == NN_SERVICE_OK);
   ret = nn_service_select(nn_model_handle);
   assert(ret == NN_SERVICE_OK);
   nn_model = nn_service_active();
-  assert(nn_model);
-  assert(nn_model->user_input_size <= sizeof(nn_input_buffers[0]));
-  assert(nn_model->user_output_size <= sizeof(nn_output_buffers[0]));
-  assert(nn_model->postprocess_type == POSTPROCESS_TYPE);
 
-  ret = bqueue_init(&nn_input_queue, 2, (uint8_t *[2]){nn_input_buffers[0], nn_input_buffers[1]});
+  /* DCMIPP ISR feeds nn thread, nn thread feeds dp thread: both are single producer / single consumer */
+  for (i = 0; i < NN_INPUT_BUFFER_NB; i++)
+    nn_inputs[i] = nn_input_buffers[i];
+  ret = bqueue_init_spsc(&nn_input_queue, NN_INPUT_BUFFER_NB, nn_inputs);
   assert(ret == 0);
-  ret = bqueue_init(&nn_output_queue, 2, (uint8_t *[2]){nn_output_buffers[0], nn_output_buffers[1]});
+  for (i = 0; i < NN_OUTPUT_BUFFER_NB; i++)
+    nn_outputs[i] = nn_output_buffers[i];
+  ret = bqueue_init_spsc(&nn_output_queue, NN_OUTPUT_BUFFER_NB, nn_outputs);
   assert(ret == 0);
 
   isp_sem = xSemaphoreCreateCountingStatic(1, 0, &isp_sem_buffer);
@@ -257,12 +491,26 @@ void app_pipeline_start(void)
   hdl = xTaskCreateStatic(nn_thread_fct, "nn", configMINIMAL_STACK_SIZE * 2, NULL, nn_priority, nn_thread_stack,
                           &nn_thread);
   assert(hdl != NULL);
+  app_stats_task_register(hdl, configMINIMAL_STACK_SIZE * 2);
   hdl = xTaskCreateStatic(dp_thread_fct, "dp", configMINIMAL_STACK_SIZE * 2, NULL, dp_priority, dp_thread_stack,
                           &dp_thread);
   assert(hdl != NULL);
+  app_stats_task_register(hdl, configMINIMAL_STACK_SIZE * 2);
   hdl = xTaskCreateStatic(isp_thread_fct, "isp", configMINIMAL_STACK_SIZE * 2, NULL, isp_priority, isp_thread_stack,
                           &isp_thread);
   assert(hdl != NULL);
+  app_stats_task_register(hdl, configMINIMAL_STACK_SIZE * 2);
+}
+
+int app_pipeline_model_nb(void)
+{
+  return sizeof(nn_model_handles) / sizeof(nn_model_handles[0]);
+}
+
+void app_pipeline_model_request(int idx)
+{
+  assert(idx >= 0 && idx < app_pipeline_model_nb());
+  nn_model_request = idx;
 }
 
 int CMW_CAMERA_PIPE_FrameEventCallback(uint32_t pipe)
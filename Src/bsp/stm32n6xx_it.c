@@ -21,6 +21,8 @@
 #include "bsp/stm32n6xx_it.h"
 
 #include "cmw_camera.h"
+#include "fal/fal_dma2d.h"
+#include "svc/app_stats.h"
 #include "uvcl.h"
 
 /**
@@ -92,15 +94,32 @@ void DebugMon_Handler(void)
 
 void CSI_IRQHandler(void)
 {
+  uint32_t ts = app_stats_isr_enter();
+
   HAL_DCMIPP_CSI_IRQHandler(CMW_CAMERA_GetDCMIPPHandle());
+  app_stats_isr_exit(ISR_CAMERA, ts);
 }
 
 void DCMIPP_IRQHandler(void)
 {
+  uint32_t ts = app_stats_isr_enter();
+
   HAL_DCMIPP_IRQHandler(CMW_CAMERA_GetDCMIPPHandle());
+  app_stats_isr_exit(ISR_CAMERA, ts);
 }
 
 void USB1_OTG_HS_IRQHandler(void)
 {
+  uint32_t ts = app_stats_isr_enter();
+
   UVCL_IRQHandler();
+  app_stats_isr_exit(ISR_USB, ts);
+}
+
+void DMA2D_IRQHandler(void)
+{
+  uint32_t ts = app_stats_isr_enter();
+
+  FAL_DMA2D_IRQHandler();
+  app_stats_isr_exit(ISR_DMA2D, ts);
 }
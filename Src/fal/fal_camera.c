@@ -21,6 +21,7 @@
 
 #include "fal/fal_camera.h"
 #include "app/app_config.h"
+#include "isp_api.h"
 #include "utils.h"
 
 static int sensor_width;
@@ -87,6 +88,27 @@ static void CAM_InitCropConfig(CMW_Manual_roi_area_t *roi, int sensor_w, int sen
   roi->offset_y = (sensor_h - roi->height + 1) / 2;
 }
 
+/* RGB to BT.601 limited range YUV. Matrix rows give V, Y and U */
+static void DCMIPP_PipeInitYuv(DCMIPP_HandleTypeDef *hdcmipp, uint32_t pitch)
+{
+  const DCMIPP_ColorConversionConfTypeDef yuv_conf = {
+    .ClampOutputSamples = ENABLE,
+    .OutputSamplesType = DCMIPP_CLAMP_YUV,
+    .RR = 112, .RG = -94, .RB = -18, .RA = 128,
+    .GR = 66, .GG = 129, .GB = 25, .GA = 16,
+    .BR = -38, .BG = -74, .BB = 112, .BA = 128,
+  };
+  int ret;
+
+  ret = HAL_DCMIPP_PIPE_SetYUVConversionConfig(hdcmipp, DCMIPP_PIPE1, &yuv_conf);
+  assert(ret == HAL_OK);
+  ret = HAL_DCMIPP_PIPE_EnableYUVConversion(hdcmipp, DCMIPP_PIPE1);
+  assert(ret == HAL_OK);
+
+  /* Pitch of chroma plane is only set by HAL on first configuration, not on resize */
+  MODIFY_REG(hdcmipp->Instance->P1PPM1PR, DCMIPP_P1PPM1PR_PITCH, pitch << DCMIPP_P1PPM1PR_PITCH_Pos);
+}
+
 static void DCMIPP_PipeInitDisplay(int sensor_w, int sensor_h)
 {
   CMW_DCMIPP_Conf_t dcmipp_conf;
@@ -106,6 +128,9 @@ static void DCMIPP_PipeInitDisplay(int sensor_w, int sensor_h)
   ret = CMW_CAMERA_SetPipeConfig(DCMIPP_PIPE1, &dcmipp_conf, &hw_pitch);
   assert(ret == HAL_OK);
   assert(hw_pitch == dcmipp_conf.output_width * dcmipp_conf.output_bpp);
+
+  if (CAPTURE_YUV420SP)
+    DCMIPP_PipeInitYuv(CMW_CAMERA_GetDCMIPPHandle(), hw_pitch);
 }
 
 static void DCMIPP_PipeInitNn(int sensor_w, int sensor_h)
@@ -191,10 +216,23 @@ void CAM_Init(void)
   DCMIPP_ReduceSpurious(CMW_CAMERA_GetDCMIPPHandle());
 }
 
+/* Chroma plane of NV12 capture follows luma one. Address is latched with the luma one on frame start */
+static void CAM_SetChromaAddress(uint8_t *dst)
+{
+  DCMIPP_HandleTypeDef *hdcmipp = CMW_CAMERA_GetDCMIPPHandle();
+
+  if (!CAPTURE_YUV420SP)
+    return;
+
+  WRITE_REG(hdcmipp->Instance->P1PPM1AR1, (uint32_t) (dst + venc_width * venc_height));
+}
+
 void CAM_DisplayPipe_Start(uint8_t *display_pipe_dst, uint32_t cam_mode)
 {
   int ret;
 
+  CAM_SetChromaAddress(display_pipe_dst);
+
   ret = CMW_CAMERA_Start(DCMIPP_PIPE1, display_pipe_dst, cam_mode);
   assert(ret == CMW_ERROR_NONE);
 }
@@ -217,8 +255,28 @@ static int CAM_SetPipeAddress(uint32_t pipe, uint8_t *dst)
   return (ret == HAL_OK) ? 0 : -1;
 }
 
+/* Display pipe output can be resized while running. Pipe is suspended on frame boundary */
+int CAM_DisplayPipe_SetSize(int width, int height)
+{
+  int ret;
+
+  ret = CMW_CAMERA_Suspend(DCMIPP_PIPE1);
+  if (ret != CMW_ERROR_NONE)
+    return -1;
+
+  venc_width = width;
+  venc_height = height;
+  DCMIPP_PipeInitDisplay(sensor_width, sensor_height);
+
+  ret = CMW_CAMERA_Resume(DCMIPP_PIPE1);
+
+  return ret == CMW_ERROR_NONE ? 0 : -1;
+}
+
 int CAM_DisplayPipe_UpdateAddress(uint8_t *display_pipe_dst)
 {
+  CAM_SetChromaAddress(display_pipe_dst);
+
   return CAM_SetPipeAddress(DCMIPP_PIPE1, display_pipe_dst);
 }
 
@@ -235,6 +293,27 @@ void CAM_IspUpdate(void)
   assert(ret == CMW_ERROR_NONE);
 }
 
+/* Id of the last frame output on pipe. 0 when the sensor is not handled by the ISP */
+uint32_t CAM_GetFrameId(uint32_t pipe)
+{
+  ISP_HandleTypeDef *isp = CMW_CAMERA_GetIspHandle();
+
+  if (!isp)
+    return 0;
+
+  return pipe == DCMIPP_PIPE2 ? ISP_GetAncillaryFrameId(isp) : ISP_GetMainFrameId(isp);
+}
+
+void CAM_GetSensorState(int32_t *exposure, int32_t *gain)
+{
+  int ret;
+
+  ret = CMW_CAMERA_GetExposure(exposure);
+  assert(ret == CMW_ERROR_NONE);
+  ret = CMW_CAMERA_GetGain(gain);
+  assert(ret == CMW_ERROR_NONE);
+}
+
 int CAM_GetVencWidth(void)
 {
   assert(venc_width);
@@ -20,38 +20,43 @@
 
 #include "stm32n6xx_hal.h"
 
+typedef struct {
+  int is_fill;
+  union {
+    fal_dma2d_fill_t fill;
+    fal_dma2d_blend_t blend;
+  };
+  fal_dma2d_cb_t on_complete;
+  fal_dma2d_cb_t on_error;
+  void *user;
+} fal_dma2d_op_t;
+
 static DMA2D_HandleTypeDef dma2d_handle;
-static fal_dma2d_cb_t complete_cb;
-static fal_dma2d_cb_t error_cb;
-static void *cb_user;
+/* Transfer with fence f is in fal_dma2d_queue[f % FAL_DMA2D_QUEUE_LEN]. Tasks write queued_fence,
+ * interrupt writes done_fence.
+ */
+static fal_dma2d_op_t fal_dma2d_queue[FAL_DMA2D_QUEUE_LEN];
+static volatile fal_dma2d_fence_t queued_fence;
+static volatile fal_dma2d_fence_t done_fence;
+static volatile int is_running;
+static fal_dma2d_fence_t wait_fence;
+static fal_dma2d_cb_t wait_cb;
+static void *wait_user;
 
-static void fal_dma2d_clear_callbacks(void)
-{
-  complete_cb = NULL;
-  error_cb = NULL;
-  cb_user = NULL;
-}
+static void fal_dma2d_on_done(int is_error);
 
 static void fal_dma2d_on_complete(DMA2D_HandleTypeDef *handle)
 {
   (void) handle;
 
-  HAL_NVIC_DisableIRQ(DMA2D_IRQn);
-  if (complete_cb)
-    complete_cb(cb_user);
-
-  fal_dma2d_clear_callbacks();
+  fal_dma2d_on_done(0);
 }
 
 static void fal_dma2d_on_error(DMA2D_HandleTypeDef *handle)
 {
   (void) handle;
 
-  HAL_NVIC_DisableIRQ(DMA2D_IRQn);
-  if (error_cb)
-    error_cb(cb_user);
-
-  fal_dma2d_clear_callbacks();
+  fal_dma2d_on_done(1);
 }
 
 static int fal_dma2d_prepare(uint32_t mode, uint32_t output_offset)
@@ -71,20 +76,22 @@ static int fal_dma2d_prepare(uint32_t mode, uint32_t output_offset)
   dma2d_handle.XferCpltCallback = fal_dma2d_on_complete;
   dma2d_handle.XferErrorCallback = fal_dma2d_on_error;
 
-  HAL_NVIC_EnableIRQ(DMA2D_IRQn);
-
   return 0;
 }
 
-int FAL_DMA2D_Blend(const fal_dma2d_blend_t *cfg)
+static const uint32_t fal_dma2d_input_modes[] = {
+  [FAL_DMA2D_FORMAT_ARGB8888] = DMA2D_INPUT_ARGB8888,
+  [FAL_DMA2D_FORMAT_A8] = DMA2D_INPUT_A8,
+  [FAL_DMA2D_FORMAT_A4] = DMA2D_INPUT_A4,
+};
+
+static int fal_dma2d_start_blend(const fal_dma2d_blend_t *cfg)
 {
+  uint32_t src_stride;
   uint32_t dst_addr;
   int ret;
 
-  if (!cfg || !cfg->dst || !cfg->src)
-    return -1;
-
-  fal_dma2d_clear_callbacks();
+  src_stride = cfg->src_stride ? cfg->src_stride : cfg->src_width;
   ret = fal_dma2d_prepare(DMA2D_M2M_BLEND, cfg->dst_width - cfg->src_width);
   if (ret)
     return ret;
@@ -95,10 +102,12 @@ int FAL_DMA2D_Blend(const fal_dma2d_blend_t *cfg)
   dma2d_handle.LayerCfg[0].AlphaInverted  = DMA2D_REGULAR_ALPHA;
   dma2d_handle.LayerCfg[0].RedBlueSwap    = DMA2D_RB_REGULAR;
 
+  /* For A8/A4, alpha comes from src and RGB from InputAlpha */
   dma2d_handle.LayerCfg[1].AlphaMode      = DMA2D_NO_MODIF_ALPHA;
-  dma2d_handle.LayerCfg[1].InputAlpha     = 0xFF;
-  dma2d_handle.LayerCfg[1].InputColorMode = DMA2D_INPUT_ARGB8888;
-  dma2d_handle.LayerCfg[1].InputOffset    = 0;
+  dma2d_handle.LayerCfg[1].InputAlpha     = cfg->src_format == FAL_DMA2D_FORMAT_ARGB8888 ? 0xFF :
+                                            (0xFF000000U | cfg->src_color);
+  dma2d_handle.LayerCfg[1].InputColorMode = fal_dma2d_input_modes[cfg->src_format];
+  dma2d_handle.LayerCfg[1].InputOffset    = src_stride - cfg->src_width;
   dma2d_handle.LayerCfg[1].AlphaInverted  = DMA2D_REGULAR_ALPHA;
   dma2d_handle.LayerCfg[1].RedBlueSwap    = DMA2D_RB_REGULAR;
   dma2d_handle.LayerCfg[0].AlphaMode      = DMA2D_NO_MODIF_ALPHA;
@@ -111,10 +120,6 @@ int FAL_DMA2D_Blend(const fal_dma2d_blend_t *cfg)
   if (ret != HAL_OK)
     return -1;
 
-  complete_cb = cfg->on_complete;
-  error_cb = cfg->on_error;
-  cb_user = cfg->user;
-
   dst_addr = (uint32_t) (cfg->dst + (cfg->dst_width * cfg->y_offset + cfg->x_offset) * 4U);
   ret = HAL_DMA2D_BlendingStart_IT(&dma2d_handle, (uint32_t) cfg->src, dst_addr, dst_addr,
                                    cfg->src_width, cfg->src_height);
@@ -122,15 +127,54 @@ int FAL_DMA2D_Blend(const fal_dma2d_blend_t *cfg)
   return (ret == HAL_OK) ? 0 : -1;
 }
 
-int FAL_DMA2D_Fill(const fal_dma2d_fill_t *cfg)
+/* Fixed color foreground blended over dst, e.g. a translucent text background */
+static int fal_dma2d_fill_blend(const fal_dma2d_fill_t *cfg)
 {
   uint32_t dst_addr;
   int ret;
 
-  if (!cfg || !cfg->dst)
+  ret = fal_dma2d_prepare(DMA2D_M2M_BLEND_FG, cfg->dst_width - cfg->width);
+  if (ret)
+    return ret;
+
+  dma2d_handle.LayerCfg[0].InputAlpha     = 0xFF;
+  dma2d_handle.LayerCfg[0].InputColorMode = DMA2D_INPUT_ARGB8888;
+  dma2d_handle.LayerCfg[0].InputOffset    = cfg->dst_width - cfg->width;
+  dma2d_handle.LayerCfg[0].AlphaInverted  = DMA2D_REGULAR_ALPHA;
+  dma2d_handle.LayerCfg[0].RedBlueSwap    = DMA2D_RB_REGULAR;
+  dma2d_handle.LayerCfg[0].AlphaMode      = DMA2D_NO_MODIF_ALPHA;
+
+  /* For ARGB input InputAlpha is the alpha value only, RGB goes in FGCOLR at start */
+  dma2d_handle.LayerCfg[1].AlphaMode      = DMA2D_REPLACE_ALPHA;
+  dma2d_handle.LayerCfg[1].InputAlpha     = cfg->color >> 24;
+  dma2d_handle.LayerCfg[1].InputColorMode = DMA2D_INPUT_ARGB8888;
+  dma2d_handle.LayerCfg[1].InputOffset    = 0;
+  dma2d_handle.LayerCfg[1].AlphaInverted  = DMA2D_REGULAR_ALPHA;
+  dma2d_handle.LayerCfg[1].RedBlueSwap    = DMA2D_RB_REGULAR;
+
+  ret = HAL_DMA2D_ConfigLayer(&dma2d_handle, 1);
+  if (ret != HAL_OK)
+    return -1;
+
+  ret = HAL_DMA2D_ConfigLayer(&dma2d_handle, 0);
+  if (ret != HAL_OK)
     return -1;
 
-  fal_dma2d_clear_callbacks();
+  /* In this mode first source address is the foreground color */
+  dst_addr = (uint32_t) (cfg->dst + (cfg->dst_width * cfg->y_offset + cfg->x_offset) * 4U);
+  ret = HAL_DMA2D_BlendingStart_IT(&dma2d_handle, cfg->color, dst_addr, dst_addr, cfg->width, cfg->height);
+
+  return (ret == HAL_OK) ? 0 : -1;
+}
+
+static int fal_dma2d_start_fill(const fal_dma2d_fill_t *cfg)
+{
+  uint32_t dst_addr;
+  int ret;
+
+  if (cfg->is_blend)
+    return fal_dma2d_fill_blend(cfg);
+
   ret = fal_dma2d_prepare(DMA2D_R2M, cfg->dst_width - cfg->width);
   if (ret)
     return ret;
@@ -139,22 +183,146 @@ int FAL_DMA2D_Fill(const fal_dma2d_fill_t *cfg)
   if (ret != HAL_OK)
     return -1;
 
-  complete_cb = cfg->on_complete;
-  error_cb = cfg->on_error;
-  cb_user = cfg->user;
-
   dst_addr = (uint32_t) (cfg->dst + (cfg->dst_width * cfg->y_offset + cfg->x_offset) * 4U);
   ret = HAL_DMA2D_Start_IT(&dma2d_handle, cfg->color, dst_addr, cfg->width, cfg->height);
 
   return (ret == HAL_OK) ? 0 : -1;
 }
 
-void FAL_DMA2D_IRQHandler(void)
+static int fal_dma2d_start(const fal_dma2d_op_t *op)
 {
-  HAL_DMA2D_IRQHandler(&dma2d_handle);
+  return op->is_fill ? fal_dma2d_start_fill(&op->fill) : fal_dma2d_start_blend(&op->blend);
+}
+
+static int fal_dma2d_is_done(fal_dma2d_fence_t fence)
+{
+  return (int32_t) (done_fence - fence) >= 0;
+}
+
+/* Start transfer following done_fence if any. -1 if it can't start */
+static int fal_dma2d_start_next(void)
+{
+  if (done_fence == queued_fence) {
+    is_running = 0;
+    return 0;
+  }
+
+  return fal_dma2d_start(&fal_dma2d_queue[(done_fence + 1) % FAL_DMA2D_QUEUE_LEN]);
+}
+
+/* Next transfer is started before callbacks run so DMA2D stays busy while they execute. A
+ * transfer that can't start is completed as failed.
+ */
+static void fal_dma2d_on_done(int is_error)
+{
+  fal_dma2d_op_t *op;
+  fal_dma2d_cb_t cb;
+  void *user;
+
+  do {
+    op = &fal_dma2d_queue[(done_fence + 1) % FAL_DMA2D_QUEUE_LEN];
+    cb = is_error ? op->on_error : op->on_complete;
+    user = op->user;
+    done_fence++;
+    is_error = fal_dma2d_start_next();
+    if (cb)
+      cb(user);
+  } while (is_error);
+
+  if (wait_cb && fal_dma2d_is_done(wait_fence)) {
+    cb = wait_cb;
+    wait_cb = NULL;
+    cb(wait_user);
+  }
+}
+
+static int fal_dma2d_push(const fal_dma2d_op_t *op)
+{
+  int ret = 0;
+
+  HAL_NVIC_DisableIRQ(DMA2D_IRQn);
+  if (queued_fence - done_fence == FAL_DMA2D_QUEUE_LEN) {
+    ret = -1;
+    goto exit;
+  }
+
+  fal_dma2d_queue[(queued_fence + 1) % FAL_DMA2D_QUEUE_LEN] = *op;
+  queued_fence++;
+  if (is_running)
+    goto exit;
+
+  is_running = 1;
+  ret = fal_dma2d_start(op);
+  if (ret) {
+    queued_fence--;
+    is_running = 0;
+  }
+
+exit:
+  HAL_NVIC_EnableIRQ(DMA2D_IRQn);
+
+  return ret;
 }
 
-void DMA2D_IRQHandler(void)
+int FAL_DMA2D_Blend(const fal_dma2d_blend_t *cfg)
 {
-  FAL_DMA2D_IRQHandler();
+  fal_dma2d_op_t op = { 0 };
+
+  if (!cfg || !cfg->dst || !cfg->src || cfg->src_format > FAL_DMA2D_FORMAT_A4)
+    return -1;
+
+  op.is_fill = 0;
+  op.blend = *cfg;
+  op.on_complete = cfg->on_complete;
+  op.on_error = cfg->on_error;
+  op.user = cfg->user;
+
+  return fal_dma2d_push(&op);
+}
+
+int FAL_DMA2D_Fill(const fal_dma2d_fill_t *cfg)
+{
+  fal_dma2d_op_t op = { 0 };
+
+  if (!cfg || !cfg->dst)
+    return -1;
+
+  op.is_fill = 1;
+  op.fill = *cfg;
+  op.on_complete = cfg->on_complete;
+  op.on_error = cfg->on_error;
+  op.user = cfg->user;
+
+  return fal_dma2d_push(&op);
+}
+
+fal_dma2d_fence_t FAL_DMA2D_GetFence(void)
+{
+  return queued_fence;
+}
+
+int FAL_DMA2D_IsDone(fal_dma2d_fence_t fence)
+{
+  return fal_dma2d_is_done(fence);
+}
+
+int FAL_DMA2D_NotifyFence(fal_dma2d_fence_t fence, fal_dma2d_cb_t cb, void *user)
+{
+  int is_done;
+
+  HAL_NVIC_DisableIRQ(DMA2D_IRQn);
+  is_done = fal_dma2d_is_done(fence);
+  if (!is_done) {
+    wait_fence = fence;
+    wait_user = user;
+    wait_cb = cb;
+  }
+  HAL_NVIC_EnableIRQ(DMA2D_IRQn);
+
+  return is_done;
+}
+
+void FAL_DMA2D_IRQHandler(void)
+{
+  HAL_DMA2D_IRQHandler(&dma2d_handle);
 }
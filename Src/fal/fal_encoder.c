@@ -27,22 +27,39 @@
 #include "stm32n6xx_ll_venc.h"
 #include "utils.h"
 #include "ewl.h"
+#include "fal/fal_cache.h"
 
 #define VENC_ALLOCATOR_SIZE (4 * 1024 * 1024)
+/* D-cache line */
+#define VENC_ALLOCATOR_ALIGN 32
+#define VENC_HEADER_MAX_SIZE 128
 #define RATE_CTRL_QP 25
-
-enum {
-  VENC_RATE_CTRL_QP_CONSTANT,
-  VENC_RATE_CTRL_VBR,
-};
+#define RATE_CTRL_QP_MIN 10
+#define RATE_CTRL_QP_MAX 51
+#define JPEG_QLEVEL 6
 
 static uint8_t venc_hw_allocator_buffer[VENC_ALLOCATOR_SIZE] ALIGN_32 IN_PSRAM;
 static uint8_t *venc_hw_allocator_pos = venc_hw_allocator_buffer;
 static struct VENC_Context {
+  ENC_Codec_t codec;
+  ENC_Input_t input;
   H264EncInst hdl;
+  JpegEncInst jpeg_hdl;
+  int jpeg_qlevel;
   int is_sps_pps_done;
   uint64_t pic_cnt;
   int gop_len;
+  int width;
+  int height;
+  int fps;
+  ENC_RateCtrl_t rc;
+  int slice_rows;
+  /* sliced mode: SPS/PPS are prepended by us so the hw output only holds slices */
+  uint8_t header[VENC_HEADER_MAX_SIZE] ALIGN_32;
+  size_t header_len;
+  size_t prefix_len;
+  ENC_SliceReadyCb_t slice_cb;
+  void *slice_cb_arg;
 } VENC_Instance;
 
 static void VENC_SetupConstantQp(H264EncRateCtrl *rate, int qp)
@@ -56,20 +73,88 @@ static void VENC_SetupConstantQp(H264EncRateCtrl *rate, int qp)
   rate->qpMax = qp;
 }
 
-static void VENC_SetupVbr(H264EncRateCtrl *rate, int bitrate, int gopLen, int qp)
+static void VENC_SetupVbr(H264EncRateCtrl *rate, int bitrate, int gopLen, int qp, int qpMin, int qpMax)
 {
   rate->pictureRc = 1;
   rate->mbRc = 1;
   rate->pictureSkip = 0;
   rate->hrd = 0;
+  rate->hrdCpbSize = 0;
   rate->qpHdr = qp;
-  rate->qpMin = 10;
-  rate->qpMax = 51;
+  rate->qpMin = qpMin;
+  rate->qpMax = qpMax;
   rate->gopLen = gopLen;
   rate->bitPerSecond = bitrate;
   rate->intraQpDelta = 0;
 }
 
+/* VBR bounded by a half second virtual buffer, HRD stays off. HRD would give a strict CBR but
+ * then the library refuses any rate control change once stream is started.
+ */
+static void VENC_SetupConstrainedVbr(H264EncRateCtrl *rate, int bitrate, int gopLen, int qp, int qpMin, int qpMax)
+{
+  VENC_SetupVbr(rate, bitrate, gopLen, qp, qpMin, qpMax);
+  rate->hrdCpbSize = bitrate / 2;
+}
+
+static void VENC_CompleteRateCtrl(struct VENC_Context *p_ctx, ENC_RateCtrl_t *p_rc)
+{
+  if (!p_rc->bitrate)
+    p_rc->bitrate = ((p_ctx->width * p_ctx->height * 12) * p_ctx->fps) / 30;
+  if (!p_rc->gop_size)
+    p_rc->gop_size = p_ctx->fps;
+  if (!p_rc->qp)
+    p_rc->qp = RATE_CTRL_QP;
+  if (!p_rc->qp_min)
+    p_rc->qp_min = RATE_CTRL_QP_MIN;
+  if (!p_rc->qp_max)
+    p_rc->qp_max = RATE_CTRL_QP_MAX;
+}
+
+static int VENC_ApplyRateCtrl(struct VENC_Context *p_ctx, const ENC_RateCtrl_t *p_rc)
+{
+  H264EncRateCtrl rate;
+  int qp = p_rc->qp;
+  int ret;
+
+  ret = H264EncGetRateCtrl(p_ctx->hdl, &rate);
+  if (ret != H264ENC_OK)
+    return -1;
+
+  /* Once started, rate control goes on from its current qp instead of restarting from p_rc->qp */
+  if (p_rc->mode != ENC_RATE_CTRL_CQP)
+  {
+    if (p_ctx->pic_cnt)
+      qp = rate.qpHdr;
+    qp = MIN(MAX(qp, p_rc->qp_min), p_rc->qp_max);
+  }
+
+  switch (p_rc->mode)
+  {
+  case ENC_RATE_CTRL_VBR:
+    VENC_SetupVbr(&rate, p_rc->bitrate, p_rc->gop_size, qp, p_rc->qp_min, p_rc->qp_max);
+    break;
+  case ENC_RATE_CTRL_CVBR:
+    VENC_SetupConstrainedVbr(&rate, p_rc->bitrate, p_rc->gop_size, qp, p_rc->qp_min, p_rc->qp_max);
+    break;
+  case ENC_RATE_CTRL_CQP:
+    VENC_SetupConstantQp(&rate, p_rc->qp);
+    rate.gopLen = p_rc->gop_size;
+    break;
+  default:
+    return -1;
+  }
+
+  ret = H264EncSetRateCtrl(p_ctx->hdl, &rate);
+  if (ret != H264ENC_OK)
+    return -1;
+
+  p_ctx->rc = *p_rc;
+  p_ctx->gop_len = p_rc->gop_size - 1;
+
+  return 0;
+}
+
 static int VENC_AppendPadding(struct VENC_Context *p_ctx, uint8_t *p_out, size_t out_len, size_t *p_out_len)
 {
   uint32_t out_addr = (uint32_t) p_out;
@@ -130,29 +215,52 @@ static int VENC_EncodeStart(struct VENC_Context *p_ctx, uint8_t *p_out, size_t o
   return 0;
 }
 
+static void VENC_SliceReady(H264EncSliceReady *slice)
+{
+  struct VENC_Context *p_ctx = slice->pAppData;
+  size_t len = p_ctx->prefix_len;
+  u32 i;
+
+  /* sizeTbl is written by the VENC in cacheable PSRAM */
+  FAL_CacheInvalidate(slice->sliceSizes, slice->slicesReady * sizeof(slice->sliceSizes[0]));
+  for (i = 0; i < slice->slicesReady; i++)
+    len += slice->sliceSizes[i];
+
+  p_ctx->slice_cb(p_ctx->slice_cb_arg, len);
+}
+
+/* NULL for packed input */
+static uint8_t *VENC_ChromaPlane(struct VENC_Context *p_ctx, uint8_t *p_in)
+{
+  if (p_ctx->input != ENC_INPUT_NV12)
+    return NULL;
+
+  return p_in + p_ctx->width * p_ctx->height;
+}
+
 static int VENC_EncodeFrame(struct VENC_Context *p_ctx, uint8_t *p_in, uint8_t *p_out, size_t out_len,
-                            size_t *p_out_len, int is_intra_force)
+                            size_t *p_out_len, int is_intra)
 {
+  H264EncSliceReadyCallBackFunc slice_cb = p_ctx->slice_cb ? VENC_SliceReady : NULL;
   H264EncOut enc_out;
   H264EncIn enc_in;
   int ret;
 
-  /* In both N6_VENC_INPUT_YUV2 and N6_VENC_INPUT_RGB565 only busLuma is used */
+  /* Packed RGB input only uses busLuma */
   enc_in.busLuma = (ptr_t) p_in;
-  enc_in.busChromaU = 0;
+  enc_in.busChromaU = (ptr_t) VENC_ChromaPlane(p_ctx, p_in);
   enc_in.busChromaV = 0;
   enc_in.pOutBuf = (u32 *) p_out;
   enc_in.busOutBuf = (ptr_t) p_out;
   enc_in.outBufSize = out_len;
-  enc_in.codingType = (p_ctx->pic_cnt % (p_ctx->gop_len + 1) == 0) ? H264ENC_INTRA_FRAME : H264ENC_PREDICTED_FRAME;
-  enc_in.codingType = is_intra_force ? H264ENC_INTRA_FRAME : enc_in.codingType;
+  enc_in.codingType = is_intra ? H264ENC_INTRA_FRAME : H264ENC_PREDICTED_FRAME;
   enc_in.timeIncrement = 1;
   enc_in.ipf = H264ENC_REFERENCE_AND_REFRESH; /* FIXME : can be H264ENC_NO_REFERENCE_NO_REFRESH in I only mode */
   enc_in.ltrf = H264ENC_NO_REFERENCE_NO_REFRESH;
   enc_in.lineBufWrCnt = 0;
   enc_in.sendAUD = 0;
 
-  ret = H264EncStrmEncode(p_ctx->hdl, &enc_in, &enc_out, NULL, NULL, NULL);
+  ret = H264EncStrmEncode(p_ctx->hdl, &enc_in, &enc_out, slice_cb, NULL, p_ctx);
   if (ret != H264ENC_FRAME_READY)
     return -1;
 
@@ -165,11 +273,22 @@ static int VENC_EncodeFrame(struct VENC_Context *p_ctx, uint8_t *p_in, uint8_t *
 static int VENC_Encode(uint8_t *p_in, uint8_t *p_out, size_t out_len, size_t *p_out_len, int is_intra_force)
 {
   struct VENC_Context *p_ctx = &VENC_Instance;
+  int is_intra = is_intra_force || (p_ctx->pic_cnt % (p_ctx->gop_len + 1) == 0);
   size_t start_len = 0;
   size_t frame_len;
   int ret;
 
-  if (!p_ctx->is_sps_pps_done)
+  if (p_ctx->slice_rows)
+  {
+    /* Intra frames carry SPS/PPS so the host can join at any IDR */
+    if (is_intra)
+    {
+      if (p_ctx->header_len > out_len)
+        return -1;
+      memcpy(p_out, p_ctx->header, p_ctx->header_len);
+      start_len = p_ctx->header_len;
+    }
+  } else if (!p_ctx->is_sps_pps_done)
   {
     ret = VENC_EncodeStart(p_ctx, p_out, out_len, &start_len);
     if (ret)
@@ -177,7 +296,11 @@ static int VENC_Encode(uint8_t *p_in, uint8_t *p_out, size_t out_len, size_t *p_
     p_ctx->is_sps_pps_done = 1;
   }
 
-  ret = VENC_EncodeFrame(p_ctx, p_in, &p_out[start_len], out_len - start_len, &frame_len, is_intra_force);
+  p_ctx->prefix_len = start_len;
+  if (p_ctx->slice_cb && start_len)
+    p_ctx->slice_cb(p_ctx->slice_cb_arg, start_len);
+
+  ret = VENC_EncodeFrame(p_ctx, p_in, &p_out[start_len], out_len - start_len, &frame_len, is_intra);
   if (ret)
     return ret;
 
@@ -186,22 +309,99 @@ static int VENC_Encode(uint8_t *p_in, uint8_t *p_out, size_t out_len, size_t *p_
   return 0;
 }
 
+static int VENC_JpegEncode(struct VENC_Context *p_ctx, uint8_t *p_in, uint8_t *p_out, size_t out_len,
+                           size_t *p_out_len)
+{
+  JpegEncOut enc_out;
+  JpegEncIn enc_in;
+  int ret;
+
+  /* Packed RGB input only uses luma plane, NV12 chroma goes in Cb one */
+  memset(&enc_in, 0, sizeof(enc_in));
+  enc_in.frameHeader = 1;
+  enc_in.pLum = p_in;
+  enc_in.busLum = (size_t) p_in;
+  enc_in.pCb = VENC_ChromaPlane(p_ctx, p_in);
+  enc_in.busCb = (size_t) enc_in.pCb;
+  enc_in.pOutBuf = p_out;
+  enc_in.busOutBuf = (size_t) p_out;
+  enc_in.outBufSize = out_len;
+
+  ret = JpegEncEncode(p_ctx->jpeg_hdl, &enc_in, &enc_out, NULL, NULL);
+  if (ret != JPEGENC_FRAME_READY)
+    return -1;
+
+  p_ctx->pic_cnt++;
+  *p_out_len = enc_out.jfifSize;
+
+  return 0;
+}
+
+static void VENC_JpegInit(struct VENC_Context *p_ctx, ENC_Conf_t *p_conf)
+{
+  JpegEncCfg cfg;
+  int ret;
+
+  p_ctx->jpeg_qlevel = p_conf->jpeg_qlevel ? p_conf->jpeg_qlevel : JPEG_QLEVEL;
+  assert(p_ctx->jpeg_qlevel <= 9);
+
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.inputWidth = p_conf->width;
+  cfg.inputHeight = p_conf->height;
+  cfg.codingWidth = p_conf->width;
+  cfg.codingHeight = p_conf->height;
+  cfg.qLevel = p_ctx->jpeg_qlevel;
+  cfg.frameType = p_conf->input == ENC_INPUT_NV12 ? JPEGENC_YUV420_SEMIPLANAR : JPEGENC_RGB888;
+  cfg.colorConversion.type = JPEGENC_RGBTOYUV_BT601;
+  cfg.rotation = JPEGENC_ROTATE_0;
+  cfg.codingType = JPEGENC_WHOLE_FRAME;
+  cfg.codingMode = JPEGENC_420_MODE;
+  cfg.unitsType = JPEGENC_NO_UNITS;
+  cfg.markerType = JPEGENC_SINGLE_MARKER;
+  cfg.xDensity = 1;
+  cfg.yDensity = 1;
+  ret = JpegEncInit(&cfg, &p_ctx->jpeg_hdl);
+  assert(ret == JPEGENC_OK);
+
+  /* Every frame is intra, rate control is reported as a fixed qp */
+  memset(&p_ctx->rc, 0, sizeof(p_ctx->rc));
+  p_ctx->rc.mode = ENC_RATE_CTRL_CQP;
+  p_ctx->rc.gop_size = 1;
+  p_ctx->rc.qp = p_ctx->jpeg_qlevel;
+  p_ctx->rc.qp_min = p_ctx->jpeg_qlevel;
+  p_ctx->rc.qp_max = p_ctx->jpeg_qlevel;
+  VENC_CompleteRateCtrl(p_ctx, &p_ctx->rc);
+  p_ctx->gop_len = 0;
+}
+
 void ENC_Init(ENC_Conf_t *p_conf)
 {
-  const int rate_ctrl_mode = VENC_RATE_CTRL_VBR;
   struct VENC_Context *p_ctx = &VENC_Instance;
+  ENC_RateCtrl_t rc = p_conf->rate_ctrl;
   H264EncPreProcessingCfg cfg;
   H264EncCodingCtrl ctrl;
   H264EncConfig config;
-  H264EncRateCtrl rate;
-  int target_bitrate;
   int ret;
 
   __HAL_RCC_SYSCFG_CLK_ENABLE();
   LL_VENC_Init();
 
   memset(&config, 0, sizeof(config));
-  p_ctx->gop_len = p_conf->fps - 1;
+  p_ctx->codec = p_conf->codec;
+  p_ctx->input = p_conf->input;
+  p_ctx->is_sps_pps_done = 0;
+  p_ctx->pic_cnt = 0;
+  p_ctx->width = p_conf->width;
+  p_ctx->height = p_conf->height;
+  p_ctx->fps = p_conf->fps;
+  p_ctx->slice_rows = 0;
+
+  if (p_ctx->codec == ENC_CODEC_JPEG)
+  {
+    VENC_JpegInit(p_ctx, p_conf);
+    return;
+  }
+
   /* init encoder */
   config.streamType = H264ENC_BYTE_STREAM;
   config.viewMode = H264ENC_BASE_VIEW_SINGLE_BUFFER;
@@ -217,50 +417,93 @@ void ENC_Init(ENC_Conf_t *p_conf)
   /* setup source format */
   ret = H264EncGetPreProcessing(p_ctx->hdl, &cfg);
   assert(ret == H264ENC_OK);
-  cfg.inputType = H264ENC_RGB888;
+  cfg.inputType = p_conf->input == ENC_INPUT_NV12 ? H264ENC_YUV420_SEMIPLANAR : H264ENC_RGB888;
   ret = H264EncSetPreProcessing(p_ctx->hdl, &cfg);
   assert(ret == H264ENC_OK);
 
   /* setup coding ctrl */
   ret = H264EncGetCodingCtrl(p_ctx->hdl, &ctrl);
   assert(ret == H264ENC_OK);
-  ctrl.idrHeader = 1;
+  ctrl.idrHeader = p_conf->slice_rows ? 0 : 1;
+  ctrl.sliceSize = p_conf->slice_rows;
   ret = H264EncSetCodingCtrl(p_ctx->hdl, &ctrl);
   assert(ret == H264ENC_OK);
+  p_ctx->slice_rows = p_conf->slice_rows;
 
   /* setup rate ctrl */
-  ret = H264EncGetRateCtrl(p_ctx->hdl, &rate);
-  assert(ret == H264ENC_OK);
-  target_bitrate = ((p_conf->width * p_conf->height * 12) * p_conf->fps) / 30;
-  if (rate_ctrl_mode == VENC_RATE_CTRL_QP_CONSTANT)
+  VENC_CompleteRateCtrl(p_ctx, &rc);
+  ret = VENC_ApplyRateCtrl(p_ctx, &rc);
+  assert(ret == 0);
+
+  if (p_ctx->slice_rows)
   {
-    VENC_SetupConstantQp(&rate, RATE_CTRL_QP);
-  } else if (rate_ctrl_mode == VENC_RATE_CTRL_VBR)
+    /* header is written by hw in cacheable memory */
+    FAL_CacheInvalidate(p_ctx->header, sizeof(p_ctx->header));
+    ret = VENC_EncodeStart(p_ctx, p_ctx->header, sizeof(p_ctx->header), &p_ctx->header_len);
+    assert(ret == 0);
+    FAL_CacheInvalidate(p_ctx->header, sizeof(p_ctx->header));
+  }
+}
+
+void ENC_DeInit()
+{
+  struct VENC_Context *p_ctx = &VENC_Instance;
+  int ret;
+
+  if (p_ctx->codec == ENC_CODEC_JPEG)
   {
-    VENC_SetupVbr(&rate, target_bitrate, p_conf->fps, RATE_CTRL_QP);
+    ret = JpegEncRelease(p_ctx->jpeg_hdl);
+    assert(ret == JPEGENC_OK);
   } else
   {
-    assert(0);
+    ret = H264EncRelease(p_ctx->hdl);
+    assert(ret == H264ENC_OK);
   }
-  ret = H264EncSetRateCtrl(p_ctx->hdl, &rate);
-  assert(ret == H264ENC_OK);
+
+  /* Single instance, so all linear memory is free again */
+  venc_hw_allocator_pos = venc_hw_allocator_buffer;
 }
 
-void ENC_DeInit()
+int ENC_SetRateControl(const ENC_RateCtrl_t *p_rc)
 {
   struct VENC_Context *p_ctx = &VENC_Instance;
-  int ret;
+  ENC_RateCtrl_t rc = *p_rc;
 
-  ret = H264EncRelease(p_ctx->hdl);
-  assert(ret == H264ENC_OK);
+  if (p_ctx->codec == ENC_CODEC_JPEG)
+    return -1;
+
+  VENC_CompleteRateCtrl(p_ctx, &rc);
+
+  return VENC_ApplyRateCtrl(p_ctx, &rc);
+}
+
+void ENC_GetRateControl(ENC_RateCtrl_t *p_rc)
+{
+  *p_rc = VENC_Instance.rc;
 }
 
 int ENC_EncodeFrame(uint8_t *p_in, uint8_t *p_out, size_t out_len, int is_intra_force)
 {
+  return ENC_EncodeFrameSliced(p_in, p_out, out_len, is_intra_force, NULL, NULL);
+}
+
+int ENC_EncodeFrameSliced(uint8_t *p_in, uint8_t *p_out, size_t out_len, int is_intra_force,
+                          ENC_SliceReadyCb_t cb, void *cb_arg)
+{
+  struct VENC_Context *p_ctx = &VENC_Instance;
   size_t out_compressed_frame_len;
   int ret;
 
+  if (p_ctx->codec == ENC_CODEC_JPEG)
+  {
+    ret = VENC_JpegEncode(p_ctx, p_in, p_out, out_len, &out_compressed_frame_len);
+    return ret ? -1 : (int) out_compressed_frame_len;
+  }
+
+  p_ctx->slice_cb = p_ctx->slice_rows ? cb : NULL;
+  p_ctx->slice_cb_arg = cb_arg;
   ret = VENC_Encode(p_in, p_out, out_len, &out_compressed_frame_len, is_intra_force);
+  p_ctx->slice_cb = NULL;
 
   return ret ? -1 : (int) out_compressed_frame_len;
 }
@@ -288,9 +531,13 @@ void *EWLcalloc(u32 n, u32 s)
   return res;
 }
 
-/* Implement simple EWLMallocLinear. No dealloc supported */
+/* Implement simple EWLMallocLinear. No dealloc supported. Buffers are cache line aligned so that
+ * invalidating one written by the hardware never drops cpu data of its neighbours.
+ */
 i32 EWLMallocLinear(const void *instance, u32 size, EWLLinearMem_t *info)
 {
+  venc_hw_allocator_pos = (uint8_t *) (((uintptr_t) venc_hw_allocator_pos + VENC_ALLOCATOR_ALIGN - 1) &
+                                       ~(uintptr_t) (VENC_ALLOCATOR_ALIGN - 1));
   if (venc_hw_allocator_pos + size > venc_hw_allocator_buffer + VENC_ALLOCATOR_SIZE)
     return -1;
 
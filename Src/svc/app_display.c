@@ -20,11 +20,14 @@
 
 #include <assert.h>
 #include <stdint.h>
-#include <string.h>
+#include <stdio.h>
 
 #include "app/app.h"
+#include "app/app_config.h"
 #include "app_postprocess.h"
 #include "svc/app_stats.h"
+#include "svc/app_trace.h"
+#include "svc/bitrate_ctrl.h"
 #include "svc/draw.h"
 #include "svc/figs.h"
 #include "fal/fal_encoder.h"
@@ -38,10 +41,46 @@
 #define DBG_INFO_FONT font_12
 #define CONF_LEVEL_FONT font_16
 #define INF_INFO_FONT font_16
+#define OVERLAY_FONT_FORMAT DRAW_FORMAT_A4
+#define OVERLAY_TEXT_COLOR 0xffffff
+/* DMA2D blends overlay on ARGB8888 frames, cpu on NV12 ones */
+#define OVERLAY_DST_FORMAT (CAPTURE_YUV420SP ? DRAW_FORMAT_NV12 : DRAW_FORMAT_ARGB8888)
 #define OBJ_RECT_COLOR 0xffffffff
+#define DBG_INFO_COLUMNS 41
+#define DBG_INFO_LINES (APP_NN_CASCADE ? 13 : 12)
+#define INF_INFO_COLUMNS 24
+#define INF_INFO_LINES 2
 #define VENC_MAX_WIDTH 1280
 #define VENC_MAX_HEIGHT 720
-#define VENC_OUT_BUFFER_SIZE (255 * 1024)
+/* Slots share 528 KB of the 576 KB AXI_SRAM_UNCACHED, UVCL uses the rest */
+#define VENC_OUT_BUFFER_SIZE ((528 / VENC_OUT_BUFFER_NB) * 1024)
+#define OVERLAY_REGION_SIZE(columns, font_width, lines, font_height) \
+  (((columns) * (font_width) * (lines) * (font_height) * 4 + 31) & ~31)
+
+/* Encoded frames are handed to UVCL in order and released in the same order. progress holds
+ * the bytes produced so far; with sliced encoding UVCL sends them while the frame is encoded.
+ */
+typedef struct {
+  UVCL_FrameProgress_t progress;
+  uint32_t capture_ts;
+  uint32_t frame_id;
+  uint32_t submit_ts;
+  int drain_us;
+} uvc_slot_t;
+
+typedef enum {
+  OVERLAY_REGION_INF,
+  OVERLAY_REGION_DBG,
+  OVERLAY_REGION_NB,
+} overlay_region_id_t;
+
+typedef enum {
+  DBG_INFO_OFF,
+  DBG_INFO_MEAN,
+  DBG_INFO_PERCENTILES,
+  DBG_INFO_CPU,
+  DBG_INFO_MODE_NB,
+} dbg_info_mode_t;
 
 typedef struct {
   float conf;
@@ -53,18 +92,55 @@ typedef struct {
 
 static DRAW_Font_t font_12;
 static DRAW_Font_t font_16;
+static DRAW_List_t overlay_list;
+static DRAW_TextCache_t overlay_text_cache;
+static uint8_t overlay_text_strips[DRAW_TEXT_CACHE_ENTRY_NB * DRAW_TEXT_CACHE_ENTRY_SIZE] ALIGN_32 IN_PSRAM;
+static DRAW_List_t overlay_region_list;
+static DRAW_Region_t overlay_regions[OVERLAY_REGION_NB];
+/* Sized for font_16 / font_12 panels, kept in internal ram */
+static uint8_t overlay_region_inf_buf[OVERLAY_REGION_SIZE(INF_INFO_COLUMNS, 11, INF_INFO_LINES, 16)] ALIGN_32;
+static uint8_t overlay_region_dbg_buf[OVERLAY_REGION_SIZE(DBG_INFO_COLUMNS, 7, DBG_INFO_LINES, 12)] ALIGN_32;
 static SemaphoreHandle_t dma2d_lock;
 static StaticSemaphore_t dma2d_lock_buffer;
 static SemaphoreHandle_t dma2d_sem;
 static StaticSemaphore_t dma2d_sem_buffer;
+static SemaphoreHandle_t rc_lock;
+static StaticSemaphore_t rc_lock_buffer;
+static ENC_RateCtrl_t rc_current;
+static ENC_RateCtrl_t rc_request;
+static int rc_request_pending;
+/* Setting requested by config or app, adaptive bitrate works below it */
+static ENC_RateCtrl_t rc_target;
+static bitrate_ctrl_t bitrate_ctrl;
+static uint32_t bitrate_ctrl_skip_nb;
+static int venc_fps;
+/* Stream committed by host, stream pipeline is configured for and time of last reconfiguration */
+static UVCL_StreamConf_t uvc_stream_req;
+static volatile uint32_t uvc_stream_start_nb;
+static uint32_t uvc_stream_start_nb_seen;
+static UVCL_StreamConf_t uvc_stream_cur;
+static uint32_t uvc_stream_switch_ts;
+static int uvc_stream_is_switching;
+static uint32_t uvc_stream_last_ts;
+static int uvc_stream_is_started;
 
 static struct uvcl_callbacks uvcl_cbs;
 static int uvc_is_active;
-static volatile int buffer_flying;
+static volatile int glass_to_usb_us = -1;
+static dbg_info_mode_t dbg_info_mode;
 static int force_intra;
+static ENC_Conf_t enc_conf_base;
 
-static uint8_t venc_out_buffer[VENC_OUT_BUFFER_SIZE] ALIGN_32 UNCACHED;
-static uint8_t uvc_in_buffers[VENC_OUT_BUFFER_SIZE] ALIGN_32;
+/* Slot counters only grow. used and submitted are written by dp thread, released by UVC ISR
+ * which reads submitted in its assert, so all three are volatile.
+ */
+static uint8_t venc_out_buffers[VENC_OUT_BUFFER_NB][VENC_OUT_BUFFER_SIZE] ALIGN_32 UNCACHED;
+static uvc_slot_t uvc_slots[VENC_OUT_BUFFER_NB];
+static volatile uint32_t uvc_slot_used_nb;
+static volatile uint32_t uvc_slot_submitted_nb;
+static volatile uint32_t uvc_slot_released_nb;
+static uint32_t uvc_slot_drained_nb;
+static uint32_t uvc_last_release_ts;
 
 static int clamp_point(int *x, int *y)
 {
@@ -118,146 +194,550 @@ static void cvt_nn_box_to_dp_box(od_pp_outBuffer_t *detect, box_t *box_dp)
   box_dp->conf = detect->conf;
 }
 
-static void draw_box(uint8_t *p_buffer, od_pp_outBuffer_t *box_nn)
+static void draw_box(DRAW_List_t *p_list, od_pp_outBuffer_t *box_nn)
 {
   box_t box_disp;
 
   cvt_nn_box_to_dp_box(box_nn, &box_disp);
-  DRAW_RectArgbHw(p_buffer, VENC_WIDTH, VENC_HEIGHT, box_disp.x, box_disp.y, box_disp.w, box_disp.h, OBJ_RECT_COLOR);
-  DRAW_PrintfArgbHw(&CONF_LEVEL_FONT, p_buffer, VENC_WIDTH, VENC_HEIGHT, box_disp.x, box_disp.y, "%5.1f %%",
-                    box_disp.conf * 100);
+  DRAW_ListRect(p_list, box_disp.x, box_disp.y, box_disp.w, box_disp.h, OBJ_RECT_COLOR);
+#if APP_NN_CASCADE
+  /* class refined by the ROI model, or the detector one when the ROI was skipped */
+  DRAW_ListPrintf(p_list, &CONF_LEVEL_FONT, box_disp.x, box_disp.y, "%5.1f %% #%d", box_disp.conf * 100,
+                  (int)box_nn->class_index);
+#else
+  DRAW_ListPrintf(p_list, &CONF_LEVEL_FONT, box_disp.x, box_disp.y, "%5.1f %%", box_disp.conf * 100);
+#endif
+}
+
+/* Fits a duration in 4 columns */
+static void time_stat_format(char *buf, size_t size, uint32_t us)
+{
+  float ms = us / 1000.0f;
+
+  if (ms < 9.995f)
+    snprintf(buf, size, "%4.2f", ms);
+  else if (ms < 99.95f)
+    snprintf(buf, size, "%4.1f", ms);
+  else if (ms < 9999.5f)
+    snprintf(buf, size, "%4.0f", ms);
+  else
+    snprintf(buf, size, "9999");
+}
+
+static void time_stat_display(time_stat_t *p_stat, DRAW_List_t *p_list, char *label, int line_nb, int indent)
+{
+  int offset = VENC_WIDTH - DBG_INFO_COLUMNS * DBG_INFO_FONT.width;
+  char pct[4][5];
+
+  if (dbg_info_mode == DBG_INFO_MEAN) {
+    DRAW_ListPrintf(p_list, &DBG_INFO_FONT, offset, line_nb * DBG_INFO_FONT.height,
+                    "%*s%s : %5.1f ms / %5.1f ms ", indent + 1, "", label, p_stat->last / 1000.0,
+                    p_stat->mean / 1000);
+    return;
+  }
+
+  time_stat_format(pct[0], sizeof(pct[0]), time_stat_percentile(p_stat, 50));
+  time_stat_format(pct[1], sizeof(pct[1]), time_stat_percentile(p_stat, 90));
+  time_stat_format(pct[2], sizeof(pct[2]), time_stat_percentile(p_stat, 99));
+  time_stat_format(pct[3], sizeof(pct[3]), time_stat_max(p_stat));
+  DRAW_ListPrintf(p_list, &DBG_INFO_FONT, offset, line_nb * DBG_INFO_FONT.height,
+                  "%*s%s : %s %s %s %s ", indent + 1, "", label, pct[0], pct[1], pct[2], pct[3]);
 }
 
-static void time_stat_display(time_stat_t *p_stat, uint8_t *p_buffer, char *label, int line_nb, int indent)
+static void bitrate_stat_display(bitrate_stat_t *p_stat, DRAW_List_t *p_list, char *label, int line_nb, int indent)
 {
-  int offset = VENC_WIDTH - 41 * DBG_INFO_FONT.width;
+  int offset = VENC_WIDTH - DBG_INFO_COLUMNS * DBG_INFO_FONT.width;
 
-  DRAW_PrintfArgbHw(&DBG_INFO_FONT, p_buffer, VENC_WIDTH, VENC_HEIGHT, offset, line_nb * DBG_INFO_FONT.height,
-                    "%*s%s : %3d ms / %5.1f ms ", indent + 1, "", label, p_stat->last, p_stat->mean);
+  DRAW_ListPrintf(p_list, &DBG_INFO_FONT, offset, line_nb * DBG_INFO_FONT.height,
+                  "%*s%s : %5d kbps %4u skip ", indent + 1, "", label, p_stat->bitrate / 1000,
+                  (unsigned int)p_stat->skip_nb);
 }
 
-static int build_display_nn_dbg(uint8_t *p_buffer, stat_info_t *si, int line_nb)
+static void psram_bw_display(stat_info_t *si, DRAW_List_t *p_list, char *label, int line_nb, int indent)
 {
-  time_stat_display(&si->nn_total_time, p_buffer,     "NN thread stats  ", line_nb++, 0);
-  time_stat_display(&si->nn_inference_time, p_buffer, "inference    ", line_nb++, 4);
+  int offset = VENC_WIDTH - DBG_INFO_COLUMNS * DBG_INFO_FONT.width;
+  float kb_per_frame = 0;
+  int i;
+
+  for (i = 0; i < BW_MASTER_NB; i++)
+    if (app_stats_bw_is_psram(i))
+      kb_per_frame += si->bw[i].mean / 1024;
+
+  DRAW_ListPrintf(p_list, &DBG_INFO_FONT, offset, line_nb * DBG_INFO_FONT.height,
+                  "%*s%s : %5d kB / frame     ", indent + 1, "", label, (int)kb_per_frame);
+}
+
+static int build_display_nn_dbg(DRAW_List_t *p_list, stat_info_t *si, int line_nb)
+{
+  time_stat_display(&si->nn_total_time, p_list,     "NN thread stats  ", line_nb++, 0);
+  time_stat_display(&si->nn_inference_time, p_list, "inference    ", line_nb++, 4);
+  time_stat_display(&si->nn_idle_time, p_list,      "npu idle     ", line_nb++, 4);
 
   return line_nb;
 }
 
-static int build_display_disp_dbg(uint8_t *p_buffer, stat_info_t *si, int line_nb)
+static int build_display_disp_dbg(DRAW_List_t *p_list, stat_info_t *si, int line_nb)
 {
-  time_stat_display(&si->disp_total_time, p_buffer,   "DISP thread stats", line_nb++, 0);
-  time_stat_display(&si->nn_pp_time, p_buffer,        "pp           " , line_nb++, 4);
-  time_stat_display(&si->disp_display_time, p_buffer, "display      ", line_nb++, 4);
-  time_stat_display(&si->disp_enc_time, p_buffer,     "encode       ", line_nb++, 4);
+  time_stat_display(&si->disp_total_time, p_list,   "DISP thread stats", line_nb++, 0);
+  time_stat_display(&si->nn_pp_time, p_list,        "pp           " , line_nb++, 4);
+  if (APP_NN_CASCADE)
+    time_stat_display(&si->nn_roi_time, p_list,     "roi          ", line_nb++, 4);
+  time_stat_display(&si->disp_display_time, p_list, "display      ", line_nb++, 4);
+  time_stat_display(&si->disp_enc_time, p_list,     "encode       ", line_nb++, 4);
+  time_stat_display(&si->glass_to_usb_time, p_list, "glass to usb ", line_nb++, 4);
+  time_stat_display(&si->uvc_drain_time, p_list,    "usb drain    ", line_nb++, 4);
+  bitrate_stat_display(&si->venc_bitrate, p_list,   "bitrate      ", line_nb++, 4);
+  psram_bw_display(si, p_list,                      "psram        ", line_nb++, 4);
 
   return line_nb;
 }
 
+/* Tasks in uxTaskGetSystemState() order, the ones not fitting in the region are skipped */
+static int build_display_cpu_dbg(DRAW_List_t *p_list, stat_info_t *si, int line_nb)
+{
+  int offset = VENC_WIDTH - DBG_INFO_COLUMNS * DBG_INFO_FONT.width;
+  int task_nb = MIN(si->cpu.task_nb, DBG_INFO_LINES - 1 - ISR_SRC_NB);
+  task_stat_t *p_task;
+  char stack[24];
+  int i;
+
+  for (i = 0; i < task_nb; i++) {
+    p_task = &si->cpu.task[i];
+    if (p_task->stack_size)
+      snprintf(stack, sizeof(stack), "%5u / %5u", (unsigned int)p_task->stack_free,
+               (unsigned int)p_task->stack_size);
+    else
+      snprintf(stack, sizeof(stack), "%5u", (unsigned int)p_task->stack_free);
+    DRAW_ListPrintf(p_list, &DBG_INFO_FONT, offset, line_nb++ * DBG_INFO_FONT.height,
+                    " %-10s : %5.1f %%  %-13s     ", p_task->name, p_task->load, stack);
+  }
+  for (i = 0; i < ISR_SRC_NB; i++)
+    DRAW_ListPrintf(p_list, &DBG_INFO_FONT, offset, line_nb++ * DBG_INFO_FONT.height,
+                    " isr %-6s : %5.1f %%  %5u max us      ", app_stats_isr_name(i), si->cpu.isr[i].load,
+                    (unsigned int)si->cpu.isr[i].max_us);
+
+  return line_nb;
+}
+
+static const char *dbg_info_header(void)
+{
+  switch (dbg_info_mode) {
+  case DBG_INFO_MEAN:
+    return " last      mean    ";
+  case DBG_INFO_CPU:
+    return "    cpu   free /  size     ";
+  default:
+    return " p50  p90  p99  max ";
+  }
+}
+
+/* USER1 cycles through off, last / mean, percentiles and cpu views */
 static int update_and_capture_debug_enabled(void)
 {
   static int prev_button_state = GPIO_PIN_RESET;
-  static int display_debug_enabled = 0;
   int cur_button_state;
 
   cur_button_state = BSP_PB_GetState(BUTTON_USER1);
-  if (cur_button_state == GPIO_PIN_SET && prev_button_state == GPIO_PIN_RESET)
-    display_debug_enabled = !display_debug_enabled;
+  if (cur_button_state == GPIO_PIN_SET && prev_button_state == GPIO_PIN_RESET) {
+    dbg_info_mode = (dbg_info_mode + 1) % DBG_INFO_MODE_NB;
+    /* Trace then covers the debug session */
+    if (dbg_info_mode == DBG_INFO_OFF)
+      app_trace_dump_request();
+  }
   prev_button_state = cur_button_state;
 
-  return display_debug_enabled;
+  return dbg_info_mode != DBG_INFO_OFF;
 }
 
-static int build_display_inference_info(uint8_t *p_buffer, uint32_t inf_time, int line_nb)
+static int build_display_inference_info(DRAW_List_t *p_list, uint32_t inf_time_us, int line_nb)
 {
   const int offset_x = 16;
 
-  DRAW_PrintfArgbHw(&INF_INFO_FONT, p_buffer, VENC_WIDTH, VENC_HEIGHT, offset_x, line_nb * INF_INFO_FONT.height,
-                    " Inference : %4.1f ms ", (double)inf_time);
+  DRAW_ListPrintf(p_list, &INF_INFO_FONT, offset_x, line_nb * INF_INFO_FONT.height,
+                   " Inference : %4.1f ms ", inf_time_us / 1000.0);
 
   return line_nb + 1;
 }
 
-static int build_display_cpu_load(uint8_t *p_buffer, int line_nb)
+static int build_display_cpu_load(DRAW_List_t *p_list, int line_nb)
 {
   const int offset_x = 16;
   float cpu_load_one_second;
 
   app_stats_cpuload_get(NULL, &cpu_load_one_second, NULL);
-  DRAW_PrintfArgbHw(&INF_INFO_FONT, p_buffer, VENC_WIDTH, VENC_HEIGHT, offset_x, line_nb * INF_INFO_FONT.height,
-                    " Cpu load  : %4.1f  %% ", cpu_load_one_second);
+  DRAW_ListPrintf(p_list, &INF_INFO_FONT, offset_x, line_nb * INF_INFO_FONT.height,
+                  " Cpu load  : %4.1f  %% ", cpu_load_one_second);
   line_nb++;
 
   return line_nb;
 }
 
-static void build_display_stat_info(uint8_t *p_buffer, stat_info_t *si)
+/* Returns list region content is recorded in, frame list itself without OVERLAY_REGIONS */
+static DRAW_List_t *overlay_region_begin(overlay_region_id_t id, DRAW_List_t *p_list, int x_pos, int y_pos,
+                                         int width, int height)
+{
+  int ret;
+
+  if (!OVERLAY_REGIONS)
+    return p_list;
+
+  ret = DRAW_RegionBegin(&overlay_regions[id], &overlay_region_list, &overlay_text_cache, x_pos, y_pos, width,
+                         height);
+  assert(ret == 0);
+
+  return &overlay_region_list;
+}
+
+static void overlay_region_end(overlay_region_id_t id, DRAW_List_t *p_list)
+{
+  if (!OVERLAY_REGIONS)
+    return;
+
+  DRAW_RegionEnd(&overlay_regions[id], &overlay_region_list);
+  app_stats_bw_add(BW_OVERLAY, overlay_region_list.byte_nb);
+  DRAW_ListRegion(p_list, &overlay_regions[id]);
+}
+
+static void build_display_stat_info(DRAW_List_t *p_list, stat_info_t *si)
 {
+  DRAW_List_t *p_region_list;
   int line_nb = 1;
 
   if (!update_and_capture_debug_enabled())
     return;
 
-  line_nb = build_display_nn_dbg(p_buffer, si, line_nb);
-  build_display_disp_dbg(p_buffer, si, line_nb);
+  p_region_list = overlay_region_begin(OVERLAY_REGION_DBG, p_list,
+                                       VENC_WIDTH - DBG_INFO_COLUMNS * DBG_INFO_FONT.width,
+                                       line_nb * DBG_INFO_FONT.height, DBG_INFO_COLUMNS * DBG_INFO_FONT.width,
+                                       DBG_INFO_LINES * DBG_INFO_FONT.height);
+  DRAW_ListPrintf(p_region_list, &DBG_INFO_FONT, VENC_WIDTH - DBG_INFO_COLUMNS * DBG_INFO_FONT.width,
+                  line_nb++ * DBG_INFO_FONT.height, "%*s", DBG_INFO_COLUMNS, dbg_info_header());
+  if (dbg_info_mode == DBG_INFO_CPU) {
+    build_display_cpu_dbg(p_region_list, si, line_nb);
+  } else {
+    line_nb = build_display_nn_dbg(p_region_list, si, line_nb);
+    build_display_disp_dbg(p_region_list, si, line_nb);
+  }
+  overlay_region_end(OVERLAY_REGION_DBG, p_list);
 }
 
-static void build_display(uint8_t *p_buffer, od_pp_out_t *pp_out)
+static void build_display_overlay(DRAW_List_t *p_list, od_pp_out_t *pp_out)
 {
   const uint8_t *fig_array[] = {fig0, fig1, fig2, fig3, fig4, fig5, fig6, fig7, fig8, fig9};
   int line_nb = VENC_HEIGHT / INF_INFO_FONT.height - 4;
-  stat_info_t si_copy;
+  DRAW_List_t *p_region_list;
+  /* Too large for dp thread stack */
+  static stat_info_t si_copy;
   int nb;
   int i;
 
   stat_info_copy(&si_copy);
 
   for (i = 0; i < pp_out->nb_detect; i++)
-    draw_box(p_buffer, &pp_out->pOutBuff[i]);
+    draw_box(p_list, &pp_out->pOutBuff[i]);
 
-  line_nb = build_display_inference_info(p_buffer, si_copy.nn_inference_time.last, line_nb);
-  line_nb = build_display_cpu_load(p_buffer, line_nb);
+  p_region_list = overlay_region_begin(OVERLAY_REGION_INF, p_list, 16, line_nb * INF_INFO_FONT.height,
+                                       INF_INFO_COLUMNS * INF_INFO_FONT.width, INF_INFO_LINES * INF_INFO_FONT.height);
+  line_nb = build_display_inference_info(p_region_list, si_copy.nn_inference_time.last, line_nb);
+  line_nb = build_display_cpu_load(p_region_list, line_nb);
+  overlay_region_end(OVERLAY_REGION_INF, p_list);
 
   nb = MIN(pp_out->nb_detect, ARRAY_NB(fig_array) - 1);
-  DRAW_CopyArgbHW(p_buffer, VENC_WIDTH, VENC_HEIGHT, (uint8_t *) fig_array[nb], 64, 64, 16, 16);
+  DRAW_ListCopy(p_list, (uint8_t *) fig_array[nb], 64, 64, 16, 16);
 
-  build_display_stat_info(p_buffer, &si_copy);
+  build_display_stat_info(p_list, &si_copy);
 }
 
-static size_t encode_display(int is_intra_force, uint8_t *p_buffer)
+/* Overlay is queued to DMA2D while it is recorded. Caller waits for it with build_display_wait() */
+static void build_display(uint8_t *p_buffer, od_pp_out_t *pp_out)
 {
-  size_t res;
+  DRAW_ListBeginFormat(&overlay_list, p_buffer, VENC_WIDTH, VENC_HEIGHT, OVERLAY_DST_FORMAT, &overlay_text_cache);
+  build_display_overlay(&overlay_list, pp_out);
+  DRAW_ListSubmit(&overlay_list);
+}
 
-  res = ENC_EncodeFrame(p_buffer, venc_out_buffer, VENC_OUT_BUFFER_SIZE, is_intra_force);
-  if ((int)res > 0 && buffer_flying) {
-    force_intra = 1;
-    return (size_t)-1;
-  }
+static void build_display_wait(void)
+{
+  DRAW_ListWait(&overlay_list);
+  app_stats_bw_add(BW_OVERLAY, overlay_list.byte_nb);
+}
 
-  if ((int)res <= 0)
+static int uvc_slot_is_free(void)
+{
+  return uvc_slot_used_nb - uvc_slot_released_nb < VENC_OUT_BUFFER_NB;
+}
+
+/* Forget frames UVCL has not accepted, e.g. across a streaming restart */
+static void uvc_slot_drop_pending(void)
+{
+  uvc_slot_used_nb = uvc_slot_submitted_nb;
+}
+
+/* Called from encoder each time a slice is written. The frame is handed to UVCL on its first
+ * slice when all older frames are already submitted, then UVCL follows progress.frame_size.
+ */
+static void encode_display_slice_ready(void *cb_arg, size_t len)
+{
+  uvc_slot_t *slot = cb_arg;
+  int idx = slot - uvc_slots;
+  int ret;
+
+  slot->progress.frame_size = len;
+  if (uvc_slot_submitted_nb + 1 != uvc_slot_used_nb)
+    return;
+
+  /* Counted before UVCL owns the frame, its release can come before UVCL_ShowFrameProgressive() returns */
+  slot->submit_ts = app_stats_timestamp();
+  uvc_slot_submitted_nb++;
+  __DMB();
+  ret = UVCL_ShowFrameProgressive(venc_out_buffers[idx], &slot->progress);
+  if (ret != 0)
+    uvc_slot_submitted_nb--;
+}
+
+static ENC_Codec_t stream_codec(const UVCL_StreamConf_t *stream)
+{
+  return stream->payload_type == UVCL_PAYLOAD_FB_JPEG ? ENC_CODEC_JPEG : ENC_CODEC_H264;
+}
+
+/* H264 reads one reference and writes the reconstructed frame, both YUV420. Motion search
+ * refetch is not counted.
+ */
+static void encode_display_bw_add(int len)
+{
+  uint32_t pixel_nb = VENC_WIDTH * VENC_HEIGHT;
+
+  app_stats_bw_add(BW_VENC_IN, CAPTURE_FRAME_SIZE(VENC_WIDTH, VENC_HEIGHT));
+  if (stream_codec(&uvc_stream_cur) == ENC_CODEC_H264)
+    app_stats_bw_add(BW_VENC_REF, 2 * pixel_nb * 3 / 2);
+  app_stats_bw_add(BW_VENC_OUT, len);
+}
+
+static int encode_display(int is_intra_force, uint8_t *p_buffer, const bqueue_meta_t *meta)
+{
+  int idx = uvc_slot_used_nb % VENC_OUT_BUFFER_NB;
+  uvc_slot_t *slot = &uvc_slots[idx];
+  int res;
+
+  slot->progress.frame_size = 0;
+  slot->progress.is_complete = 0;
+  slot->progress.is_error = 0;
+  slot->capture_ts = meta->capture_ts;
+  slot->frame_id = meta->frame_id;
+  uvc_slot_used_nb++;
+
+  res = ENC_EncodeFrameSliced(p_buffer, venc_out_buffers[idx], VENC_OUT_BUFFER_SIZE, is_intra_force,
+                              encode_display_slice_ready, slot);
+  if (res <= 0 && uvc_slot_submitted_nb != uvc_slot_used_nb) {
+    uvc_slot_used_nb--;
+    force_intra = is_intra_force;
+    return res;
+  }
+  /* Head of the frame is already on the wire. UVCL drops it and releases the slot, next frame is an intra */
+  if (res <= 0) {
+    force_intra = 1;
+    slot->progress.is_error = 1;
+    __DMB();
+    slot->progress.is_complete = 1;
     return res;
+  }
 
-  memcpy(&uvc_in_buffers, venc_out_buffer, res);
+  slot->progress.frame_size = res;
+  __DMB();
+  slot->progress.is_complete = 1;
+  encode_display_bw_add(res);
 
   return res;
 }
 
-static int send_display(int len)
+/* UVCL takes one frame while another is on the wire. Frames it refuses stay in
+ * their slot and are retried on next render, so no encoded frame is ever lost.
+ */
+static void send_display(void)
 {
+  uvc_slot_t *slot;
+  int idx;
   int ret;
 
-  buffer_flying = 1;
-  ret = UVCL_ShowFrame(uvc_in_buffers, len);
-  if (ret != 0)
-    buffer_flying = 0;
+  while (uvc_slot_submitted_nb != uvc_slot_used_nb) {
+    idx = uvc_slot_submitted_nb % VENC_OUT_BUFFER_NB;
+    slot = &uvc_slots[idx];
+    if (!slot->progress.is_complete)
+      break;
+    /* Same ordering as encode_display_slice_ready() */
+    slot->submit_ts = app_stats_timestamp();
+    uvc_slot_submitted_nb++;
+    __DMB();
+    ret = UVCL_ShowFrame(venc_out_buffers[idx], slot->progress.frame_size);
+    if (ret != 0) {
+      uvc_slot_submitted_nb--;
+      break;
+    }
+  }
+}
 
-  return ret;
+static void publish_rate_control(void)
+{
+  int ret;
+
+  ret = xSemaphoreTake(rc_lock, portMAX_DELAY);
+  assert(ret == pdTRUE);
+  ENC_GetRateControl(&rc_current);
+  ret = xSemaphoreGive(rc_lock);
+  assert(ret == pdTRUE);
+}
+
+static void adapt_bitrate_reset(void)
+{
+  bitrate_ctrl_init(&bitrate_ctrl, rc_target.bitrate, venc_fps);
+}
+
+/* Encoder is only driven by dp thread, so requests from other tasks are applied here */
+static void apply_rate_control(void)
+{
+  ENC_RateCtrl_t rc;
+  int is_pending;
+  int ret;
+
+  ret = xSemaphoreTake(rc_lock, portMAX_DELAY);
+  assert(ret == pdTRUE);
+  rc = rc_request;
+  is_pending = rc_request_pending;
+  rc_request_pending = 0;
+  ret = xSemaphoreGive(rc_lock);
+  assert(ret == pdTRUE);
+
+  if (!is_pending)
+    return;
+
+  /* An invalid request leaves current setting in place */
+  ret = ENC_SetRateControl(&rc);
+  if (ret)
+    return;
+
+  ENC_GetRateControl(&rc_target);
+  adapt_bitrate_reset();
+  publish_rate_control();
+}
+
+static void adapt_bitrate_apply(void)
+{
+  ENC_RateCtrl_t rc = rc_target;
+  int ret;
+
+  rc.bitrate = bitrate_ctrl.bitrate;
+  rc.qp_min = MIN(rc_target.qp_min + bitrate_ctrl.qp_min_delta, rc_target.qp_max);
+  ret = ENC_SetRateControl(&rc);
+  if (ret)
+    return;
+
+  publish_rate_control();
+}
+
+/* Feed controller with drain time of frames released since last call */
+static void adapt_bitrate_update(int is_skip)
+{
+  stat_info_t *stats = app_stats_state();
+  bitrate_stat_t bitrate_stat;
+  int is_changed = 0;
+  uvc_slot_t *slot;
+
+  while (uvc_slot_drained_nb != uvc_slot_released_nb) {
+    slot = &uvc_slots[uvc_slot_drained_nb % VENC_OUT_BUFFER_NB];
+    time_stat_update(&stats->uvc_drain_time, slot->drain_us);
+    is_changed |= bitrate_ctrl_on_drain(&bitrate_ctrl, slot->drain_us);
+    uvc_slot_drained_nb++;
+  }
+  if (is_skip) {
+    bitrate_ctrl_skip_nb++;
+    is_changed |= bitrate_ctrl_on_skip(&bitrate_ctrl);
+  }
+
+  if (is_changed && VENC_ADAPTIVE_BITRATE && rc_target.mode != ENC_RATE_CTRL_CQP)
+    adapt_bitrate_apply();
+
+  bitrate_stat.bitrate = rc_current.bitrate;
+  bitrate_stat.decrease_nb = bitrate_ctrl.decrease_nb;
+  bitrate_stat.increase_nb = bitrate_ctrl.increase_nb;
+  bitrate_stat.skip_nb = bitrate_ctrl_skip_nb;
+  bitrate_stat_update(&stats->venc_bitrate, &bitrate_stat);
+}
+
+static int is_same_stream(const UVCL_StreamConf_t *a, const UVCL_StreamConf_t *b)
+{
+  return a->payload_type == b->payload_type && a->width == b->width && a->height == b->height &&
+         a->fps == b->fps;
+}
+
+/* Resize display pipe and restart encoder for the new stream. Bitrate and gop follow the
+ * pixel rate and fps ratios so rate control settings made at runtime are kept. They restart
+ * from build configuration when codec changes.
+ */
+static void stream_reconfigure(const UVCL_StreamConf_t *stream)
+{
+  uint64_t pixel_rate_prev = (uint64_t) uvc_stream_cur.width * uvc_stream_cur.height * uvc_stream_cur.fps;
+  uint64_t pixel_rate = (uint64_t) stream->width * stream->height * stream->fps;
+  ENC_Conf_t enc_conf = enc_conf_base;
+  ENC_RateCtrl_t rc = rc_target;
+  int fps_prev = uvc_stream_cur.fps;
+  int ret;
+
+  if (stream_codec(stream) != stream_codec(&uvc_stream_cur)) {
+    pixel_rate_prev = (uint64_t) enc_conf_base.width * enc_conf_base.height * enc_conf_base.fps;
+    fps_prev = enc_conf_base.fps;
+    rc = enc_conf_base.rate_ctrl;
+  }
+
+  if (stream->width != uvc_stream_cur.width || stream->height != uvc_stream_cur.height) {
+    ret = CAM_DisplayPipe_SetSize(stream->width, stream->height);
+    assert(ret == 0);
+  }
+
+  enc_conf.width = stream->width;
+  enc_conf.height = stream->height;
+  enc_conf.fps = stream->fps;
+  enc_conf.codec = stream_codec(stream);
+  enc_conf.rate_ctrl = rc;
+  enc_conf.rate_ctrl.bitrate = (rc.bitrate * pixel_rate) / pixel_rate_prev;
+  if (rc.gop_size)
+    enc_conf.rate_ctrl.gop_size = MAX((rc.gop_size * stream->fps) / fps_prev, 1);
+  ENC_DeInit();
+  ENC_Init(&enc_conf);
+
+  ENC_GetRateControl(&rc_target);
+  venc_fps = stream->fps;
+  adapt_bitrate_reset();
+  publish_rate_control();
+
+  uvc_stream_cur = *stream;
+  /* Frames captured before pipe resume have previous size */
+  uvc_stream_switch_ts = app_stats_timestamp();
+  uvc_stream_is_switching = 1;
+}
+
+/* Drop frames captured with previous configuration and decimate camera rate down to stream fps */
+static int stream_is_frame_dropped(uint32_t capture_ts)
+{
+  int period_us = 1000000 / uvc_stream_cur.fps;
+  int camera_period_us = 1000000 / CAMERA_FPS;
+  int elapsed_us;
+
+  if (uvc_stream_is_switching && (int32_t)(capture_ts - uvc_stream_switch_ts) < 0)
+    return 1;
+  uvc_stream_is_switching = 0;
+  if (!uvc_stream_is_started || uvc_stream_cur.fps >= CAMERA_FPS)
+    return 0;
+
+  elapsed_us = app_stats_cycles_to_us(capture_ts - uvc_stream_last_ts);
+
+  return elapsed_us < period_us - camera_period_us / 2;
 }
 
 static void app_uvc_streaming_active(struct uvcl_callbacks *cbs, UVCL_StreamConf_t stream)
 {
   (void)cbs;
-  (void)stream;
+  uvc_stream_req = stream;
+  uvc_stream_start_nb++;
   uvc_is_active = 1;
   BSP_LED_On(LED_RED);
 }
@@ -271,11 +751,27 @@ static void app_uvc_streaming_inactive(struct uvcl_callbacks *cbs)
 
 static void app_uvc_frame_release(struct uvcl_callbacks *cbs, void *frame)
 {
-  (void)cbs;
-  (void)frame;
-  assert(buffer_flying);
+  int idx = uvc_slot_released_nb % VENC_OUT_BUFFER_NB;
+  uint32_t start;
+  uint32_t now;
 
-  buffer_flying = 0;
+  (void)cbs;
+  assert(uvc_slot_released_nb != uvc_slot_submitted_nb);
+  assert(frame == venc_out_buffers[idx]);
+
+  /* Frame goes on the wire once submitted and previous one is released */
+  now = app_stats_timestamp();
+  start = uvc_slots[idx].submit_ts;
+  if ((int32_t)(uvc_last_release_ts - start) > 0)
+    start = uvc_last_release_ts;
+  uvc_slots[idx].drain_us = app_stats_cycles_to_us(now - start);
+  uvc_last_release_ts = now;
+
+  /* Stats are updated from task context on next render. An aborted frame never reached the host */
+  if (!uvc_slots[idx].progress.is_error)
+    glass_to_usb_us = app_stats_elapsed_us(uvc_slots[idx].capture_ts);
+  app_trace_instant(TRACE_UVC_RELEASE, uvc_slots[idx].frame_id);
+  uvc_slot_released_nb++;
 }
 
 void app_display_init(void)
@@ -286,14 +782,26 @@ void app_display_init(void)
   assert(dma2d_sem);
   dma2d_lock = xSemaphoreCreateMutexStatic(&dma2d_lock_buffer);
   assert(dma2d_lock);
+  rc_lock = xSemaphoreCreateMutexStatic(&rc_lock_buffer);
+  assert(rc_lock);
 
-  ret = DRAW_FontSetup(&Font12, &font_12);
+  ret = DRAW_FontSetupFormat(&Font12, &font_12, OVERLAY_FONT_FORMAT);
   assert(ret == 0);
-  ret = DRAW_FontSetup(&Font16, &font_16);
+  ret = DRAW_FontSetupFormat(&Font16, &font_16, OVERLAY_FONT_FORMAT);
   assert(ret == 0);
-
-  buffer_flying = 0;
-  force_intra = 0;
+  /* A background box would cost one more blended fill per string */
+  DRAW_FontSetColor(&font_12, OVERLAY_TEXT_COLOR, 0);
+  DRAW_FontSetColor(&font_16, OVERLAY_TEXT_COLOR, 0);
+  DRAW_TextCacheInit(&overlay_text_cache, overlay_text_strips);
+  DRAW_RegionInit(&overlay_regions[OVERLAY_REGION_INF], overlay_region_inf_buf, sizeof(overlay_region_inf_buf));
+  DRAW_RegionInit(&overlay_regions[OVERLAY_REGION_DBG], overlay_region_dbg_buf, sizeof(overlay_region_dbg_buf));
+
+  uvc_slot_used_nb = 0;
+  uvc_slot_submitted_nb = 0;
+  uvc_slot_released_nb = 0;
+  uvc_slot_drained_nb = 0;
+  bitrate_ctrl_skip_nb = 0;
+  glass_to_usb_us = -1;
   uvc_is_active = 0;
 }
 
@@ -304,6 +812,15 @@ int app_display_setup(const ENC_Conf_t *enc_conf, const UVCL_Conf_t *uvcl_conf)
   int ret;
 
   ENC_Init(&enc_local);
+  ENC_GetRateControl(&rc_target);
+  venc_fps = enc_conf->fps;
+  enc_conf_base = *enc_conf;
+  uvc_stream_cur.width = enc_conf->width;
+  uvc_stream_cur.height = enc_conf->height;
+  uvc_stream_cur.fps = enc_conf->fps;
+  uvc_stream_cur.payload_type = enc_conf->codec == ENC_CODEC_JPEG ? UVCL_PAYLOAD_FB_JPEG : UVCL_PAYLOAD_FB_H264;
+  adapt_bitrate_reset();
+  publish_rate_control();
 
   uvcl_cbs.streaming_active = app_uvc_streaming_active;
   uvcl_cbs.streaming_inactive = app_uvc_streaming_inactive;
@@ -313,35 +830,97 @@ int app_display_setup(const ENC_Conf_t *enc_conf, const UVCL_Conf_t *uvcl_conf)
   return ret;
 }
 
-int app_display_render(uint8_t *frame_buffer, od_pp_out_t *pp_out)
+int app_display_render(uint8_t *frame_buffer, const bqueue_meta_t *meta, od_pp_out_t *pp_out)
 {
   static int uvc_is_active_prev = 0;
   stat_info_t *stats = app_stats_state();
+  int is_intra_force;
+  int is_skip;
   uint32_t ts;
   int len;
 
+  if (glass_to_usb_us >= 0) {
+    time_stat_update(&stats->glass_to_usb_time, glass_to_usb_us);
+    glass_to_usb_us = -1;
+  }
+
   if (!uvc_is_active) {
     uvc_is_active_prev = uvc_is_active;
     return 0;
   }
 
-  ts = HAL_GetTick();
-  build_display(frame_buffer, pp_out);
-  time_stat_update(&stats->disp_display_time, HAL_GetTick() - ts);
+  /* Stream restarts on an intra frame, with pipeline matching the stream host committed. Host
+   * may stop and start again between two frames.
+   */
+  if (!uvc_is_active_prev || uvc_stream_start_nb != uvc_stream_start_nb_seen) {
+    uvc_stream_start_nb_seen = uvc_stream_start_nb;
+    force_intra = 1;
+    uvc_slot_drop_pending();
+    uvc_stream_is_started = 0;
+    if (!is_same_stream(&uvc_stream_req, &uvc_stream_cur))
+      stream_reconfigure(&uvc_stream_req);
+  }
+  send_display();
 
-  ts = HAL_GetTick();
-  len = (int)encode_display(!uvc_is_active_prev || force_intra, frame_buffer);
-  time_stat_update(&stats->disp_enc_time, HAL_GetTick() - ts);
+  if (stream_is_frame_dropped(meta->capture_ts))
+    return 0;
 
-  if (len > 0)
-    send_display(len);
+  /* Skip the frame before encoding when USB lags so the P frame chain stays intact */
+  is_skip = !uvc_slot_is_free();
+  adapt_bitrate_update(is_skip);
+  if (is_skip)
+    return 0;
 
+  ts = app_stats_timestamp();
+  app_trace_begin(TRACE_DISP_DISPLAY, meta->frame_id);
+  build_display(frame_buffer, pp_out);
+  apply_rate_control();
+  /* Encoder reads overlay from frame buffer */
+  build_display_wait();
+  app_trace_end(TRACE_DISP_DISPLAY, meta->frame_id);
+  time_stat_update(&stats->disp_display_time, app_stats_elapsed_us(ts));
+
+  ts = app_stats_timestamp();
+  app_trace_begin(TRACE_DISP_ENC, meta->frame_id);
+  is_intra_force = !uvc_is_active_prev || force_intra;
   force_intra = 0;
+  uvc_stream_last_ts = meta->capture_ts;
+  uvc_stream_is_started = 1;
+  len = encode_display(is_intra_force, frame_buffer, meta);
+  app_trace_end(TRACE_DISP_ENC, meta->frame_id);
+  time_stat_update(&stats->disp_enc_time, app_stats_elapsed_us(ts));
+
+  if (len > 0)
+    send_display();
+
   uvc_is_active_prev = uvc_is_active;
 
   return uvc_is_active;
 }
 
+void app_display_set_rate_control(const ENC_RateCtrl_t *rc)
+{
+  int ret;
+
+  ret = xSemaphoreTake(rc_lock, portMAX_DELAY);
+  assert(ret == pdTRUE);
+  rc_request = *rc;
+  rc_request_pending = 1;
+  ret = xSemaphoreGive(rc_lock);
+  assert(ret == pdTRUE);
+}
+
+void app_display_get_rate_control(ENC_RateCtrl_t *rc)
+{
+  int ret;
+
+  ret = xSemaphoreTake(rc_lock, portMAX_DELAY);
+  assert(ret == pdTRUE);
+  *rc = rc_current;
+  ret = xSemaphoreGive(rc_lock);
+  assert(ret == pdTRUE);
+}
+
 void DRAW_HwLock(void *dma2d_handle)
 {
   int ret;
@@ -18,18 +18,59 @@
 
 #include "svc/app_stats.h"
 
-#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "FreeRTOS.h"
-#include "semphr.h"
 #include "task.h"
 #include "stm32n6xx_hal.h"
 
-static SemaphoreHandle_t stat_info_lock;
-static StaticSemaphore_t stat_info_lock_buffer;
+#define TIME_STAT_LINEAR_NB 16
+#define TIME_STAT_OCTAVE_MIN 4
+#define TIME_STAT_OCTAVE_MAX 25
+#define TIME_STAT_OCTAVE_SUB_NB 8
+#define CPU_DUMP_LINE_SIZE 160
+
 static stat_info_t stat_info;
 static cpuload_info_t cpu_load;
+/* Free running counters, wrap is handled by 32 bits deltas */
+static volatile uint32_t bw_counters[BW_MASTER_NB];
+static uint32_t bw_counters_prev[BW_MASTER_NB];
+static uint32_t bw_update_tick;
+/* Written by a single handler each, max is reset by app_stats_task_update() */
+static volatile uint32_t isr_cycles[ISR_SRC_NB];
+static volatile uint32_t isr_counts[ISR_SRC_NB];
+static volatile uint32_t isr_max_cycles[ISR_SRC_NB];
+static const char *const isr_names[ISR_SRC_NB] = {
+  [ISR_CAMERA] = "camera",
+  [ISR_USB] = "usb",
+  [ISR_DMA2D] = "dma2d",
+};
+static struct {
+  TaskHandle_t hdl;
+  uint32_t stack_size;
+} task_stacks[TASK_STAT_MAX_NB];
+static int task_stack_nb;
+/* Counters of previous sample, matched by handle as the task list order is not stable */
+static struct {
+  TaskHandle_t hdl;
+  configRUN_TIME_COUNTER_TYPE run_time;
+} task_prev[TASK_STAT_MAX_NB];
+static int task_prev_nb;
+static configRUN_TIME_COUNTER_TYPE task_prev_total;
+static uint32_t isr_cycles_prev[ISR_SRC_NB];
+static uint32_t isr_counts_prev[ISR_SRC_NB];
+static uint32_t task_update_tick;
+static TaskStatus_t task_status[TASK_STAT_MAX_NB];
+static const uint8_t bw_is_psram[BW_MASTER_NB] = {
+  [BW_CAPTURE_DISPLAY] = 1,
+  [BW_CAPTURE_NN] = 1,
+  [BW_NN_IN] = 1,
+  [BW_VENC_IN] = 1,
+  [BW_VENC_REF] = 1,
+  [BW_OVERLAY] = 1,
+};
 
 static void cpuload_init(cpuload_info_t *cpu_load_init)
 {
@@ -67,13 +108,50 @@ static void cpuload_get_info(cpuload_info_t *cpu_load_info, float *cpu_load_last
                      (cpu_load_info->history[2].total - cpu_load_info->history[7].total);
 }
 
-void app_stats_init(void)
+/* Seqlock: counter is odd during an update, reader copies again when it moved */
+static void stat_write_begin(uint32_t *p_seq)
+{
+  *(volatile uint32_t *) p_seq += 1;
+  __DMB();
+}
+
+static void stat_write_end(uint32_t *p_seq)
+{
+  __DMB();
+  *(volatile uint32_t *) p_seq += 1;
+}
+
+/* Spins while a writer is mid update, which never lasts as readers do not preempt writers */
+static void stat_read(void *dst, const void *src, size_t size, const uint32_t *p_seq)
 {
-  stat_info_lock = xSemaphoreCreateMutexStatic(&stat_info_lock_buffer);
-  assert(stat_info_lock);
+  uint32_t seq;
 
+  do {
+    do {
+      seq = *(const volatile uint32_t *) p_seq;
+    } while (seq & 1);
+    __DMB();
+    memcpy(dst, src, size);
+    __DMB();
+  } while (*(const volatile uint32_t *) p_seq != seq);
+}
+
+void app_stats_init(void)
+{
   memset(&stat_info, 0, sizeof(stat_info));
   cpuload_init(&cpu_load);
+  memset((void *) bw_counters, 0, sizeof(bw_counters));
+  memset(bw_counters_prev, 0, sizeof(bw_counters_prev));
+  bw_update_tick = HAL_GetTick();
+  memset((void *) isr_cycles, 0, sizeof(isr_cycles));
+  memset((void *) isr_counts, 0, sizeof(isr_counts));
+  memset((void *) isr_max_cycles, 0, sizeof(isr_max_cycles));
+  memset(isr_cycles_prev, 0, sizeof(isr_cycles_prev));
+  memset(isr_counts_prev, 0, sizeof(isr_counts_prev));
+  task_stack_nb = 0;
+  task_prev_nb = 0;
+  task_prev_total = portGET_RUN_TIME_COUNTER_VALUE();
+  task_update_tick = HAL_GetTick();
 }
 
 stat_info_t *app_stats_state(void)
@@ -81,33 +159,177 @@ stat_info_t *app_stats_state(void)
   return &stat_info;
 }
 
-void time_stat_update(time_stat_t *p_stat, int value)
+static int time_stat_bucket(uint32_t value)
 {
-  int ret;
+  int octave;
+
+  if (value < TIME_STAT_LINEAR_NB)
+    return value;
 
-  ret = xSemaphoreTake(stat_info_lock, portMAX_DELAY);
-  assert(ret == pdTRUE);
+  octave = 31 - __builtin_clz(value);
+  if (octave > TIME_STAT_OCTAVE_MAX)
+    return TIME_STAT_BUCKET_NB - 1;
+
+  return TIME_STAT_LINEAR_NB + (octave - TIME_STAT_OCTAVE_MIN) * TIME_STAT_OCTAVE_SUB_NB +
+         ((value >> (octave - 3)) & (TIME_STAT_OCTAVE_SUB_NB - 1));
+}
 
+static uint32_t time_stat_bucket_max(int idx)
+{
+  int octave;
+  int sub;
+
+  if (idx < TIME_STAT_LINEAR_NB)
+    return idx;
+
+  octave = (idx - TIME_STAT_LINEAR_NB) / TIME_STAT_OCTAVE_SUB_NB + TIME_STAT_OCTAVE_MIN;
+  sub = (idx - TIME_STAT_LINEAR_NB) % TIME_STAT_OCTAVE_SUB_NB;
+
+  return ((TIME_STAT_OCTAVE_SUB_NB + sub + 1) << (octave - 3)) - 1;
+}
+
+/* Windows alternate, the oldest one is cleared when the current one is full */
+static void time_stat_hist_add(time_stat_t *p_stat, uint32_t value)
+{
+  time_hist_t *hist = &p_stat->hist[p_stat->hist_cur];
+
+  if (hist->nb == TIME_STAT_WINDOW) {
+    hist = &p_stat->hist[!p_stat->hist_cur];
+    memset(hist, 0, sizeof(*hist));
+    p_stat->hist_cur = !p_stat->hist_cur;
+  }
+  hist->bucket[time_stat_bucket(value)]++;
+  hist->nb++;
+  if (value > hist->max)
+    hist->max = value;
+}
+
+void time_stat_update(time_stat_t *p_stat, int value)
+{
+  stat_write_begin(&p_stat->seq);
+
+  time_stat_hist_add(p_stat, value < 0 ? 0 : value);
   p_stat->last = value;
   p_stat->acc += value;
   p_stat->total++;
   p_stat->mean = (float)p_stat->acc / p_stat->total;
 
-  ret = xSemaphoreGive(stat_info_lock);
-  assert(ret == pdTRUE);
+  stat_write_end(&p_stat->seq);
+}
+
+uint32_t time_stat_percentile(const time_stat_t *p_stat, int pct)
+{
+  uint32_t nb = p_stat->hist[0].nb + p_stat->hist[1].nb;
+  uint32_t max = time_stat_max(p_stat);
+  uint32_t rank;
+  uint32_t acc = 0;
+  int i;
+
+  if (!nb)
+    return 0;
+
+  rank = (nb * pct + 99) / 100;
+  for (i = 0; i < TIME_STAT_BUCKET_NB; i++) {
+    acc += p_stat->hist[0].bucket[i] + p_stat->hist[1].bucket[i];
+    if (acc >= rank)
+      return time_stat_bucket_max(i) < max ? time_stat_bucket_max(i) : max;
+  }
+
+  return max;
+}
+
+uint32_t time_stat_max(const time_stat_t *p_stat)
+{
+  return p_stat->hist[0].max > p_stat->hist[1].max ? p_stat->hist[0].max : p_stat->hist[1].max;
+}
+
+/* value->seq is ignored */
+void bitrate_stat_update(bitrate_stat_t *p_stat, const bitrate_stat_t *value)
+{
+  stat_write_begin(&p_stat->seq);
+
+  p_stat->bitrate = value->bitrate;
+  p_stat->decrease_nb = value->decrease_nb;
+  p_stat->increase_nb = value->increase_nb;
+  p_stat->skip_nb = value->skip_nb;
+
+  stat_write_end(&p_stat->seq);
+}
+
+void roi_stat_update(roi_stat_t *p_stat, int run_nb, int skip_nb)
+{
+  stat_write_begin(&p_stat->seq);
+
+  p_stat->frame_nb++;
+  p_stat->run_nb += run_nb;
+  p_stat->skip_nb += skip_nb;
+  p_stat->last = run_nb;
+
+  stat_write_end(&p_stat->seq);
+}
+
+static void time_stat_copy(time_stat_t *dst, const time_stat_t *src)
+{
+  stat_read(dst, src, sizeof(*dst), &src->seq);
 }
 
 void stat_info_copy(stat_info_t *copy)
 {
-  int ret;
+  time_stat_copy(&copy->nn_total_time, &stat_info.nn_total_time);
+  time_stat_copy(&copy->nn_inference_time, &stat_info.nn_inference_time);
+  time_stat_copy(&copy->nn_prepare_time, &stat_info.nn_prepare_time);
+  time_stat_copy(&copy->nn_idle_time, &stat_info.nn_idle_time);
+  time_stat_copy(&copy->disp_total_time, &stat_info.disp_total_time);
+  time_stat_copy(&copy->nn_pp_time, &stat_info.nn_pp_time);
+  time_stat_copy(&copy->nn_roi_time, &stat_info.nn_roi_time);
+  time_stat_copy(&copy->disp_display_time, &stat_info.disp_display_time);
+  time_stat_copy(&copy->disp_enc_time, &stat_info.disp_enc_time);
+  time_stat_copy(&copy->glass_to_usb_time, &stat_info.glass_to_usb_time);
+  time_stat_copy(&copy->uvc_drain_time, &stat_info.uvc_drain_time);
+  stat_read(&copy->venc_bitrate, &stat_info.venc_bitrate, sizeof(copy->venc_bitrate), &stat_info.venc_bitrate.seq);
+  stat_read(&copy->roi, &stat_info.roi, sizeof(copy->roi), &stat_info.roi.seq);
+  stat_read(&copy->cpu, &stat_info.cpu, sizeof(copy->cpu), &stat_info.cpu.seq);
+  /* bw and bw_elapsed_ms are contiguous and share bw_seq */
+  stat_read(&copy->bw_seq, &stat_info.bw_seq, sizeof(*copy) - offsetof(stat_info_t, bw_seq), &stat_info.bw_seq);
+}
+
+void app_stats_bw_add(bw_master_t master, uint32_t bytes)
+{
+  bw_counters[master] += bytes;
+}
+
+void app_stats_bw_update(void)
+{
+  uint32_t delta[BW_MASTER_NB];
+  uint32_t now = HAL_GetTick();
+  uint32_t counter;
+  bw_stat_t *p_stat;
+  int i;
+
+  for (i = 0; i < BW_MASTER_NB; i++) {
+    counter = bw_counters[i];
+    delta[i] = counter - bw_counters_prev[i];
+    bw_counters_prev[i] = counter;
+  }
+
+  stat_write_begin(&stat_info.bw_seq);
 
-  ret = xSemaphoreTake(stat_info_lock, portMAX_DELAY);
-  assert(ret == pdTRUE);
+  for (i = 0; i < BW_MASTER_NB; i++) {
+    p_stat = &stat_info.bw[i];
+    p_stat->last = delta[i];
+    p_stat->acc += delta[i];
+    p_stat->total++;
+    p_stat->mean = (float)p_stat->acc / p_stat->total;
+  }
+  stat_info.bw_elapsed_ms += now - bw_update_tick;
+  bw_update_tick = now;
 
-  *copy = stat_info;
+  stat_write_end(&stat_info.bw_seq);
+}
 
-  ret = xSemaphoreGive(stat_info_lock);
-  assert(ret == pdTRUE);
+int app_stats_bw_is_psram(bw_master_t master)
+{
+  return bw_is_psram[master];
 }
 
 void app_stats_cpuload_update(void)
@@ -119,3 +341,170 @@ void app_stats_cpuload_get(float *cpu_load_last, float *cpu_load_last_second, fl
 {
   cpuload_get_info(&cpu_load, cpu_load_last, cpu_load_last_second, cpu_load_last_five_seconds);
 }
+
+void app_stats_task_register(TaskHandle_t hdl, uint32_t stack_depth)
+{
+  if (task_stack_nb == TASK_STAT_MAX_NB)
+    return;
+
+  task_stacks[task_stack_nb].hdl = hdl;
+  task_stacks[task_stack_nb].stack_size = stack_depth * sizeof(StackType_t);
+  __DMB();
+  task_stack_nb++;
+}
+
+static uint32_t task_stack_size(TaskHandle_t hdl)
+{
+  int i;
+
+  for (i = 0; i < task_stack_nb; i++)
+    if (task_stacks[i].hdl == hdl)
+      return task_stacks[i].stack_size;
+
+  return 0;
+}
+
+static configRUN_TIME_COUNTER_TYPE task_prev_run_time(TaskHandle_t hdl)
+{
+  int i;
+
+  for (i = 0; i < task_prev_nb; i++)
+    if (task_prev[i].hdl == hdl)
+      return task_prev[i].run_time;
+
+  /* Task created during the period */
+  return 0;
+}
+
+static void task_stat_fill(task_stat_t *p_stat, const TaskStatus_t *status, configRUN_TIME_COUNTER_TYPE total)
+{
+  configRUN_TIME_COUNTER_TYPE run_time = status->ulRunTimeCounter - task_prev_run_time(status->xHandle);
+
+  strncpy(p_stat->name, status->pcTaskName, sizeof(p_stat->name) - 1);
+  p_stat->name[sizeof(p_stat->name) - 1] = '\0';
+  p_stat->priority = status->uxCurrentPriority;
+  p_stat->load = total ? 100.0f * run_time / total : 0;
+  p_stat->stack_free = status->usStackHighWaterMark * sizeof(StackType_t);
+  p_stat->stack_size = task_stack_size(status->xHandle);
+}
+
+/* uxTaskGetSystemState() suspends the scheduler while it walks the task lists and scans the
+ * unused part of each stack, hence the low sampling rate.
+ */
+void app_stats_task_update(void)
+{
+  configRUN_TIME_COUNTER_TYPE total_run_time;
+  configRUN_TIME_COUNTER_TYPE total;
+  uint32_t cycles[ISR_SRC_NB];
+  uint32_t counts[ISR_SRC_NB];
+  uint32_t max_cycles[ISR_SRC_NB];
+  uint32_t period_cycles;
+  uint32_t now = HAL_GetTick();
+  cpu_stat_t *p_stat = &stat_info.cpu;
+  int task_nb;
+  int i;
+
+  if (now - task_update_tick < TASK_STAT_PERIOD_MS)
+    return;
+
+  task_nb = uxTaskGetSystemState(task_status, TASK_STAT_MAX_NB, &total_run_time);
+  for (i = 0; i < ISR_SRC_NB; i++) {
+    cycles[i] = isr_cycles[i];
+    counts[i] = isr_counts[i];
+    max_cycles[i] = __atomic_exchange_n(&isr_max_cycles[i], 0, __ATOMIC_RELAXED);
+  }
+  total = total_run_time - task_prev_total;
+  period_cycles = (now - task_update_tick) * (SystemCoreClock / 1000);
+
+  stat_write_begin(&p_stat->seq);
+
+  p_stat->task_nb = task_nb;
+  for (i = 0; i < task_nb; i++)
+    task_stat_fill(&p_stat->task[i], &task_status[i], total);
+  for (i = 0; i < ISR_SRC_NB; i++) {
+    p_stat->isr[i].load = 100.0f * (cycles[i] - isr_cycles_prev[i]) / period_cycles;
+    p_stat->isr[i].nb = counts[i] - isr_counts_prev[i];
+    p_stat->isr[i].max_us = app_stats_cycles_to_us(max_cycles[i]);
+  }
+  p_stat->period_ms = now - task_update_tick;
+
+  stat_write_end(&p_stat->seq);
+
+  for (i = 0; i < task_nb; i++) {
+    task_prev[i].hdl = task_status[i].xHandle;
+    task_prev[i].run_time = task_status[i].ulRunTimeCounter;
+  }
+  task_prev_nb = task_nb;
+  task_prev_total = total_run_time;
+  memcpy(isr_cycles_prev, cycles, sizeof(isr_cycles_prev));
+  memcpy(isr_counts_prev, counts, sizeof(isr_counts_prev));
+  task_update_tick = now;
+}
+
+void app_stats_cpu_dump(app_stats_out_t out, void *arg)
+{
+  char line[CPU_DUMP_LINE_SIZE];
+  static cpu_stat_t cpu;
+  task_stat_t *p_task;
+  int i;
+
+  stat_read(&cpu, &stat_info.cpu, sizeof(cpu), &stat_info.cpu.seq);
+
+  snprintf(line, sizeof(line), "{\"cpu\":{\"period_ms\":%lu,\"tasks\":[", (unsigned long) cpu.period_ms);
+  out(line, arg);
+  for (i = 0; i < cpu.task_nb; i++) {
+    p_task = &cpu.task[i];
+    snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"prio\":%lu,\"load\":%.2f,\"stack_free\":%lu,"
+             "\"stack_size\":%lu}", i ? "," : "", p_task->name, (unsigned long) p_task->priority,
+             (double) p_task->load, (unsigned long) p_task->stack_free, (unsigned long) p_task->stack_size);
+    out(line, arg);
+  }
+  out("],\"isr\":[", arg);
+  for (i = 0; i < ISR_SRC_NB; i++) {
+    snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"load\":%.2f,\"nb\":%lu,\"max_us\":%lu}",
+             i ? "," : "", isr_names[i], (double) cpu.isr[i].load, (unsigned long) cpu.isr[i].nb,
+             (unsigned long) cpu.isr[i].max_us);
+    out(line, arg);
+  }
+  out("]}}\n", arg);
+}
+
+uint32_t app_stats_isr_enter(void)
+{
+  return app_stats_timestamp();
+}
+
+/* Handlers of one source never nest so plain read-modify-write is enough, except for the max
+ * which app_stats_task_update() swaps from task context.
+ */
+void app_stats_isr_exit(isr_src_t src, uint32_t ts)
+{
+  uint32_t cycles = app_stats_timestamp() - ts;
+
+  isr_cycles[src] += cycles;
+  isr_counts[src]++;
+  if (cycles > isr_max_cycles[src])
+    isr_max_cycles[src] = cycles;
+}
+
+const char *app_stats_isr_name(isr_src_t src)
+{
+  return isr_names[src];
+}
+
+/* DWT cycle counter, enabled by app_run() */
+uint32_t app_stats_timestamp(void)
+{
+  return DWT->CYCCNT;
+}
+
+/* Valid for intervals up to 2^32 cycles */
+uint32_t app_stats_elapsed_us(uint32_t ts)
+{
+  return (DWT->CYCCNT - ts) / (SystemCoreClock / 1000000);
+}
+
+uint32_t app_stats_cycles_to_us(uint32_t cycles)
+{
+  return cycles / (SystemCoreClock / 1000000);
+}
@@ -0,0 +1,184 @@
+/**
+ ******************************************************************************
+ * @file    app_trace.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include "svc/app_trace.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "task.h"
+#include "stm32n6xx_hal.h"
+#include "app/app_config.h"
+#include "svc/app_stats.h"
+
+#define TRACE_DUMP_LINE_SIZE 160
+#define TRACE_RING_SIZE (APP_TRACE_DEPTH ? APP_TRACE_DEPTH : 1)
+
+typedef struct {
+  uint32_t ts;
+  uint32_t frame_id;
+  uint16_t event;
+  uint16_t phase;
+  /* reservation number + 1, written last so dump skips records still being written */
+  uint32_t seq;
+} trace_rec_t;
+
+typedef struct {
+  const char *name;
+  int tid;
+} trace_event_desc_t;
+
+static const char *const trace_tid_names[] = {"camera isr", "isp", "nn", "dp", "usb"};
+static const trace_event_desc_t trace_events[TRACE_EVENT_NB] = {
+  [TRACE_CAPTURE_DISPLAY] = {"capture display", 0},
+  [TRACE_CAPTURE_NN] = {"capture nn", 0},
+  [TRACE_ISP_UPDATE] = {"isp update", 1},
+  [TRACE_NN_INFERENCE] = {"inference", 2},
+  [TRACE_NN_SWITCH] = {"model switch", 2},
+  [TRACE_NN_PP] = {"postprocess", 3},
+  [TRACE_NN_ROI] = {"roi", 3},
+  [TRACE_DISP_DISPLAY] = {"display", 3},
+  [TRACE_DISP_ENC] = {"encode", 3},
+  [TRACE_UVC_RELEASE] = {"usb release", 4},
+};
+static const char trace_phases[] = {'B', 'E', 'i'};
+
+static trace_rec_t trace_ring[TRACE_RING_SIZE];
+/* Free running, ring index is reservation number modulo TRACE_RING_SIZE */
+static uint32_t trace_head;
+static volatile int trace_is_frozen;
+static SemaphoreHandle_t trace_dump_sem;
+static StaticSemaphore_t trace_dump_sem_buffer;
+static StaticTask_t trace_thread;
+static StackType_t trace_thread_stack[2 * configMINIMAL_STACK_SIZE];
+
+static void trace_out_console(const char *str, void *arg)
+{
+  (void) arg;
+
+  printf("%s", str);
+}
+
+static void trace_thread_fct(void *arg)
+{
+  int ret;
+
+  while (1) {
+    ret = xSemaphoreTake(trace_dump_sem, portMAX_DELAY);
+    assert(ret == pdTRUE);
+    if (APP_TRACE_DEPTH)
+      app_trace_dump(trace_out_console, NULL);
+    app_stats_cpu_dump(trace_out_console, NULL);
+  }
+}
+
+void app_trace_init(void)
+{
+  TaskHandle_t hdl;
+
+  trace_head = 0;
+  trace_is_frozen = 0;
+
+  /* Also dumps cpu stats, so it exists without tracing */
+  trace_dump_sem = xSemaphoreCreateCountingStatic(1, 0, &trace_dump_sem_buffer);
+  assert(trace_dump_sem);
+
+  /* Console is slow, dump must not delay pipeline tasks */
+  hdl = xTaskCreateStatic(trace_thread_fct, "trace", configMINIMAL_STACK_SIZE * 2, NULL, tskIDLE_PRIORITY + 1,
+                          trace_thread_stack, &trace_thread);
+  assert(hdl != NULL);
+  app_stats_task_register(hdl, configMINIMAL_STACK_SIZE * 2);
+}
+
+void app_trace_record(trace_event_t event, trace_phase_t phase, uint32_t frame_id)
+{
+  uint32_t ts = app_stats_timestamp();
+  trace_rec_t *rec;
+  uint32_t seq;
+
+  if (!APP_TRACE_DEPTH || trace_is_frozen)
+    return;
+
+  /* ISR can preempt a task between reservation and write, each owns its slot */
+  seq = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED);
+  rec = &trace_ring[seq % TRACE_RING_SIZE];
+  rec->seq = 0;
+  rec->ts = ts;
+  rec->frame_id = frame_id;
+  rec->event = event;
+  rec->phase = phase;
+  __atomic_store_n(&rec->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+void app_trace_dump_request(void)
+{
+  xSemaphoreGive(trace_dump_sem);
+}
+
+/* Timestamps are 32 bits cycle counts, extended by summing deltas between consecutive records.
+ * Records are stored in reservation order, so a delta can be slightly negative.
+ */
+void app_trace_dump(app_trace_out_t out, void *arg)
+{
+  char line[TRACE_DUMP_LINE_SIZE];
+  uint32_t cycles_per_us = SystemCoreClock / 1000000;
+  const trace_event_desc_t *desc;
+  const trace_rec_t *rec;
+  uint32_t ts_prev = 0;
+  int64_t cycles = 0;
+  uint32_t head;
+  uint32_t seq;
+  uint32_t us;
+  int is_first = 1;
+  unsigned int i;
+
+  trace_is_frozen = 1;
+  head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+  seq = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+  out("[\n", arg);
+  for (i = 0; i < sizeof(trace_tid_names) / sizeof(trace_tid_names[0]); i++) {
+    snprintf(line, sizeof(line), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+             "\"args\":{\"name\":\"%s\"}},\n", i, trace_tid_names[i]);
+    out(line, arg);
+  }
+  for (; seq != head; seq++) {
+    rec = &trace_ring[seq % TRACE_RING_SIZE];
+    if (__atomic_load_n(&rec->seq, __ATOMIC_ACQUIRE) != seq + 1)
+      continue;
+    if (!is_first)
+      cycles += (int32_t) (rec->ts - ts_prev);
+    ts_prev = rec->ts;
+    is_first = 0;
+    if (cycles < 0)
+      cycles = 0;
+    desc = &trace_events[rec->event];
+    us = (uint32_t) (cycles / cycles_per_us);
+    snprintf(line, sizeof(line), "{\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%lu.%03lu,\"pid\":0,\"tid\":%d,"
+             "\"args\":{\"frame\":%lu}},\n", desc->name, trace_phases[rec->phase],
+             rec->phase == TRACE_INSTANT ? "\"s\":\"t\"," : "", (unsigned long) us,
+             (unsigned long) ((cycles % cycles_per_us) * 1000 / cycles_per_us), desc->tid,
+             (unsigned long) rec->frame_id);
+    out(line, arg);
+  }
+  /* closing event avoids a trailing comma */
+  out("{\"name\":\"dump\",\"ph\":\"i\",\"s\":\"g\",\"ts\":0,\"pid\":0,\"tid\":0}\n]\n", arg);
+  trace_is_frozen = 0;
+}
@@ -0,0 +1,101 @@
+/**
+ ******************************************************************************
+ * @file    bitrate_ctrl.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include "svc/bitrate_ctrl.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "utils.h"
+
+/* Load thresholds in per mille of frame period */
+#define BITRATE_CTRL_LOAD_HIGH 850
+#define BITRATE_CTRL_LOAD_LOW 500
+/* Frames between two decreases so the previous one can take effect */
+#define BITRATE_CTRL_DECREASE_HOLD 4
+#define BITRATE_CTRL_MIN_DIV 8
+#define BITRATE_CTRL_INCREASE_DIV 16
+/* Each backoff step also raises qp floor so easy frames stop spending bits */
+#define BITRATE_CTRL_QP_MIN_STEP 2
+#define BITRATE_CTRL_BACKOFF_LEVEL_MAX 10
+
+static int bitrate_ctrl_decrease(bitrate_ctrl_t *p_ctrl)
+{
+  if (p_ctrl->frames_since_change < BITRATE_CTRL_DECREASE_HOLD)
+    return 0;
+  if (p_ctrl->bitrate == p_ctrl->bitrate_min && p_ctrl->backoff_level == BITRATE_CTRL_BACKOFF_LEVEL_MAX)
+    return 0;
+
+  p_ctrl->bitrate = MAX(p_ctrl->bitrate * 3 / 4, p_ctrl->bitrate_min);
+  p_ctrl->backoff_level = MIN(p_ctrl->backoff_level + 1, BITRATE_CTRL_BACKOFF_LEVEL_MAX);
+  p_ctrl->qp_min_delta = p_ctrl->backoff_level * BITRATE_CTRL_QP_MIN_STEP;
+  p_ctrl->frames_since_change = 0;
+  p_ctrl->decrease_nb++;
+
+  return 1;
+}
+
+static int bitrate_ctrl_increase(bitrate_ctrl_t *p_ctrl)
+{
+  /* Wait a second of light load before probing for more */
+  if (p_ctrl->frames_since_change < p_ctrl->fps)
+    return 0;
+  if (p_ctrl->bitrate == p_ctrl->bitrate_max)
+    return 0;
+
+  p_ctrl->bitrate = MIN(p_ctrl->bitrate + p_ctrl->bitrate_max / BITRATE_CTRL_INCREASE_DIV, p_ctrl->bitrate_max);
+  p_ctrl->backoff_level = MAX(p_ctrl->backoff_level - 1, 0);
+  p_ctrl->qp_min_delta = p_ctrl->backoff_level * BITRATE_CTRL_QP_MIN_STEP;
+  p_ctrl->frames_since_change = 0;
+  p_ctrl->increase_nb++;
+
+  return 1;
+}
+
+void bitrate_ctrl_init(bitrate_ctrl_t *p_ctrl, int bitrate_max, int fps)
+{
+  assert(bitrate_max > 0);
+  assert(fps > 0);
+
+  memset(p_ctrl, 0, sizeof(*p_ctrl));
+  p_ctrl->bitrate_max = bitrate_max;
+  p_ctrl->bitrate_min = bitrate_max / BITRATE_CTRL_MIN_DIV;
+  p_ctrl->bitrate = bitrate_max;
+  p_ctrl->fps = fps;
+  p_ctrl->frame_period_us = 1000000 / fps;
+}
+
+int bitrate_ctrl_on_drain(bitrate_ctrl_t *p_ctrl, int drain_us)
+{
+  int load = (int)((int64_t)drain_us * 1000 / p_ctrl->frame_period_us);
+
+  p_ctrl->load += (load - p_ctrl->load) / 4;
+  p_ctrl->frames_since_change++;
+
+  if (p_ctrl->load > BITRATE_CTRL_LOAD_HIGH)
+    return bitrate_ctrl_decrease(p_ctrl);
+  if (p_ctrl->load < BITRATE_CTRL_LOAD_LOW)
+    return bitrate_ctrl_increase(p_ctrl);
+
+  return 0;
+}
+
+int bitrate_ctrl_on_skip(bitrate_ctrl_t *p_ctrl)
+{
+  return bitrate_ctrl_decrease(p_ctrl);
+}
@@ -19,14 +19,28 @@
 #include "svc/buffer_queue.h"
 
 #include <assert.h>
+#include <string.h>
 
-int bqueue_init(bqueue_t *bq, int buffer_nb, uint8_t **buffers)
+static void bqueue_set_buffers(bqueue_t *bq, int buffer_nb, uint8_t **buffers)
 {
   int i;
 
+  bq->buffer_nb = buffer_nb;
+  for (i = 0; i < buffer_nb; i++) {
+    assert(buffers[i]);
+    bq->buffers[i] = buffers[i];
+  }
+  memset(bq->metas, 0, sizeof(bq->metas));
+  bq->free_idx = 0;
+  bq->ready_idx = 0;
+}
+
+int bqueue_init(bqueue_t *bq, int buffer_nb, uint8_t **buffers)
+{
   if (buffer_nb > BQUEUE_MAX_BUFFERS)
     return -1;
 
+  bq->mode = BQUEUE_MODE_SEM;
   bq->free = xSemaphoreCreateCountingStatic(buffer_nb, buffer_nb, &bq->free_buffer);
   if (!bq->free)
     goto free_sem_error;
@@ -34,13 +48,7 @@ int bqueue_init(bqueue_t *bq, int buffer_nb, uint8_t **buffers)
   if (!bq->ready)
     goto ready_sem_error;
 
-  bq->buffer_nb = buffer_nb;
-  for (i = 0; i < buffer_nb; i++) {
-    assert(buffers[i]);
-    bq->buffers[i] = buffers[i];
-  }
-  bq->free_idx = 0;
-  bq->ready_idx = 0;
+  bqueue_set_buffers(bq, buffer_nb, buffers);
 
   return 0;
 
@@ -50,11 +58,120 @@ free_sem_error:
   return -1;
 }
 
+int bqueue_init_spsc(bqueue_t *bq, int buffer_nb, uint8_t **buffers)
+{
+  if (buffer_nb < 1 || buffer_nb > BQUEUE_MAX_BUFFERS)
+    return -1;
+
+  bq->mode = BQUEUE_MODE_SPSC;
+  bq->free = NULL;
+  bq->ready = NULL;
+  atomic_init(&bq->put_free_nb, 0);
+  atomic_init(&bq->put_ready_nb, 0);
+  bq->get_free_nb = 0;
+  bq->get_ready_nb = 0;
+  atomic_init(&bq->producer, NULL);
+  atomic_init(&bq->consumer, NULL);
+
+  bqueue_set_buffers(bq, buffer_nb, buffers);
+
+  return 0;
+}
+
+static int bqueue_spsc_has_free(bqueue_t *bq)
+{
+  uint32_t put_free_nb = atomic_load_explicit(&bq->put_free_nb, memory_order_acquire);
+
+  return bq->get_free_nb - put_free_nb < (uint32_t) bq->buffer_nb;
+}
+
+static int bqueue_spsc_has_ready(bqueue_t *bq)
+{
+  uint32_t put_ready_nb = atomic_load_explicit(&bq->put_ready_nb, memory_order_acquire);
+
+  return put_ready_nb != bq->get_ready_nb;
+}
+
+/* Waiter is published before each re-check so a concurrent put either is seen
+ * by the re-check or finds the waiter and leaves a pending notification. A put
+ * takes the waiter, so it is published again after a wake up that finds nothing,
+ * and cleared on return so no put notifies a task that stopped waiting.
+ */
+static void bqueue_spsc_wait(bqueue_t *bq, _Atomic(TaskHandle_t) *waiter, int (*is_available)(bqueue_t *bq))
+{
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+  for (;;) {
+    atomic_store(waiter, task);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (is_available(bq))
+      break;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  atomic_store(waiter, NULL);
+}
+
+static void bqueue_spsc_wake(_Atomic(TaskHandle_t) *waiter)
+{
+  TaskHandle_t task;
+
+  task = atomic_exchange(waiter, NULL);
+  if (task)
+    xTaskNotifyGive(task);
+}
+
+static void bqueue_spsc_wake_from_isr(_Atomic(TaskHandle_t) *waiter)
+{
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  TaskHandle_t task;
+
+  task = atomic_exchange(waiter, NULL);
+  if (!task)
+    return;
+
+  vTaskNotifyGiveFromISR(task, &xHigherPriorityTaskWoken);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static uint8_t *bqueue_spsc_get_free(bqueue_t *bq, int is_blocking)
+{
+  uint8_t *res;
+
+  if (!bqueue_spsc_has_free(bq)) {
+    if (!is_blocking)
+      return NULL;
+    bqueue_spsc_wait(bq, &bq->producer, bqueue_spsc_has_free);
+  }
+
+  res = bq->buffers[bq->free_idx];
+  bq->free_idx = (bq->free_idx + 1) % bq->buffer_nb;
+  bq->get_free_nb++;
+
+  return res;
+}
+
+static uint8_t *bqueue_spsc_get_ready(bqueue_t *bq)
+{
+  uint8_t *res;
+
+  if (!bqueue_spsc_has_ready(bq))
+    bqueue_spsc_wait(bq, &bq->consumer, bqueue_spsc_has_ready);
+
+  res = bq->buffers[bq->ready_idx];
+  bq->ready_idx = (bq->ready_idx + 1) % bq->buffer_nb;
+  bq->get_ready_nb++;
+
+  return res;
+}
+
 uint8_t *bqueue_get_free(bqueue_t *bq, int is_blocking)
 {
   uint8_t *res;
   int ret;
 
+  if (bq->mode == BQUEUE_MODE_SPSC)
+    return bqueue_spsc_get_free(bq, is_blocking);
+
   ret = xSemaphoreTake(bq->free, is_blocking ? portMAX_DELAY : 0);
   if (ret == pdFALSE)
     return NULL;
@@ -69,6 +186,12 @@ void bqueue_put_free(bqueue_t *bq)
 {
   int ret;
 
+  if (bq->mode == BQUEUE_MODE_SPSC) {
+    atomic_fetch_add_explicit(&bq->put_free_nb, 1, memory_order_seq_cst);
+    bqueue_spsc_wake(&bq->producer);
+    return;
+  }
+
   ret = xSemaphoreGive(bq->free);
   assert(ret == pdTRUE);
 }
@@ -78,6 +201,9 @@ uint8_t *bqueue_get_ready(bqueue_t *bq)
   uint8_t *res;
   int ret;
 
+  if (bq->mode == BQUEUE_MODE_SPSC)
+    return bqueue_spsc_get_ready(bq);
+
   ret = xSemaphoreTake(bq->ready, portMAX_DELAY);
   assert(ret == pdTRUE);
 
@@ -92,6 +218,12 @@ void bqueue_put_ready(bqueue_t *bq)
   BaseType_t xHigherPriorityTaskWoken = pdFALSE;
   int ret;
 
+  if (bq->mode == BQUEUE_MODE_SPSC) {
+    atomic_fetch_add_explicit(&bq->put_ready_nb, 1, memory_order_seq_cst);
+    bqueue_spsc_wake(&bq->consumer);
+    return;
+  }
+
   if (xPortIsInsideInterrupt()) {
     ret = xSemaphoreGiveFromISR(bq->ready, &xHigherPriorityTaskWoken);
     assert(ret == pdTRUE);
@@ -101,3 +233,34 @@ void bqueue_put_ready(bqueue_t *bq)
     assert(ret == pdTRUE);
   }
 }
+
+/* Same as bqueue_put_ready() minus the execution context probe */
+void bqueue_put_ready_from_isr(bqueue_t *bq)
+{
+  BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+  int ret;
+
+  if (bq->mode == BQUEUE_MODE_SPSC) {
+    atomic_fetch_add_explicit(&bq->put_ready_nb, 1, memory_order_seq_cst);
+    bqueue_spsc_wake_from_isr(&bq->consumer);
+    return;
+  }
+
+  ret = xSemaphoreGiveFromISR(bq->ready, &xHigherPriorityTaskWoken);
+  assert(ret == pdTRUE);
+  portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+/* Metadata travels with the buffer: producer fills it before put_ready, consumer reads it after get_ready */
+bqueue_meta_t *bqueue_get_meta(bqueue_t *bq, uint8_t *buffer)
+{
+  int i;
+
+  for (i = 0; i < bq->buffer_nb; i++) {
+    if (bq->buffers[i] == buffer)
+      return &bq->metas[i];
+  }
+  assert(0);
+
+  return NULL;
+}
@@ -21,11 +21,13 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
+#include "fal/fal_cache.h"
 #include "fal/fal_dma2d.h"
 #include "utils.h"
 
-#define MAX_LINE_CHAR 64
+#define MAX_LINE_CHAR DRAW_LINE_CHAR_MAX
 
 static void draw_dma2d_cb(void *ctx)
 {
@@ -39,8 +41,74 @@ static void draw_dma2d_error_cb(void *ctx)
   assert(0);
 }
 
-static void draw_copy_argb_hw(uint8_t *p_dst, int dst_width, int dst_height, uint8_t *p_src, int src_width,
-                              int src_height, int x_offset, int y_offset)
+static const fal_dma2d_format_t draw_dma2d_formats[] = {
+  [DRAW_FORMAT_ARGB8888] = FAL_DMA2D_FORMAT_ARGB8888,
+  [DRAW_FORMAT_A8] = FAL_DMA2D_FORMAT_A8,
+  [DRAW_FORMAT_A4] = FAL_DMA2D_FORMAT_A4,
+};
+
+static int draw_format_size(DRAW_Format_t format, int pixel_nb)
+{
+  switch (format) {
+  case DRAW_FORMAT_A8:
+    return pixel_nb;
+  case DRAW_FORMAT_A4:
+    return (pixel_nb + 1) / 2;
+  default:
+    return pixel_nb * 4;
+  }
+}
+
+/* A4 lines must start on a byte */
+static int draw_format_stride(DRAW_Format_t format, int width)
+{
+  return format == DRAW_FORMAT_A4 ? (width + 1) & ~1 : width;
+}
+
+static uint8_t draw_alpha_get(DRAW_Format_t format, const uint8_t *p_data, int pos)
+{
+  if (format == DRAW_FORMAT_A8)
+    return p_data[pos];
+
+  return ((p_data[pos / 2] >> ((pos & 1) * 4)) & 0xf) * 0x11;
+}
+
+static void draw_alpha_put(DRAW_Format_t format, uint8_t *p_data, int pos, uint8_t alpha)
+{
+  int shift = (pos & 1) * 4;
+
+  if (format == DRAW_FORMAT_A8)
+    p_data[pos] = alpha;
+  else
+    p_data[pos / 2] = (p_data[pos / 2] & ~(0xf << shift)) | ((alpha >> 4) << shift);
+}
+
+static int draw_font_char_size(DRAW_Font_t *p_font)
+{
+  return draw_format_size(p_font->format, p_font->stride * p_font->height);
+}
+
+static uint8_t *draw_font_glyph(DRAW_Font_t *p_font, char c)
+{
+  return &p_font->data[(c - ' ') * draw_font_char_size(p_font)];
+}
+
+/* Caller holds DRAW_HwLock */
+static void draw_fence_wait(fal_dma2d_fence_t fence)
+{
+  if (!FAL_DMA2D_NotifyFence(fence, draw_dma2d_cb, NULL))
+    DRAW_Wfe();
+}
+
+/* Queue has room once transfer queued FAL_DMA2D_QUEUE_LEN places back is done */
+static fal_dma2d_fence_t draw_queue_slot_fence(void)
+{
+  return FAL_DMA2D_GetFence() - FAL_DMA2D_QUEUE_LEN + 1;
+}
+
+static void draw_blend_hw(uint8_t *p_dst, int dst_width, int dst_height, uint8_t *p_src, int src_width,
+                          int src_height, int src_stride, DRAW_Format_t format, uint32_t color, int x_offset,
+                          int y_offset)
 {
   fal_dma2d_blend_t cfg = {
     .dst = p_dst,
@@ -49,24 +117,28 @@ static void draw_copy_argb_hw(uint8_t *p_dst, int dst_width, int dst_height, uin
     .src = p_src,
     .src_width = (uint32_t) src_width,
     .src_height = (uint32_t) src_height,
+    .src_stride = (uint32_t) src_stride,
+    .src_format = draw_dma2d_formats[format],
+    .src_color = color,
     .x_offset = (uint32_t) x_offset,
     .y_offset = (uint32_t) y_offset,
-    .on_complete = draw_dma2d_cb,
+    .on_complete = NULL,
     .on_error = draw_dma2d_error_cb,
     .user = NULL,
   };
   int ret;
 
   DRAW_HwLock(NULL);
+  draw_fence_wait(draw_queue_slot_fence());
   ret = FAL_DMA2D_Blend(&cfg);
   assert(ret == 0);
 
-  DRAW_Wfe();
+  draw_fence_wait(FAL_DMA2D_GetFence());
   DRAW_HwUnlock();
 }
 
 static void draw_fill_argb_hw(uint8_t *p_dst, int dst_width, int dst_height, int src_width, int src_height,
-                              int x_offset, int y_offset, uint32_t color)
+                              int x_offset, int y_offset, uint32_t color, int is_blend)
 {
   fal_dma2d_fill_t cfg = {
     .dst = p_dst,
@@ -77,30 +149,32 @@ static void draw_fill_argb_hw(uint8_t *p_dst, int dst_width, int dst_height, int
     .x_offset = (uint32_t) x_offset,
     .y_offset = (uint32_t) y_offset,
     .color = color,
-    .on_complete = draw_dma2d_cb,
+    .is_blend = is_blend,
+    .on_complete = NULL,
     .on_error = draw_dma2d_error_cb,
     .user = NULL,
   };
   int ret;
 
   DRAW_HwLock(NULL);
+  draw_fence_wait(draw_queue_slot_fence());
   ret = FAL_DMA2D_Fill(&cfg);
   assert(ret == 0);
 
-  DRAW_Wfe();
+  draw_fence_wait(FAL_DMA2D_GetFence());
   DRAW_HwUnlock();
 }
 
 static void draw_hline_argb_hw(uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos, int len,
                                uint32_t color)
 {
-  draw_fill_argb_hw(p_dst, dst_width, dst_height, len, 1, x_pos, y_pos, color);
+  draw_fill_argb_hw(p_dst, dst_width, dst_height, len, 1, x_pos, y_pos, color, 0);
 }
 
 static void draw_vline_argb_hw(uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos, int len,
                                uint32_t color)
 {
-  draw_fill_argb_hw(p_dst, dst_width, dst_height, 1, len, x_pos, y_pos, color);
+  draw_fill_argb_hw(p_dst, dst_width, dst_height, 1, len, x_pos, y_pos, color, 0);
 }
 
 static void draw_rect_argb_hw(uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos, int width, int height,
@@ -113,7 +187,7 @@ static void draw_rect_argb_hw(uint8_t *p_dst, int dst_width, int dst_height, int
   draw_vline_argb_hw(p_dst, dst_width, dst_height, x_pos + width - 1, y_pos, height, color);
 }
 
-static void draw_font_cvt(sFONT *p_font_in, uint32_t *dout, uint8_t *din)
+static void draw_font_cvt(sFONT *p_font_in, DRAW_Font_t *p_font, uint8_t *dout, uint8_t *din)
 {
   uint32_t height, width;
   uint32_t offset;
@@ -141,12 +215,9 @@ static void draw_font_cvt(sFONT *p_font_in, uint32_t *dout, uint8_t *din)
       break;
     }
 
-    for (j = 0; j < width; j++) {
-      if (line & (1 << (width- j + offset- 1)))
-        *dout++ = 0xFFFFFFFFUL;
-      else
-        *dout++ = 0x40000000UL;
-    }
+    for (j = 0; j < width; j++)
+      draw_alpha_put(p_font->format, dout, i * p_font->stride + j,
+                     (line & (1 << (width- j + offset- 1))) ? 0xff : 0x00);
   }
 }
 
@@ -157,17 +228,15 @@ static int draw_font_setup_with_memory(sFONT *p_font_in, DRAW_Font_t *p_font, vo
   int char_size_in;
   int i;
 
-  bytes_per_char = p_font_in->Width * p_font_in->Height * 4;
+  bytes_per_char = draw_font_char_size(p_font);
   if (data_size < bytes_per_char * nb_char_in_font)
     return -1;
 
   char_size_in = p_font_in->Height * ((p_font_in->Width + 7) / 8);
-  p_font->width = p_font_in->Width;
-  p_font->height = p_font_in->Height;
   p_font->data = data;
 
   for (i = 0; i < nb_char_in_font; i++)
-    draw_font_cvt(p_font_in, (uint32_t *) &p_font->data[i * bytes_per_char],
+    draw_font_cvt(p_font_in, p_font, &p_font->data[i * bytes_per_char],
                   (uint8_t *) &p_font_in->table[i * char_size_in]);
 
   return 0;
@@ -176,20 +245,24 @@ static int draw_font_setup_with_memory(sFONT *p_font_in, DRAW_Font_t *p_font, vo
 static void draw_draw_char_argb_hw(DRAW_Font_t *p_font, uint8_t *p_dst, int dst_width, int dst_height, int x_pos,
                                    int y_pos, uint8_t *data)
 {
-  draw_copy_argb_hw(p_dst, dst_width, dst_height, data, p_font->width, p_font->height, x_pos, y_pos);
+  draw_blend_hw(p_dst, dst_width, dst_height, data, p_font->width, p_font->height, p_font->stride, p_font->format,
+                p_font->color, x_pos, y_pos);
 }
 
 static void draw_display_char_argb_hw(DRAW_Font_t *p_font, uint8_t *p_dst, int dst_width, int dst_height, int x_pos,
                                       int y_pos, char c)
 {
-  int char_size = p_font->height * p_font->width * 4;
-
-  draw_draw_char_argb_hw(p_font, p_dst, dst_width, dst_height, x_pos, y_pos, &p_font->data[(c - ' ') * char_size]);
+  draw_draw_char_argb_hw(p_font, p_dst, dst_width, dst_height, x_pos, y_pos, draw_font_glyph(p_font, c));
 }
 
 static void draw_puts_argb_hw(DRAW_Font_t *p_font, uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos,
                               char *line)
 {
+  int len = strlen(line);
+
+  if (len && p_font->bg_color >> 24)
+    draw_fill_argb_hw(p_dst, dst_width, dst_height, len * p_font->width, p_font->height, x_pos, y_pos,
+                      p_font->bg_color, 1);
   while (*line != '\0') {
     draw_display_char_argb_hw(p_font, p_dst, dst_width, dst_height, x_pos, y_pos, *line);
     x_pos += p_font->width;
@@ -197,19 +270,460 @@ static void draw_puts_argb_hw(DRAW_Font_t *p_font, uint8_t *p_dst, int dst_width
   }
 }
 
+static int draw_text_stride(DRAW_Font_t *p_font, int len)
+{
+  return draw_format_stride(p_font->format, len * p_font->width);
+}
+
+static void draw_text_render(DRAW_TextEntry_t *entry)
+{
+  DRAW_Font_t *p_font = entry->p_font;
+  int strip_stride = draw_text_stride(p_font, entry->len);
+  uint8_t *p_glyph;
+  int i, x, y;
+
+  for (i = 0; i < entry->len; i++) {
+    p_glyph = draw_font_glyph(p_font, entry->text[i]);
+    for (y = 0; y < p_font->height; y++)
+      for (x = 0; x < p_font->width; x++)
+        draw_alpha_put(p_font->format, entry->p_strip, y * strip_stride + i * p_font->width + x,
+                       draw_alpha_get(p_font->format, p_glyph, y * p_font->stride + x));
+  }
+  FAL_CacheClean(entry->p_strip, draw_format_size(p_font->format, p_font->height * strip_stride));
+}
+
+/* Returns strip of text, rendering it in least recently used entry on miss. Entries already
+ * referenced by the list being recorded are never evicted. NULL if text can't be cached.
+ */
+static DRAW_TextEntry_t *draw_text_lookup(DRAW_TextCache_t *p_cache, DRAW_Font_t *p_font, const char *text, int len)
+{
+  DRAW_TextEntry_t *victim = NULL;
+  DRAW_TextEntry_t *entry;
+  int i;
+
+  if (draw_format_size(p_font->format, draw_text_stride(p_font, len) * p_font->height) > DRAW_TEXT_CACHE_ENTRY_SIZE)
+    return NULL;
+
+  for (i = 0; i < DRAW_TEXT_CACHE_ENTRY_NB; i++) {
+    entry = &p_cache->entries[i];
+    if (entry->p_font == p_font && entry->len == len && memcmp(entry->text, text, len) == 0) {
+      entry->last_use = p_cache->gen;
+      p_cache->hit_nb++;
+      return entry;
+    }
+    if (entry->last_use != p_cache->gen && (!victim || entry->last_use < victim->last_use))
+      victim = entry;
+  }
+  if (!victim)
+    return NULL;
+
+  victim->p_font = p_font;
+  victim->len = len;
+  memcpy(victim->text, text, len);
+  victim->last_use = p_cache->gen;
+  victim->rev++;
+  draw_text_render(victim);
+  p_cache->miss_nb++;
+
+  return victim;
+}
+
+static void draw_list_push(DRAW_List_t *p_list, int is_blocking);
+
+static DRAW_Cmd_t *draw_list_add(DRAW_List_t *p_list, DRAW_CmdType_t type, int text_len)
+{
+  DRAW_Cmd_t *cmd;
+
+  if (p_list->cmd_nb == DRAW_LIST_CMD_NB || p_list->text_len + text_len > DRAW_LIST_TEXT_SIZE) {
+    /* Region content can't be compared anymore, it is redrawn */
+    p_list->is_deferred = 0;
+    p_list->is_sig_valid = 0;
+    draw_list_push(p_list, 1);
+  }
+
+  /* Region lists compare commands bytes, padding included */
+  cmd = &p_list->cmds[p_list->cmd_nb++];
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->type = type;
+
+  return cmd;
+}
+
+static int draw_list_is_inside(DRAW_List_t *p_list, int x_pos, int y_pos, int width, int height)
+{
+  return x_pos >= 0 && y_pos >= 0 && x_pos + width <= p_list->dst_width && y_pos + height <= p_list->dst_height;
+}
+
+/* Source fetch plus destination write, and read when blending */
+static uint32_t draw_list_bytes(DRAW_List_t *p_list, DRAW_CmdType_t type, int width, int height, DRAW_Format_t format)
+{
+  int pixel_nb = width * height;
+  int src_size = 0;
+
+  if (type == DRAW_CMD_COPY || type == DRAW_CMD_TEXT)
+    src_size = draw_format_size(format, pixel_nb);
+  if (p_list->dst_format == DRAW_FORMAT_NV12)
+    return src_size + pixel_nb * 3;
+  if (type == DRAW_CMD_FILL)
+    return pixel_nb * 4;
+
+  return src_size + pixel_nb * 8;
+}
+
+static void draw_list_next(DRAW_List_t *p_list)
+{
+  DRAW_Cmd_t *cmd = &p_list->cmds[p_list->push_cmd];
+
+  if (cmd->type == DRAW_CMD_TEXT && ++p_list->push_char < cmd->text.len)
+    return;
+
+  p_list->push_char = 0;
+  p_list->push_cmd++;
+}
+
+static int draw_list_queue(DRAW_List_t *p_list)
+{
+  DRAW_Cmd_t *cmd = &p_list->cmds[p_list->push_cmd];
+  fal_dma2d_blend_t blend = {
+    .dst = p_list->p_dst,
+    .dst_width = (uint32_t) p_list->dst_width,
+    .dst_height = (uint32_t) p_list->dst_height,
+    .x_offset = (uint32_t) cmd->x_pos,
+    .y_offset = (uint32_t) cmd->y_pos,
+    .on_complete = NULL,
+    .on_error = draw_dma2d_error_cb,
+    .user = p_list,
+  };
+  fal_dma2d_fill_t fill = {
+    .dst = p_list->p_dst,
+    .dst_width = (uint32_t) p_list->dst_width,
+    .dst_height = (uint32_t) p_list->dst_height,
+    .width = (uint32_t) cmd->width,
+    .height = (uint32_t) cmd->height,
+    .x_offset = (uint32_t) cmd->x_pos,
+    .y_offset = (uint32_t) cmd->y_pos,
+    .color = cmd->color,
+    .on_complete = NULL,
+    .on_error = draw_dma2d_error_cb,
+    .user = p_list,
+  };
+  DRAW_Font_t *p_font = cmd->text.p_font;
+  char c;
+
+  if (cmd->type == DRAW_CMD_TEXT) {
+    if (!draw_list_is_inside(p_list, cmd->x_pos + p_list->push_char * p_font->width, cmd->y_pos, p_font->width,
+                             p_font->height))
+      return 0;
+  } else if (!draw_list_is_inside(p_list, cmd->x_pos, cmd->y_pos, cmd->width, cmd->height)) {
+    return 0;
+  }
+
+  p_list->transfer_nb++;
+  if (cmd->type == DRAW_CMD_TEXT)
+    p_list->byte_nb += draw_list_bytes(p_list, cmd->type, p_font->width, p_font->height, p_font->format);
+  else
+    p_list->byte_nb += draw_list_bytes(p_list, cmd->type, cmd->width, cmd->height, cmd->copy.format);
+  switch (cmd->type) {
+  case DRAW_CMD_FILL:
+    return FAL_DMA2D_Fill(&fill);
+  case DRAW_CMD_FILL_BLEND:
+    fill.is_blend = 1;
+    return FAL_DMA2D_Fill(&fill);
+  case DRAW_CMD_COPY:
+    blend.src = cmd->copy.p_src;
+    blend.src_width = (uint32_t) cmd->width;
+    blend.src_height = (uint32_t) cmd->height;
+    blend.src_stride = cmd->copy.stride;
+    blend.src_format = draw_dma2d_formats[cmd->copy.format];
+    blend.src_color = cmd->copy.color;
+    return FAL_DMA2D_Blend(&blend);
+  case DRAW_CMD_TEXT:
+    c = p_list->text[cmd->text.pos + p_list->push_char];
+    blend.src = draw_font_glyph(p_font, c);
+    blend.src_width = p_font->width;
+    blend.src_height = p_font->height;
+    blend.src_stride = p_font->stride;
+    blend.src_format = draw_dma2d_formats[p_font->format];
+    blend.src_color = cmd->text.color;
+    blend.x_offset += (uint32_t) (p_list->push_char * p_font->width);
+    return FAL_DMA2D_Blend(&blend);
+  default:
+    return -1;
+  }
+}
+
+/* Source of a cpu blend. p_data NULL is a plain color */
+typedef struct {
+  const uint8_t *p_data;
+  int stride;
+  DRAW_Format_t format;
+  uint32_t color;
+  uint8_t yuv[3];
+} draw_cpu_src_t;
+
+/* BT.601 limited range, as DCMIPP is setup for the capture */
+static void draw_rgb_to_yuv(uint32_t rgb, uint8_t yuv[3])
+{
+  int r = (rgb >> 16) & 0xff;
+  int g = (rgb >> 8) & 0xff;
+  int b = rgb & 0xff;
+
+  yuv[0] = (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+  yuv[1] = (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+  yuv[2] = (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+static void draw_cpu_src_init(draw_cpu_src_t *src, const uint8_t *p_data, int stride, DRAW_Format_t format,
+                              uint32_t color)
+{
+  src->p_data = p_data;
+  src->stride = stride;
+  src->format = format;
+  src->color = color;
+  draw_rgb_to_yuv(color, src->yuv);
+}
+
+/* Returns alpha of source pixel and sets its yuv */
+static uint8_t draw_cpu_src_get(draw_cpu_src_t *src, int x, int y, uint8_t yuv[3])
+{
+  uint32_t argb;
+  uint8_t alpha;
+
+  if (src->p_data && src->format == DRAW_FORMAT_ARGB8888) {
+    memcpy(&argb, &src->p_data[(y * src->stride + x) * 4], sizeof(argb));
+    alpha = argb >> 24;
+    if (alpha)
+      draw_rgb_to_yuv(argb, yuv);
+    return alpha;
+  }
+
+  alpha = src->p_data ? draw_alpha_get(src->format, src->p_data, y * src->stride + x) : src->color >> 24;
+  memcpy(yuv, src->yuv, 3);
+
+  return alpha;
+}
+
+static uint8_t draw_cpu_mix(uint8_t dst, uint8_t src, int alpha)
+{
+  return (uint8_t) ((dst * (255 - alpha) + src * alpha + 127) / 255);
+}
+
+/* Frame is written by camera and read by encoder, rows touched by cpu go through cache maintenance */
+static void draw_nv12_cache(DRAW_List_t *p_list, int x_pos, int y_pos, int width, int height, int is_done)
+{
+  uint8_t *p_uv = p_list->p_dst + p_list->dst_width * p_list->dst_height;
+  int x_uv = x_pos & ~1;
+  int width_uv = ((x_pos + width + 1) & ~1) - x_uv;
+  int y;
+
+  for (y = y_pos; y < y_pos + height; y++) {
+    if (is_done)
+      FAL_CacheClean(&p_list->p_dst[y * p_list->dst_width + x_pos], width);
+    else
+      FAL_CacheCleanInvalidate(&p_list->p_dst[y * p_list->dst_width + x_pos], width);
+  }
+  for (y = y_pos / 2; y <= (y_pos + height - 1) / 2; y++) {
+    if (is_done)
+      FAL_CacheClean(&p_uv[y * p_list->dst_width + x_uv], width_uv);
+    else
+      FAL_CacheCleanInvalidate(&p_uv[y * p_list->dst_width + x_uv], width_uv);
+  }
+}
+
+/* Area covered by commands not blended yet, clipped to destination. Returns 0 if empty */
+static int draw_nv12_area(DRAW_List_t *p_list, int *x_min, int *y_min, int *x_max, int *y_max)
+{
+  DRAW_Cmd_t *cmd;
+  int width;
+  int i;
+
+  *x_min = p_list->dst_width;
+  *y_min = p_list->dst_height;
+  *x_max = 0;
+  *y_max = 0;
+  for (i = p_list->push_cmd; i < p_list->cmd_nb; i++) {
+    cmd = &p_list->cmds[i];
+    width = cmd->type == DRAW_CMD_TEXT ? cmd->text.len * cmd->text.p_font->width : cmd->width;
+    *x_min = MIN(*x_min, MAX(cmd->x_pos, 0));
+    *y_min = MIN(*y_min, MAX(cmd->y_pos, 0));
+    *x_max = MAX(*x_max, MIN(cmd->x_pos + width, p_list->dst_width));
+    *y_max = MAX(*y_max, MIN(cmd->y_pos + (cmd->type == DRAW_CMD_TEXT ? cmd->text.p_font->height : cmd->height),
+                             p_list->dst_height));
+  }
+
+  return *x_min < *x_max && *y_min < *y_max;
+}
+
+/* Blended by 2x2 blocks so each source pixel is read once. Luma is blended per pixel. A chroma
+ * sample is blended with the mean alpha and alpha weighted color of its block, pixels out of the
+ * source counting as transparent. Caller does the cache maintenance.
+ */
+static void draw_nv12_blend(DRAW_List_t *p_list, draw_cpu_src_t *src, int x_pos, int y_pos, int width, int height)
+{
+  uint8_t *p_uv = p_list->p_dst + p_list->dst_width * p_list->dst_height;
+  int x_end = x_pos + width;
+  int y_end = y_pos + height;
+  int sum_a, sum_u, sum_v;
+  uint8_t yuv[3];
+  uint8_t *p_pix;
+  int alpha;
+  int x, y, i;
+  int px, py;
+
+  for (y = y_pos & ~1; y < y_end; y += 2) {
+    for (x = x_pos & ~1; x < x_end; x += 2) {
+      sum_a = sum_u = sum_v = 0;
+      for (i = 0; i < 4; i++) {
+        px = x + (i & 1);
+        py = y + i / 2;
+        if (px < x_pos || px >= x_end || py < y_pos || py >= y_end)
+          continue;
+        alpha = draw_cpu_src_get(src, px - x_pos, py - y_pos, yuv);
+        if (!alpha)
+          continue;
+        p_pix = &p_list->p_dst[py * p_list->dst_width + px];
+        *p_pix = draw_cpu_mix(*p_pix, yuv[0], alpha);
+        sum_a += alpha;
+        sum_u += alpha * yuv[1];
+        sum_v += alpha * yuv[2];
+      }
+      if (!sum_a)
+        continue;
+      p_pix = &p_uv[(y / 2) * p_list->dst_width + x];
+      p_pix[0] = (uint8_t) ((p_pix[0] * (4 * 255 - sum_a) + sum_u + 2 * 255) / (4 * 255));
+      p_pix[1] = (uint8_t) ((p_pix[1] * (4 * 255 - sum_a) + sum_v + 2 * 255) / (4 * 255));
+    }
+  }
+}
+
+/* Same bounds and operations as draw_list_queue(), done by cpu */
+static void draw_list_blend_cpu(DRAW_List_t *p_list)
+{
+  DRAW_Cmd_t *cmd = &p_list->cmds[p_list->push_cmd];
+  DRAW_Font_t *p_font = cmd->text.p_font;
+  int x_pos = cmd->x_pos;
+  int width = cmd->width;
+  int height = cmd->height;
+  draw_cpu_src_t src;
+  char c;
+
+  switch (cmd->type) {
+  case DRAW_CMD_FILL:
+    /* DMA2D fill writes color as is, alpha is not shown */
+    draw_cpu_src_init(&src, NULL, 0, DRAW_FORMAT_ARGB8888, cmd->color | 0xff000000);
+    break;
+  case DRAW_CMD_FILL_BLEND:
+    draw_cpu_src_init(&src, NULL, 0, DRAW_FORMAT_ARGB8888, cmd->color);
+    break;
+  case DRAW_CMD_COPY:
+    draw_cpu_src_init(&src, cmd->copy.p_src, cmd->copy.stride, cmd->copy.format, cmd->copy.color);
+    break;
+  case DRAW_CMD_TEXT:
+    c = p_list->text[cmd->text.pos + p_list->push_char];
+    draw_cpu_src_init(&src, draw_font_glyph(p_font, c), p_font->stride, p_font->format, cmd->text.color);
+    x_pos += p_list->push_char * p_font->width;
+    width = p_font->width;
+    height = p_font->height;
+    break;
+  default:
+    assert(0);
+    return;
+  }
+
+  if (!draw_list_is_inside(p_list, x_pos, cmd->y_pos, width, height))
+    return;
+
+  p_list->transfer_nb++;
+  p_list->byte_nb += draw_list_bytes(p_list, cmd->type, width, height, src.format);
+  draw_nv12_blend(p_list, &src, x_pos, cmd->y_pos, width, height);
+}
+
+/* Queue recorded transfers so DMA2D drains them while recording goes on. Without is_blocking,
+ * it stops when DMA2D queue is full.
+ */
+static void draw_list_push(DRAW_List_t *p_list, int is_blocking)
+{
+  int x_min, y_min, x_max, y_max;
+  int is_area;
+  int ret;
+
+  if (p_list->is_deferred)
+    return;
+
+  /* cpu blends are batched until submit, so cache maintenance is done once for their whole area */
+  if (p_list->dst_format == DRAW_FORMAT_NV12) {
+    if (!is_blocking)
+      return;
+    is_area = draw_nv12_area(p_list, &x_min, &y_min, &x_max, &y_max);
+    if (is_area)
+      draw_nv12_cache(p_list, x_min, y_min, x_max - x_min, y_max - y_min, 0);
+    while (p_list->push_cmd < p_list->cmd_nb) {
+      draw_list_blend_cpu(p_list);
+      draw_list_next(p_list);
+    }
+    if (is_area)
+      draw_nv12_cache(p_list, x_min, y_min, x_max - x_min, y_max - y_min, 1);
+    p_list->cmd_nb = 0;
+    p_list->text_len = 0;
+    p_list->push_cmd = 0;
+    return;
+  }
+
+  DRAW_HwLock(NULL);
+  while (p_list->push_cmd < p_list->cmd_nb) {
+    if (!FAL_DMA2D_IsDone(draw_queue_slot_fence())) {
+      if (!is_blocking)
+        break;
+      draw_fence_wait(draw_queue_slot_fence());
+    }
+    ret = draw_list_queue(p_list);
+    assert(ret == 0);
+    draw_list_next(p_list);
+  }
+  p_list->fence = FAL_DMA2D_GetFence();
+  DRAW_HwUnlock();
+
+  /* Queued transfers hold their own copy, storage can be reused */
+  if (p_list->push_cmd == p_list->cmd_nb) {
+    p_list->cmd_nb = 0;
+    p_list->text_len = 0;
+    p_list->push_cmd = 0;
+  }
+}
+
 int DRAW_FontSetup(sFONT *p_font_in, DRAW_Font_t *p_font)
+{
+  return DRAW_FontSetupFormat(p_font_in, p_font, DRAW_FORMAT_A8);
+}
+
+int DRAW_FontSetupFormat(sFONT *p_font_in, DRAW_Font_t *p_font, DRAW_Format_t format)
 {
   const int nb_char_in_font = '~' - ' ' + 1;
   int bytes_per_char;
 
-  bytes_per_char = p_font_in->Width * p_font_in->Height * 4;
-  p_font->data = malloc(nb_char_in_font * bytes_per_char);
+  if (format != DRAW_FORMAT_A8 && format != DRAW_FORMAT_A4)
+    return -1;
+
+  p_font->width = p_font_in->Width;
+  p_font->height = p_font_in->Height;
+  p_font->format = format;
+  p_font->stride = draw_format_stride(format, p_font->width);
+  DRAW_FontSetColor(p_font, 0xffffff, 0x40000000);
+
+  bytes_per_char = draw_font_char_size(p_font);
+  p_font->data = calloc(nb_char_in_font, bytes_per_char);
   if (!p_font->data)
     return -1;
 
   return draw_font_setup_with_memory(p_font_in, p_font, p_font->data, nb_char_in_font * bytes_per_char);
 }
 
+void DRAW_FontSetColor(DRAW_Font_t *p_font, uint32_t color, uint32_t bg_color)
+{
+  p_font->color = color & 0xffffff;
+  p_font->bg_color = bg_color;
+}
+
 void DRAW_RectArgbHw(uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos, int width, int height,
                      uint32_t color)
 {
@@ -219,7 +733,7 @@ void DRAW_RectArgbHw(uint8_t *p_dst, int dst_width, int dst_height, int x_pos, i
 void DRAW_FillArgbHw(uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos, int width, int height,
                      uint32_t color)
 {
-  draw_fill_argb_hw(p_dst, dst_width, dst_height, x_pos, y_pos, width, height, color);
+  draw_fill_argb_hw(p_dst, dst_width, dst_height, x_pos, y_pos, width, height, color, 0);
 }
 
 void DRAW_PrintfArgbHw(DRAW_Font_t *p_font, uint8_t *p_dst, int dst_width, int dst_height, int x_pos, int y_pos,
@@ -239,7 +753,253 @@ void DRAW_PrintfArgbHw(DRAW_Font_t *p_font, uint8_t *p_dst, int dst_width, int d
 void DRAW_CopyArgbHW(uint8_t *p_dst, int dst_width, int dst_height, uint8_t *p_src, int src_width, int src_height,
                      int x_offset, int y_offset)
 {
-  draw_copy_argb_hw(p_dst, dst_width, dst_height, p_src, src_width, src_height, x_offset, y_offset);
+  draw_blend_hw(p_dst, dst_width, dst_height, p_src, src_width, src_height, src_width, DRAW_FORMAT_ARGB8888, 0,
+                x_offset, y_offset);
+}
+
+void DRAW_TextCacheInit(DRAW_TextCache_t *p_cache, uint8_t *p_mem)
+{
+  int i;
+
+  memset(p_cache, 0, sizeof(*p_cache));
+  /* gen 0 is reserved so free entries look least recently used */
+  p_cache->gen = 1;
+  for (i = 0; i < DRAW_TEXT_CACHE_ENTRY_NB; i++)
+    p_cache->entries[i].p_strip = &p_mem[i * DRAW_TEXT_CACHE_ENTRY_SIZE];
+}
+
+static void draw_list_begin(DRAW_List_t *p_list, uint8_t *p_dst, int dst_width, int dst_height,
+                            DRAW_Format_t dst_format, DRAW_TextCache_t *p_cache)
+{
+  p_list->p_dst = p_dst;
+  p_list->dst_width = dst_width;
+  p_list->dst_height = dst_height;
+  p_list->dst_format = dst_format;
+  p_list->p_cache = p_cache;
+  p_list->x_origin = 0;
+  p_list->y_origin = 0;
+  p_list->is_deferred = 0;
+  p_list->is_sig_valid = 0;
+  p_list->cmd_nb = 0;
+  p_list->text_len = 0;
+  p_list->push_cmd = 0;
+  p_list->push_char = 0;
+  p_list->transfer_nb = 0;
+  p_list->byte_nb = 0;
+  p_list->fence = FAL_DMA2D_GetFence();
+}
+
+/* FNV-1a of recorded commands. Glyph runs hold their text, copies of cached text hold the strip revision */
+static uint32_t draw_list_sig(DRAW_List_t *p_list)
+{
+  const uint8_t *p_data[] = { (uint8_t *) p_list->cmds, (uint8_t *) p_list->text };
+  int size[] = { p_list->cmd_nb * (int) sizeof(DRAW_Cmd_t), p_list->text_len };
+  uint32_t sig = 2166136261U;
+  int i, j;
+
+  for (i = 0; i < ARRAY_NB(p_data); i++) {
+    for (j = 0; j < size[i]; j++) {
+      sig ^= p_data[i][j];
+      sig *= 16777619U;
+    }
+  }
+
+  return sig;
+}
+
+void DRAW_ListBegin(DRAW_List_t *p_list, uint8_t *p_dst, int dst_width, int dst_height, DRAW_TextCache_t *p_cache)
+{
+  DRAW_ListBeginFormat(p_list, p_dst, dst_width, dst_height, DRAW_FORMAT_ARGB8888, p_cache);
+}
+
+void DRAW_ListBeginFormat(DRAW_List_t *p_list, uint8_t *p_dst, int dst_width, int dst_height, DRAW_Format_t dst_format,
+                          DRAW_TextCache_t *p_cache)
+{
+  assert(dst_format == DRAW_FORMAT_ARGB8888 || dst_format == DRAW_FORMAT_NV12);
+
+  draw_list_begin(p_list, p_dst, dst_width, dst_height, dst_format, p_cache);
+  if (p_cache)
+    p_cache->gen++;
+}
+
+static void draw_list_fill(DRAW_List_t *p_list, DRAW_CmdType_t type, int x_pos, int y_pos, int width, int height,
+                           uint32_t color)
+{
+  DRAW_Cmd_t *cmd;
+
+  if (width <= 0 || height <= 0)
+    return;
+
+  cmd = draw_list_add(p_list, type, 0);
+  cmd->x_pos = x_pos - p_list->x_origin;
+  cmd->y_pos = y_pos - p_list->y_origin;
+  cmd->width = width;
+  cmd->height = height;
+  cmd->color = color;
+}
+
+static void draw_list_copy(DRAW_List_t *p_list, uint8_t *p_src, int src_width, int src_height, int src_stride,
+                           DRAW_Format_t format, uint32_t color, uint32_t rev, int x_offset, int y_offset)
+{
+  DRAW_Cmd_t *cmd;
+
+  cmd = draw_list_add(p_list, DRAW_CMD_COPY, 0);
+  cmd->x_pos = x_offset - p_list->x_origin;
+  cmd->y_pos = y_offset - p_list->y_origin;
+  cmd->width = src_width;
+  cmd->height = src_height;
+  cmd->copy.p_src = p_src;
+  cmd->copy.stride = src_stride;
+  cmd->copy.format = format;
+  cmd->copy.color = color;
+  cmd->copy.rev = rev;
+}
+
+void DRAW_ListFill(DRAW_List_t *p_list, int x_pos, int y_pos, int width, int height, uint32_t color)
+{
+  draw_list_fill(p_list, DRAW_CMD_FILL, x_pos, y_pos, width, height, color);
+  draw_list_push(p_list, 0);
+}
+
+void DRAW_ListRect(DRAW_List_t *p_list, int x_pos, int y_pos, int width, int height, uint32_t color)
+{
+  draw_list_fill(p_list, DRAW_CMD_FILL, x_pos, y_pos, width, 1, color);
+  draw_list_fill(p_list, DRAW_CMD_FILL, x_pos, y_pos + height - 1, width, 1, color);
+  draw_list_fill(p_list, DRAW_CMD_FILL, x_pos, y_pos, 1, height, color);
+  draw_list_fill(p_list, DRAW_CMD_FILL, x_pos + width - 1, y_pos, 1, height, color);
+  draw_list_push(p_list, 0);
+}
+
+void DRAW_ListCopy(DRAW_List_t *p_list, uint8_t *p_src, int src_width, int src_height, int x_offset, int y_offset)
+{
+  draw_list_copy(p_list, p_src, src_width, src_height, src_width, DRAW_FORMAT_ARGB8888, 0, 0, x_offset, y_offset);
+  draw_list_push(p_list, 0);
+}
+
+void DRAW_ListPrintf(DRAW_List_t *p_list, DRAW_Font_t *p_font, int x_pos, int y_pos, const char * format, ...)
+{
+  char buffer[MAX_LINE_CHAR + 1];
+  DRAW_TextEntry_t *entry;
+  DRAW_Cmd_t *cmd;
+  va_list args;
+  int len;
+
+  buffer[MAX_LINE_CHAR] = '\0';
+
+  va_start(args, format);
+  vsnprintf(buffer, MAX_LINE_CHAR, format, args);
+  va_end(args);
+
+  len = strlen(buffer);
+  if (!len)
+    return;
+
+  if (p_font->bg_color >> 24)
+    draw_list_fill(p_list, DRAW_CMD_FILL_BLEND, x_pos, y_pos, len * p_font->width, p_font->height, p_font->bg_color);
+
+  entry = p_list->p_cache ? draw_text_lookup(p_list->p_cache, p_font, buffer, len) : NULL;
+  if (entry) {
+    draw_list_copy(p_list, entry->p_strip, len * p_font->width, p_font->height, draw_text_stride(p_font, len),
+                   p_font->format, p_font->color, entry->rev, x_pos, y_pos);
+    draw_list_push(p_list, 0);
+    return;
+  }
+
+  /* Glyph run: one command, one transfer per character */
+  cmd = draw_list_add(p_list, DRAW_CMD_TEXT, len);
+  cmd->x_pos = x_pos - p_list->x_origin;
+  cmd->y_pos = y_pos - p_list->y_origin;
+  cmd->text.p_font = p_font;
+  cmd->text.pos = p_list->text_len;
+  cmd->text.len = len;
+  cmd->text.color = p_font->color;
+  memcpy(&p_list->text[p_list->text_len], buffer, len);
+  p_list->text_len += len;
+  draw_list_push(p_list, 0);
+}
+
+void DRAW_ListSubmit(DRAW_List_t *p_list)
+{
+  draw_list_push(p_list, 1);
+}
+
+uint32_t DRAW_ListWait(DRAW_List_t *p_list)
+{
+  DRAW_HwLock(NULL);
+  draw_fence_wait(p_list->fence);
+  DRAW_HwUnlock();
+
+  return p_list->transfer_nb;
+}
+
+uint32_t DRAW_ListExec(DRAW_List_t *p_list)
+{
+  DRAW_ListSubmit(p_list);
+
+  return DRAW_ListWait(p_list);
+}
+
+void DRAW_ListRegion(DRAW_List_t *p_list, DRAW_Region_t *p_region)
+{
+  /* cpu reads region once DMA2D has redrawn it */
+  if (p_list->dst_format == DRAW_FORMAT_NV12) {
+    DRAW_HwLock(NULL);
+    draw_fence_wait(FAL_DMA2D_GetFence());
+    DRAW_HwUnlock();
+    FAL_CacheInvalidate(p_region->p_buf, p_region->width * p_region->height * 4);
+  }
+  draw_list_copy(p_list, p_region->p_buf, p_region->width, p_region->height, p_region->width, DRAW_FORMAT_ARGB8888, 0,
+                 0, p_region->x_pos, p_region->y_pos);
+  draw_list_push(p_list, 0);
+}
+
+void DRAW_RegionInit(DRAW_Region_t *p_region, uint8_t *p_buf, int buf_size)
+{
+  memset(p_region, 0, sizeof(*p_region));
+  p_region->p_buf = p_buf;
+  p_region->buf_size = buf_size;
+}
+
+int DRAW_RegionBegin(DRAW_Region_t *p_region, DRAW_List_t *p_list, DRAW_TextCache_t *p_cache, int x_pos, int y_pos,
+                     int width, int height)
+{
+  if (width <= 0 || height <= 0 || width * height * 4 > p_region->buf_size)
+    return -1;
+
+  if (x_pos != p_region->x_pos || y_pos != p_region->y_pos || width != p_region->width || height != p_region->height)
+    p_region->is_valid = 0;
+  p_region->x_pos = x_pos;
+  p_region->y_pos = y_pos;
+  p_region->width = width;
+  p_region->height = height;
+
+  /* Text cache generation is the one of the frame list */
+  draw_list_begin(p_list, p_region->p_buf, width, height, DRAW_FORMAT_ARGB8888, p_cache);
+  p_list->x_origin = x_pos;
+  p_list->y_origin = y_pos;
+  p_list->is_deferred = 1;
+  p_list->is_sig_valid = 1;
+  draw_list_fill(p_list, DRAW_CMD_FILL, x_pos, y_pos, width, height, 0x00000000);
+
+  return 0;
+}
+
+int DRAW_RegionEnd(DRAW_Region_t *p_region, DRAW_List_t *p_list)
+{
+  uint32_t sig = draw_list_sig(p_list);
+
+  if (p_list->is_sig_valid && p_region->is_valid && sig == p_region->sig) {
+    p_list->cmd_nb = 0;
+    p_list->text_len = 0;
+    return 0;
+  }
+
+  p_region->sig = sig;
+  p_region->is_valid = p_list->is_sig_valid;
+  p_list->is_deferred = 0;
+  DRAW_ListSubmit(p_list);
+
+  return 1;
 }
 
 WEAK void DRAW_HwLock(void *dma2d_handle)
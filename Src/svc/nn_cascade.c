@@ -0,0 +1,182 @@
+/**
+ ******************************************************************************
+ * @file    nn_cascade.c
+ * @author  GPM Application Team
+ *
+ ******************************************************************************
+ * @attention
+ *
+ * Copyright (c) 2024 STMicroelectronics.
+ * All rights reserved.
+ *
+ * This software is licensed under terms that can be found in the LICENSE file
+ * in the root directory of this software component.
+ * If no LICENSE file comes with this software, it is provided AS-IS.
+ *
+ ******************************************************************************
+ */
+
+#include "svc/nn_cascade.h"
+
+#include <string.h>
+
+#include "app/app_config.h"
+#include "fal/fal_cache.h"
+#include "svc/app_stats.h"
+
+/* Detections beyond this count are always skipped */
+#define NN_CASCADE_DET_MAX 32
+
+#if CAPTURE_YUV420SP
+static uint8_t nn_cascade_clamp(int v)
+{
+  return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+#endif
+
+/* ROI in frame pixels, at least one pixel wide and high */
+static void nn_cascade_roi(const nn_cascade_frame_t *frame, const od_pp_outBuffer_t *det, int *x0, int *y0, int *w,
+                           int *h)
+{
+  int x1 = (int) ((det->x_center + det->width / 2) * frame->width);
+  int y1 = (int) ((det->y_center + det->height / 2) * frame->height);
+
+  *x0 = (int) ((det->x_center - det->width / 2) * frame->width);
+  *y0 = (int) ((det->y_center - det->height / 2) * frame->height);
+  *x0 = *x0 < 0 ? 0 : *x0 >= frame->width ? frame->width - 1 : *x0;
+  *y0 = *y0 < 0 ? 0 : *y0 >= frame->height ? frame->height - 1 : *y0;
+  x1 = x1 > frame->width ? frame->width : x1;
+  y1 = y1 > frame->height ? frame->height : y1;
+  *w = x1 > *x0 ? x1 - *x0 : 1;
+  *h = y1 > *y0 ? y1 - *y0 : 1;
+}
+
+/* Nearest neighbour resize of the ROI into the RGB888 model input. Capture is written by DCMIPP
+ * so each sampled row is invalidated before being read.
+ */
+static void nn_cascade_crop(const nn_cascade_conf_t *conf, const nn_cascade_frame_t *frame,
+                            const od_pp_outBuffer_t *det)
+{
+  const int pitch = frame->width * CAPTURE_BPP;
+  uint8_t *dst = conf->input;
+  const uint8_t *row;
+  int x0, y0, w, h;
+  int sx, sy;
+  int x, y;
+#if CAPTURE_YUV420SP
+  const uint8_t *row_uv;
+  int c, d, e;
+#endif
+
+  nn_cascade_roi(frame, det, &x0, &y0, &w, &h);
+  for (y = 0; y < conf->height; y++) {
+    sy = y0 + y * h / conf->height;
+    row = &frame->buffer[sy * pitch];
+    FAL_CacheCleanInvalidate((void *) &row[x0 * CAPTURE_BPP], w * CAPTURE_BPP);
+#if CAPTURE_YUV420SP
+    row_uv = &frame->buffer[frame->height * pitch + (sy / 2) * pitch];
+    FAL_CacheCleanInvalidate((void *) &row_uv[x0 & ~1], w + 2);
+#endif
+    for (x = 0; x < conf->width; x++) {
+      sx = x0 + x * w / conf->width;
+#if CAPTURE_YUV420SP
+      /* BT.601 limited range */
+      c = 298 * (row[sx] - 16) + 128;
+      d = row_uv[sx & ~1] - 128;
+      e = row_uv[(sx & ~1) + 1] - 128;
+      *dst++ = nn_cascade_clamp((c + 409 * e) >> 8);
+      *dst++ = nn_cascade_clamp((c - 100 * d - 208 * e) >> 8);
+      *dst++ = nn_cascade_clamp((c + 516 * d) >> 8);
+#else
+      /* ARGB8888 is B, G, R, A in memory */
+      *dst++ = row[sx * 4 + 2];
+      *dst++ = row[sx * 4 + 1];
+      *dst++ = row[sx * 4 + 0];
+#endif
+    }
+  }
+  FAL_CacheClean(conf->input, conf->width * conf->height * 3);
+}
+
+/* Quantized classifier output, one byte per class */
+static int nn_cascade_top_class(const uint8_t *output, uint32_t len)
+{
+  uint32_t best = 0;
+  uint32_t i;
+
+  for (i = 1; i < len; i++)
+    if (output[i] > output[best])
+      best = i;
+
+  return best;
+}
+
+int nn_cascade_init(nn_cascade_t *ctx, const nn_cascade_conf_t *conf)
+{
+  const nn_service_model_t *model = nn_service_get(conf->model);
+
+  if (!model || !conf->input || !conf->output || conf->width <= 0 || conf->height <= 0)
+    return -1;
+  if (model->user_input_size < (uint32_t) (conf->width * conf->height * 3))
+    return -1;
+
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->conf = *conf;
+
+  return 0;
+}
+
+int nn_cascade_run(nn_cascade_t *ctx, const nn_cascade_frame_t *frame, od_pp_outBuffer_t *dets, int det_nb,
+                   nn_cascade_res_t *res)
+{
+  const nn_service_model_t *model = nn_service_get(ctx->conf.model);
+  int order[NN_CASCADE_DET_MAX];
+  int roi_nb = det_nb < NN_CASCADE_DET_MAX ? det_nb : NN_CASCADE_DET_MAX;
+  uint32_t frame_ts = app_stats_timestamp();
+  uint32_t roi_us;
+  uint32_t ts;
+  int ret;
+  int i, j;
+
+  res->run_nb = 0;
+  res->skip_nb = det_nb - roi_nb;
+
+  /* Insertion sort by decreasing confidence, detections are few */
+  for (i = 0; i < roi_nb; i++) {
+    for (j = i; j > 0 && dets[order[j - 1]].conf < dets[i].conf; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+  if (ctx->conf.roi_max && roi_nb > ctx->conf.roi_max) {
+    res->skip_nb += roi_nb - ctx->conf.roi_max;
+    roi_nb = ctx->conf.roi_max;
+  }
+
+  for (i = 0; i < roi_nb; i++) {
+    if (app_stats_elapsed_us(frame_ts) + ctx->roi_cost_us > ctx->conf.budget_us) {
+      res->skip_nb += roi_nb - i;
+      /* Estimate only moves when ROIs run, decay it so an outlier cannot starve them for good */
+      if (i == 0)
+        ctx->roi_cost_us -= ctx->roi_cost_us / 4;
+      break;
+    }
+
+    ts = app_stats_timestamp();
+    nn_cascade_crop(&ctx->conf, frame, &dets[order[i]]);
+    FAL_CacheInvalidate(ctx->conf.output, model->user_output_size);
+    ret = nn_service_run(ctx->conf.model, ctx->conf.input, model->user_input_size, ctx->conf.output,
+                         model->user_output_size);
+    if (ret != NN_SERVICE_OK)
+      return ret;
+    dets[order[i]].class_index = nn_cascade_top_class(ctx->conf.output, model->user_output_size);
+    res->run_nb++;
+
+    /* A ROI queued behind the detector on the NPU is an outlier, clamp it */
+    roi_us = app_stats_elapsed_us(ts);
+    if (ctx->roi_cost_us && roi_us > 2 * ctx->roi_cost_us)
+      roi_us = 2 * ctx->roi_cost_us;
+    ctx->roi_cost_us = ctx->roi_cost_us ? (ctx->roi_cost_us * 3 + roi_us) / 4 : roi_us;
+  }
+
+  return 0;
+}
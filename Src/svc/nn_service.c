@@ -21,6 +21,27 @@
 #include <assert.h>
 #include <string.h>
 
+#include "FreeRTOS.h"
+#include "semphr.h"
+#include "stm32n6xx_hal.h"
+#include "svc/app_stats.h"
+#if defined(LL_ATON_RT_RELOC)
+#include "ll_aton_reloc_network.h"
+#endif
+
+/* One inference request per model */
+typedef struct
+{
+  /* given when the model gets the NPU */
+  SemaphoreHandle_t grant;
+  StaticSemaphore_t grant_buffer;
+  uint32_t deadline_ts;
+  /* last LL_ATON_RT_RunEpochBlock() result, between nn_service_run_start() and nn_service_run_wait() */
+  LL_ATON_RT_RetValues_t rt_ret;
+  uint8_t is_running;
+  uint8_t is_waiting;
+} nn_service_job_t;
+
 typedef struct
 {
   nn_service_model_t models[NN_SERVICE_MAX_MODELS];
@@ -29,6 +50,12 @@ typedef struct
   uint32_t max_output_size;
   uint8_t runtime_ready;
   nn_service_model_t *active;
+  nn_service_job_t jobs[NN_SERVICE_MAX_MODELS];
+  /* model running on the NPU, the others wait for their grant */
+  nn_service_handle_t npu_owner;
+  /* protects jobs and npu_owner, never held across an epoch block */
+  SemaphoreHandle_t sched_lock;
+  StaticSemaphore_t sched_lock_buffer;
 } nn_service_ctx_t;
 
 static nn_service_ctx_t nn_ctx;
@@ -69,9 +96,57 @@ static const char *nn_service_model_name(const nn_service_model_cfg_t *cfg)
   return "unnamed";
 }
 
+/* Copies code and data into exec_ram and resolves them, weights stay in the binary. The instance then
+ * gets the network interface of the binary.
+ */
+static nn_service_status_t nn_service_reloc_install(const nn_service_reloc_cfg_t *reloc, NN_Instance_TypeDef *instance,
+                                                    uint32_t *install_us)
+{
+#if defined(LL_ATON_RT_RELOC)
+  ll_aton_reloc_config config = {
+    .exec_ram_addr = (uintptr_t) reloc->exec_ram,
+    .exec_ram_size = reloc->exec_ram_size,
+    .ext_ram_addr = (uintptr_t) reloc->ext_ram,
+    .ext_ram_size = reloc->ext_ram_size,
+    .mode = AI_RELOC_RT_LOAD_MODE_COPY,
+  };
+  ll_aton_reloc_info info;
+  uint32_t ts;
+
+  if (ll_aton_reloc_get_info(reloc->file, &info) != AI_RELOC_RT_ERR_NONE)
+    return NN_SERVICE_ERR_RELOC;
+  if (info.rt_ram_copy > reloc->exec_ram_size || info.ext_ram_sz > reloc->ext_ram_size)
+    return NN_SERVICE_ERR_RELOC;
+
+  ts = app_stats_timestamp();
+  if (ll_aton_reloc_install(reloc->file, &config, instance) != AI_RELOC_RT_ERR_NONE)
+    return NN_SERVICE_ERR_RELOC;
+  *install_us = app_stats_elapsed_us(ts);
+
+  return NN_SERVICE_OK;
+#else
+  (void) reloc;
+  (void) instance;
+  (void) install_us;
+
+  return NN_SERVICE_ERR_RELOC;
+#endif
+}
+
 nn_service_status_t nn_service_init(void)
 {
+  int i;
+
   memset(&nn_ctx, 0, sizeof(nn_ctx));
+  nn_ctx.npu_owner = NN_SERVICE_INVALID_HANDLE;
+  nn_ctx.sched_lock = xSemaphoreCreateMutexStatic(&nn_ctx.sched_lock_buffer);
+  if (!nn_ctx.sched_lock)
+    return NN_SERVICE_ERR_INIT;
+  for (i = 0; i < NN_SERVICE_MAX_MODELS; i++) {
+    nn_ctx.jobs[i].grant = xSemaphoreCreateCountingStatic(1, 0, &nn_ctx.jobs[i].grant_buffer);
+    if (!nn_ctx.jobs[i].grant)
+      return NN_SERVICE_ERR_INIT;
+  }
   LL_ATON_RT_RuntimeInit();
   nn_ctx.runtime_ready = 1;
 
@@ -85,6 +160,7 @@ nn_service_status_t nn_service_register(const nn_service_model_cfg_t *cfg, nn_se
   const LL_Buffer_InfoTypeDef *first_input;
   const LL_Buffer_InfoTypeDef *first_output;
   nn_service_model_t *model;
+  nn_service_status_t status;
 
   if (!nn_ctx.runtime_ready)
     return NN_SERVICE_ERR_INIT;
@@ -96,10 +172,19 @@ nn_service_status_t nn_service_register(const nn_service_model_cfg_t *cfg, nn_se
   model = &nn_ctx.models[nn_ctx.count];
   memset(model, 0, sizeof(*model));
 
+  if (cfg->reloc) {
+    status = nn_service_reloc_install(cfg->reloc, cfg->instance, &model->install_us);
+    if (status != NN_SERVICE_OK)
+      return status;
+    model->is_reloc = 1;
+  }
+
   model->handle = (nn_service_handle_t) nn_ctx.count;
   model->name = nn_service_model_name(cfg);
   model->instance = cfg->instance;
   model->postprocess_type = cfg->postprocess_type;
+  model->priority = cfg->priority;
+  model->deadline_us = cfg->deadline_us;
 
   inputs_info = model->instance->network && model->instance->network->input_buffers_info
                     ? model->instance->network->input_buffers_info()
@@ -131,22 +216,64 @@ nn_service_status_t nn_service_register(const nn_service_model_cfg_t *cfg, nn_se
   return NN_SERVICE_OK;
 }
 
+static void nn_service_model_init(nn_service_model_t *model)
+{
+  uint32_t ts;
+
+  if (model->is_initialized)
+    return;
+
+  ts = app_stats_timestamp();
+  LL_ATON_RT_Init_Network(model->instance);
+  model->init_us = app_stats_elapsed_us(ts);
+  model->is_initialized = 1;
+}
+
+nn_service_status_t nn_service_preinit(void)
+{
+  uint32_t i;
+
+  if (!nn_ctx.runtime_ready)
+    return NN_SERVICE_ERR_INIT;
+
+  for (i = 0; i < nn_ctx.count; i++)
+    nn_service_model_init(&nn_ctx.models[i]);
+
+  return NN_SERVICE_OK;
+}
+
 nn_service_status_t nn_service_select(nn_service_handle_t handle)
 {
+  uint32_t ts = app_stats_timestamp();
+  nn_service_model_t *model;
+
   if (!nn_ctx.runtime_ready)
     return NN_SERVICE_ERR_INIT;
   if (handle < 0 || (uint32_t) handle >= nn_ctx.count)
     return NN_SERVICE_ERR_ARGS;
 
-  nn_ctx.active = &nn_ctx.models[handle];
-  if (!nn_ctx.active->is_initialized) {
-    LL_ATON_RT_Init_Network(nn_ctx.active->instance);
-    nn_ctx.active->is_initialized = 1;
-  }
+  model = &nn_ctx.models[handle];
+  nn_service_model_init(model);
+  nn_ctx.active = model;
+  model->select_nb++;
+  model->switch_us = app_stats_elapsed_us(ts);
 
   return NN_SERVICE_OK;
 }
 
+uint32_t nn_service_switch_cost_us(nn_service_handle_t handle)
+{
+  const nn_service_model_t *model = nn_service_get(handle);
+
+  if (!model)
+    return 0;
+
+  if (!model->is_initialized)
+    return UINT32_MAX;
+
+  return model->switch_us;
+}
+
 const nn_service_model_t *nn_service_active(void)
 {
   return nn_ctx.active;
@@ -160,30 +287,230 @@ const nn_service_model_t *nn_service_get(nn_service_handle_t handle)
   return &nn_ctx.models[handle];
 }
 
+static nn_service_status_t nn_service_model_prepare_io(nn_service_model_t *model, uint8_t *input, uint32_t input_len,
+                                                       uint8_t *output, uint32_t output_len)
+{
+  if (!input || !output)
+    return NN_SERVICE_ERR_ARGS;
+
+  nn_service_model_init(model);
+
+  if (input_len < model->user_input_size || output_len < model->user_output_size)
+    return NN_SERVICE_ERR_ARGS;
+
+  if (LL_ATON_Set_User_Input_Buffer(model->instance, 0, input, input_len) != LL_ATON_User_IO_NOERROR)
+    return NN_SERVICE_ERR_IO;
+  if (LL_ATON_Set_User_Output_Buffer(model->instance, 0, output, output_len) != LL_ATON_User_IO_NOERROR)
+    return NN_SERVICE_ERR_IO;
+
+  return NN_SERVICE_OK;
+}
+
 nn_service_status_t nn_service_prepare_io(uint8_t *input, uint32_t input_len, uint8_t *output, uint32_t output_len)
 {
   if (!nn_ctx.runtime_ready || nn_ctx.active == NULL)
     return NN_SERVICE_ERR_INIT;
-  if (!input || !output)
+
+  return nn_service_model_prepare_io(nn_ctx.active, input, input_len, output, output_len);
+}
+
+/* Higher priority first, then earlier deadline. A model without deadline comes last. */
+static int nn_service_job_is_before(nn_service_handle_t a, nn_service_handle_t b)
+{
+  const nn_service_model_t *ma = &nn_ctx.models[a];
+  const nn_service_model_t *mb = &nn_ctx.models[b];
+
+  if (ma->priority != mb->priority)
+    return ma->priority > mb->priority;
+  if (!ma->deadline_us || !mb->deadline_us)
+    return ma->deadline_us != 0 && mb->deadline_us == 0;
+
+  return (int32_t) (nn_ctx.jobs[a].deadline_ts - nn_ctx.jobs[b].deadline_ts) < 0;
+}
+
+/* With sched_lock held */
+static nn_service_handle_t nn_service_job_best_waiting(void)
+{
+  nn_service_handle_t best = NN_SERVICE_INVALID_HANDLE;
+  nn_service_handle_t i;
+
+  for (i = 0; i < (nn_service_handle_t) nn_ctx.count; i++)
+    if (nn_ctx.jobs[i].is_waiting && (best == NN_SERVICE_INVALID_HANDLE || nn_service_job_is_before(i, best)))
+      best = i;
+
+  return best;
+}
+
+/* With sched_lock held */
+static void nn_service_job_grant(nn_service_handle_t handle)
+{
+  int ret;
+
+  nn_ctx.npu_owner = handle;
+  if (handle == NN_SERVICE_INVALID_HANDLE)
+    return;
+
+  nn_ctx.jobs[handle].is_waiting = 0;
+  ret = xSemaphoreGive(nn_ctx.jobs[handle].grant);
+  assert(ret == pdTRUE);
+}
+
+static void nn_service_lock(void)
+{
+  int ret;
+
+  ret = xSemaphoreTake(nn_ctx.sched_lock, portMAX_DELAY);
+  assert(ret == pdTRUE);
+}
+
+static void nn_service_unlock(void)
+{
+  int ret;
+
+  ret = xSemaphoreGive(nn_ctx.sched_lock);
+  assert(ret == pdTRUE);
+}
+
+static void nn_service_job_wait_grant(nn_service_handle_t handle)
+{
+  int ret;
+
+  ret = xSemaphoreTake(nn_ctx.jobs[handle].grant, portMAX_DELAY);
+  assert(ret == pdTRUE);
+}
+
+/* An instance can only hand the NPU over once its epoch block released the ATON IP. The runtime
+ * has no public accessor for the IP owner, so this reads its private __ll_current_aton_ip_owner,
+ * checked against LL_ATON 1.1.1 (atonn-v1.1.1-14-ge619e860): set while an epoch block holds the
+ * IP, cleared once the block ends. Recheck on runtime updates.
+ */
+static int nn_service_aton_is_owner(NN_Instance_TypeDef *instance)
+{
+  extern NN_Instance_TypeDef *volatile __ll_current_aton_ip_owner;
+
+  return __ll_current_aton_ip_owner == instance;
+}
+
+/* Called between two epoch blocks of the owner, hands the NPU over to a better ranked job */
+static void nn_service_job_yield(nn_service_handle_t handle)
+{
+  nn_service_handle_t best;
+
+  nn_service_lock();
+  best = nn_service_job_best_waiting();
+  if (best == NN_SERVICE_INVALID_HANDLE || !nn_service_job_is_before(best, handle)) {
+    nn_service_unlock();
+    return;
+  }
+  nn_ctx.models[handle].preempt_nb++;
+  nn_ctx.jobs[handle].is_waiting = 1;
+  nn_service_job_grant(best);
+  nn_service_unlock();
+
+  nn_service_job_wait_grant(handle);
+}
+
+/* Runs epoch blocks until one is in flight on the NPU or the inference is done. Without is_yield,
+ * the NPU is kept between blocks.
+ */
+static LL_ATON_RT_RetValues_t nn_service_job_step(nn_service_handle_t handle, int is_yield)
+{
+  NN_Instance_TypeDef *instance = nn_ctx.models[handle].instance;
+  LL_ATON_RT_RetValues_t ll_aton_rt_ret;
+
+  do {
+    ll_aton_rt_ret = LL_ATON_RT_RunEpochBlock(instance);
+    if (is_yield && ll_aton_rt_ret == LL_ATON_RT_NO_WFE && !nn_service_aton_is_owner(instance))
+      nn_service_job_yield(handle);
+  } while (ll_aton_rt_ret == LL_ATON_RT_NO_WFE);
+
+  return ll_aton_rt_ret;
+}
+
+/* Hands the NPU over to the best waiting job */
+static void nn_service_job_release(nn_service_handle_t handle)
+{
+  nn_service_lock();
+  nn_ctx.jobs[handle].is_running = 0;
+  nn_service_job_grant(nn_service_job_best_waiting());
+  nn_service_unlock();
+}
+
+nn_service_status_t nn_service_run_start(nn_service_handle_t handle, uint8_t *input, uint32_t input_len,
+                                         uint8_t *output, uint32_t output_len)
+{
+  nn_service_job_t *job;
+  nn_service_status_t status;
+  int is_granted;
+
+  if (!nn_ctx.runtime_ready)
+    return NN_SERVICE_ERR_INIT;
+  if (handle < 0 || (uint32_t) handle >= nn_ctx.count)
     return NN_SERVICE_ERR_ARGS;
+  job = &nn_ctx.jobs[handle];
 
-  if (!nn_ctx.active->is_initialized) {
-    nn_service_status_t status = nn_service_select(nn_ctx.active->handle);
-    if (status != NN_SERVICE_OK)
-      return status;
+  nn_service_lock();
+  if (job->is_running) {
+    nn_service_unlock();
+    return NN_SERVICE_ERR_BUSY;
   }
+  job->is_running = 1;
+  job->deadline_ts = app_stats_timestamp() + nn_ctx.models[handle].deadline_us * (SystemCoreClock / 1000000);
+  is_granted = nn_ctx.npu_owner == NN_SERVICE_INVALID_HANDLE;
+  if (is_granted)
+    nn_ctx.npu_owner = handle;
+  else
+    job->is_waiting = 1;
+  nn_service_unlock();
+  if (!is_granted)
+    nn_service_job_wait_grant(handle);
+
+  status = nn_service_model_prepare_io(&nn_ctx.models[handle], input, input_len, output, output_len);
+  if (status != NN_SERVICE_OK) {
+    nn_service_job_release(handle);
+    return status;
+  }
+  /* No yield until a block is in flight, so start only blocks on the first grant */
+  job->rt_ret = nn_service_job_step(handle, 0);
+
+  return NN_SERVICE_OK;
+}
+
+nn_service_status_t nn_service_run_wait(nn_service_handle_t handle)
+{
+  nn_service_job_t *job;
 
-  if (input_len < nn_ctx.active->user_input_size || output_len < nn_ctx.active->user_output_size)
+  if (!nn_ctx.runtime_ready)
+    return NN_SERVICE_ERR_INIT;
+  if (handle < 0 || (uint32_t) handle >= nn_ctx.count)
+    return NN_SERVICE_ERR_ARGS;
+  job = &nn_ctx.jobs[handle];
+  if (!job->is_running)
     return NN_SERVICE_ERR_ARGS;
 
-  if (LL_ATON_Set_User_Input_Buffer(nn_ctx.active->instance, 0, input, input_len) != LL_ATON_User_IO_NOERROR)
-    return NN_SERVICE_ERR_IO;
-  if (LL_ATON_Set_User_Output_Buffer(nn_ctx.active->instance, 0, output, output_len) != LL_ATON_User_IO_NOERROR)
-    return NN_SERVICE_ERR_IO;
+  /* A block that ended while the caller was busy left its event pending, WFE returns at once */
+  while (job->rt_ret != LL_ATON_RT_DONE) {
+    LL_ATON_OSAL_WFE();
+    job->rt_ret = nn_service_job_step(handle, 1);
+  }
+  LL_ATON_RT_Reset_Network(nn_ctx.models[handle].instance);
+  nn_service_job_release(handle);
 
   return NN_SERVICE_OK;
 }
 
+nn_service_status_t nn_service_run(nn_service_handle_t handle, uint8_t *input, uint32_t input_len, uint8_t *output,
+                                   uint32_t output_len)
+{
+  nn_service_status_t status;
+
+  status = nn_service_run_start(handle, input, input_len, output, output_len);
+  if (status != NN_SERVICE_OK)
+    return status;
+
+  return nn_service_run_wait(handle);
+}
+
 uint32_t nn_service_max_input_size(void)
 {
   return nn_ctx.max_input_size;
@@ -7,6 +7,7 @@ C_SOURCES_AI += $(AI_REL_DIR)/Npu/ll_aton/ll_aton_osal_freertos.c
 C_SOURCES_AI += $(AI_REL_DIR)/Npu/ll_aton/ll_aton_debug.c
 C_SOURCES_AI += $(AI_REL_DIR)/Npu/ll_aton/ll_aton_lib.c
 C_SOURCES_AI += $(AI_REL_DIR)/Npu/ll_aton/ll_aton_lib_sw_operators.c
+C_SOURCES_AI += $(AI_REL_DIR)/Npu/ll_aton/ll_aton_reloc_network.c
 C_SOURCES_AI += $(AI_REL_DIR)/Npu/ll_aton/ll_aton_rt_main.c
 C_SOURCES_AI += $(AI_REL_DIR)/Npu/ll_aton/ll_aton_runtime.c
 C_SOURCES_AI += $(AI_REL_DIR)/Npu/ll_aton/ll_aton_util.c
@@ -37,6 +38,7 @@ C_INCLUDES_AI += -I$(PPW_REL_DIR)
 C_DEFS_AI += -DLL_ATON_PLATFORM=LL_ATON_PLAT_STM32N6
 C_DEFS_AI += -DLL_ATON_OSAL=LL_ATON_OSAL_FREERTOS
 C_DEFS_AI += -DLL_ATON_RT_MODE=LL_ATON_RT_ASYNC
+C_DEFS_AI += -DLL_ATON_RT_RELOC
 C_DEFS_AI += -DLL_ATON_SW_FALLBACK
 C_DEFS_AI += -DLL_ATON_DBG_BUFFER_INFO_EXCLUDED=1
 C_DEFS_AI += -DAPP_HAS_PARALLEL_NETWORKS=0
@@ -38,7 +38,10 @@ set(APP_SOURCES
     ${PROJECT_ROOT}/Src/bsp/platform.c
     ${PROJECT_ROOT}/Src/bsp/freertos_platform.c
     ${PROJECT_ROOT}/Src/svc/app_stats.c
+    ${PROJECT_ROOT}/Src/svc/app_trace.c
+    ${PROJECT_ROOT}/Src/svc/bitrate_ctrl.c
     ${PROJECT_ROOT}/Src/svc/nn_service.c
+    ${PROJECT_ROOT}/Src/svc/nn_cascade.c
     ${PROJECT_ROOT}/Src/svc/utils.c
     ${PROJECT_ROOT}/Src/svc/draw.c
     ${PROJECT_ROOT}/Src/bsp/stm32n6xx_it.c
@@ -97,6 +100,7 @@ list(APPEND APP_SOURCES
     ${LIB_ROOT}/AI_Runtime/Npu/ll_aton/ll_aton_debug.c
     ${LIB_ROOT}/AI_Runtime/Npu/ll_aton/ll_aton_lib.c
     ${LIB_ROOT}/AI_Runtime/Npu/ll_aton/ll_aton_lib_sw_operators.c
+    ${LIB_ROOT}/AI_Runtime/Npu/ll_aton/ll_aton_reloc_network.c
     ${LIB_ROOT}/AI_Runtime/Npu/ll_aton/ll_aton_rt_main.c
     ${LIB_ROOT}/AI_Runtime/Npu/ll_aton/ll_aton_runtime.c
     ${LIB_ROOT}/AI_Runtime/Npu/ll_aton/ll_aton_util.c
@@ -259,6 +263,7 @@ target_compile_definitions(${CMAKE_PROJECT_NAME} PRIVATE
     LL_ATON_PLATFORM=LL_ATON_PLAT_STM32N6
     LL_ATON_OSAL=LL_ATON_OSAL_FREERTOS
     LL_ATON_RT_MODE=LL_ATON_RT_ASYNC
+    LL_ATON_RT_RELOC
     LL_ATON_SW_FALLBACK
     LL_ATON_DBG_BUFFER_INFO_EXCLUDED=1
     UVC_LIB_USE_DMA